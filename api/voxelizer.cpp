@@ -0,0 +1,144 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "voxelizer.h"
+#include "../app.h"
+#include "../args.h"
+
+static VoxelizeParams get_params(const VoxelizerOptions &options) {
+    if (options.solid_axes != 0 && options.solid_axes != 1 && options.solid_axes != 3)
+        throw std::runtime_error("solid axes must be 0, 1 or 3.");
+
+    if (options.solid_axes > 0 && options.device == VOXELIZER_CPU)
+        throw std::runtime_error("solid voxelization needs the gpu.");
+
+    VoxelizeParams params{};
+    params.chunk_res = options.res;
+    params.chunk_size = static_cast<uint64_t>(options.res) * options.res * options.res;
+    params.morton_encode = options.morton;
+    params.solid_axes = options.solid_axes;
+    params.max_depth = options.max_depth > 0 ? options.max_depth : DEFAULT_MAX_DEPTH;
+    params.full_readback = options.full_readback;
+    params.mem_limit_mib = options.mem_limit_mib;
+    params.dev_count = options.dev_count;
+    params.sdf_bits = 8;
+    params.batch_time_ms = BATCH_DEFAULT_TIME_MS;
+
+    return params;
+}
+
+// the vertex layout of the pipeline, white like an obj without materials
+static void fill_mesh(const MeshView &mesh, App *p_app) {
+    if (mesh.positions.size() % 3 != 0 || mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+        throw std::runtime_error("mesh needs xyz positions and three indices per triangle.");
+
+    if (!mesh.normals.empty() && mesh.normals.size() != mesh.positions.size())
+        throw std::runtime_error("mesh normals do not match the positions.");
+
+    const size_t vert_count = mesh.positions.size() / 3;
+    if (std::any_of(mesh.indices.begin(), mesh.indices.end(),
+                    [&](const uint32_t index) { return index >= vert_count; }))
+        throw std::runtime_error("mesh index is out of range.");
+
+    p_app->vertices.resize(vert_count);
+    for (size_t i = 0; i < vert_count; i++) {
+        Vertex &vertex = p_app->vertices[i];
+        vertex.pos = glm::vec3(mesh.positions[3 * i], mesh.positions[3 * i + 1], mesh.positions[3 * i + 2]);
+        if (!mesh.normals.empty())
+            vertex.normal = glm::vec3(mesh.normals[3 * i], mesh.normals[3 * i + 1], mesh.normals[3 * i + 2]);
+        vertex.color = glm::vec3(1.0f);
+    }
+
+    p_app->indices.assign(mesh.indices.begin(), mesh.indices.end());
+}
+
+// runs the app on the kept device. a run that fails on the device frees what it created and resets the device, the
+// next call starts over.
+static void run_app(App *p_app, VCW_DeviceContext *p_dev_context, const MeshView &mesh, const bool verbose) {
+    p_app->p_dev_context = p_dev_context;
+
+    // the same limits as the cli, with the engine and the outputs of the call
+    if (const std::string problem = check_grid_res(p_app->params); !problem.empty())
+        throw std::runtime_error(problem);
+
+    fill_mesh(mesh, p_app);
+
+    // the app prints every stage, muted only for this run and not for the rest of the process
+    NullStreamBuf null_buf;
+    std::ostream null_log(&null_buf);
+    if (!verbose)
+        p_app->p_log = &null_log;
+
+    try {
+        p_app->run();
+    } catch (...) {
+        if (p_app->dev_in_use)
+            p_app->reset_dev();
+        throw;
+    }
+}
+
+Voxelizer::Voxelizer() : p_dev_context(std::make_unique<VCW_DeviceContext>()) {
+}
+
+Voxelizer::~Voxelizer() {
+    p_dev_context->clean_up();
+}
+
+void Voxelizer::voxelize(const MeshView &mesh, const VoxelizerOptions &options, std::span<uint8_t> grid) {
+    if (grid.size() != static_cast<uint64_t>(options.res) * options.res * options.res)
+        throw std::runtime_error("grid has to hold res^3 values.");
+
+    voxelize(mesh, options, [&](const uint8_t *p_grid, uint32_t) {
+        std::memcpy(grid.data(), p_grid, grid.size());
+    });
+}
+
+void Voxelizer::voxelize(const MeshView &mesh, const VoxelizerOptions &options, const GridFunc &grid_func,
+                         const SvoFunc &svo_func) {
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    App app{};
+    app.params = get_params(options);
+    app.params.grid_sink = grid_func;
+    if (svo_func) {
+        app.params.generate_svo = true;
+        app.params.svo_sink = svo_func;
+    }
+
+    const VoxelizerDevice device = options.device == VOXELIZER_AUTO && auto_device ? *auto_device : options.device;
+    if (device == VOXELIZER_AUTO)
+        app.params.engine = ENGINE_AUTO;
+    else
+        app.params.engine = device == VOXELIZER_CPU ? ENGINE_CPU : ENGINE_DENSE;
+
+    run_app(&app, p_dev_context.get(), mesh, options.verbose);
+
+    if (device == VOXELIZER_AUTO)
+        auto_device = app.params.engine == ENGINE_CPU ? VOXELIZER_CPU : VOXELIZER_GPU;
+
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    last_time = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+void Voxelizer::voxelize_list(const MeshView &mesh, const VoxelizerOptions &options, const VoxelListFunc &list_func) {
+    if (options.device == VOXELIZER_CPU)
+        throw std::runtime_error("the voxel list needs the hash engine on the gpu.");
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    VoxelizerOptions list_options = options;
+    list_options.morton = false;
+    list_options.solid_axes = 0;
+
+    App app{};
+    app.params = get_params(list_options);
+    app.params.engine = ENGINE_HASH;
+    app.params.list_sink = list_func;
+
+    run_app(&app, p_dev_context.get(), mesh, options.verbose);
+
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    last_time = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
@@ -0,0 +1,99 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#ifndef VCW_VOXELIZER_H
+#define VCW_VOXELIZER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include "vss.h"
+
+// in-process voxelization for programs that embed the converter: the mesh comes from memory and the outputs go to
+// caller buffers or callbacks, no files are written. a Voxelizer keeps its vulkan device and the compiled shaders
+// between calls, switching between the grid and the voxel list recreates the device. the shaders are read from
+// shaders/ of the working directory like the cli does. it is not thread safe, use one per thread.
+
+struct VCW_DeviceContext;
+
+struct MeshView {
+    // xyz per vertex
+    std::span<const float> positions;
+    // xyz per vertex, may be empty
+    std::span<const float> normals;
+    // three per triangle
+    std::span<const uint32_t> indices;
+};
+
+enum VoxelizerDevice : uint32_t {
+    VOXELIZER_GPU = 0,
+    VOXELIZER_CPU = 1,
+    // the gpu if a suitable one is found, decided on the first call
+    VOXELIZER_AUTO = 2
+};
+
+struct VoxelizerOptions {
+    uint32_t res = 256;
+    // morton order instead of linear, x fastest
+    bool morton = false;
+    VoxelizerDevice device = VOXELIZER_AUTO;
+
+    // 0 keeps the surface shell, 1 fills along z, 3 takes the majority of all axes. gpu only.
+    uint32_t solid_axes = 0;
+    // for the svo callback
+    uint32_t max_depth = 0;
+
+    // read back the whole grid instead of the occupied bricks
+    bool full_readback = false;
+    // caps the host and the device memory each in MiB, 0 uses what is free
+    uint32_t mem_limit_mib = 0;
+    // devices the tiles of a grid too large for one device are spread across, 0 takes every suitable gpu
+    uint32_t dev_count = 0;
+
+    // the progress of the stages goes to std::cout, it is discarded otherwise
+    bool verbose = false;
+};
+
+using GridFunc = std::function<void(const uint8_t *p_grid, uint32_t res)>;
+using SvoFunc = std::function<void(const Svo &svo)>;
+using VoxelListFunc = std::function<void(const uint64_t *p_codes, uint64_t count)>;
+
+class Voxelizer {
+public:
+    Voxelizer();
+
+    ~Voxelizer();
+
+    Voxelizer(const Voxelizer &) = delete;
+
+    Voxelizer &operator=(const Voxelizer &) = delete;
+
+    // copies res^3 values into grid, which has to hold exactly that many
+    void voxelize(const MeshView &mesh, const VoxelizerOptions &options, std::span<uint8_t> grid);
+
+    // hands the grid over without a copy, the pointers are only valid during the callbacks. the svo is built only if
+    // svo_func is set.
+    void voxelize(const MeshView &mesh, const VoxelizerOptions &options, const GridFunc &grid_func,
+                  const SvoFunc &svo_func = {});
+
+    // the ascending morton codes of the occupied voxels, from the hash engine on the gpu. morton and solid_axes are
+    // ignored.
+    void voxelize_list(const MeshView &mesh, const VoxelizerOptions &options, const VoxelListFunc &list_func);
+
+    // wall time of the last call in ms
+    double get_last_time() const {
+        return last_time;
+    }
+
+private:
+    std::unique_ptr<VCW_DeviceContext> p_dev_context;
+    // what VOXELIZER_AUTO resolved to
+    std::optional<VoxelizerDevice> auto_device;
+    double last_time = 0.0;
+};
+
+#endif //VCW_VOXELIZER_H
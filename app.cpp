@@ -65,12 +65,18 @@
 #endif
 
 void App::load_model() {
-    std::cout << std::endl << "--- Model loading ---" << std::endl;
+    TRACE_SCOPE(__func__);
+    *p_log << std::endl << "--- Model loading ---" << std::endl;
+    auto start_time = std::chrono::high_resolution_clock::now();
     std::string warn, err;
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, params.input_file.c_str(), params.material_dir.c_str()))
         throw std::runtime_error(err);
     if (!warn.empty())
-        std::cout << warn << std::endl;
+        *p_log << warn << std::endl;
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stage_times.parse = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    start_time = std::chrono::high_resolution_clock::now();
 
     std::unordered_map<Vertex, uint32_t> unique_vertices{};
 
@@ -94,9 +100,6 @@ void App::load_model() {
                         attrib.vertices[3 * index.vertex_index + 2]
                 };
 
-                min_vert_coord = glm::min(min_vert_coord, vertex.pos);
-                max_vert_coord = glm::max(max_vert_coord, vertex.pos);
-
                 vertex.normal = {
                         attrib.normals[3 * index.normal_index + 0],
                         attrib.normals[3 * index.normal_index + 1],
@@ -136,25 +139,53 @@ void App::load_model() {
         }
     }
 
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.dedup = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    prepare_mesh();
+}
+
+void App::prepare_mesh() {
+    TRACE_SCOPE(__func__);
+    for (const auto &vertex: vertices) {
+        min_vert_coord = glm::min(min_vert_coord, vertex.pos);
+        max_vert_coord = glm::max(max_vert_coord, vertex.pos);
+    }
     dim = max_vert_coord - min_vert_coord;
 
-    std::cout << "min vertex coord: " << min_vert_coord << std::endl;
-    std::cout << "max vertex coord: " << max_vert_coord << std::endl;
-    std::cout << "dimensions: " << dim << std::endl;
-    std::cout << "found " << vertices.size() << " vertices." << std::endl;
+    *p_log << "min vertex coord: " << min_vert_coord << std::endl;
+    *p_log << "max vertex coord: " << max_vert_coord << std::endl;
+    *p_log << "dimensions: " << dim << std::endl;
+    *p_log << "found " << vertices.size() << " vertices." << std::endl;
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    if (params.sort_tris)
+        sort_tris_morton();
+    if (params.classify_tris)
+        classify_tris();
+    else
+        raster_tri_count = static_cast<uint32_t>(indices.size() / 3);
+    if (params.reorder_verts)
+        reorder_vertices();
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    stage_times.reorder = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    if (params.sort_tris || params.classify_tris || params.reorder_verts)
+        *p_log << "reorder time: " << stage_times.reorder << "ms" << std::endl;
 }
 
 void App::init_app() {
-    render_extent = VkExtent2D{params.chunk_res, params.chunk_res};
+    TRACE_SCOPE(__func__);
 
     //
-    // vulkan core initialization
+    // vulkan core initialization, a device kept by the library is reused
     //
-    create_inst();
-    setup_debug_msg();
+    init_dev();
 
-    pick_phy_dev();
-    create_dev();
+    // decides the size of the render target, a tile worker renders the tiles planned by the main app
+    if (!tile_worker)
+        plan_memory();
+    render_extent = VkExtent2D{tile_res, tile_res};
 
     //
     // pipeline creation
@@ -164,22 +195,108 @@ void App::init_app() {
 
     create_cmd_pool();
 
+    auto start_time = std::chrono::high_resolution_clock::now();
     create_vert_buf();
     create_index_buf();
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stage_times.upload = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 
     create_unif_buf();
 
-    create_render_target();
+    if (params.use_textures) {
+        create_textures();
+        create_textures_sampler();
+    }
+
+    if (params.engine == ENGINE_HASH)
+        create_hash_bufs();
+    else
+        create_render_target();
 
     create_desc_pool_layout();
     create_pipe();
 
+    if (params.engine == ENGINE_HASH) {
+        create_hash_pipes();
+    } else {
+        create_stats_pipe();
+        if (params.solid_axes > 0)
+            create_solid_resources();
+        if (params.palette)
+            create_palette_resources();
+        if (params.lod_levels > 0)
+            create_lod_targets();
+        if (params.generate_sdf)
+            create_sdf_resources();
+        if (splat_tri_count > 0)
+            create_splat_pipe();
+    }
+
     create_sync();
+    create_query_pool();
+    if (trace_enabled())
+        calibrate_gpu_clock();
 
     create_desc_pool(MAX_FRAMES_IN_FLIGHT);
     write_desc_pool();
 
     create_cmd_bufs();
+
+    if (tile_count > 1 && !tile_worker)
+        init_tile_workers();
+}
+
+void App::init_dev() {
+    // a tile worker only creates a device, on the physical device and in the instance of the main app
+    if (tile_worker) {
+        vkGetPhysicalDeviceMemoryProperties(phy_dev, &phy_dev_mem_props);
+        vkGetPhysicalDeviceProperties(phy_dev, &phy_dev_props);
+        create_dev();
+        return;
+    }
+
+    if (p_dev_context != nullptr && p_dev_context->is_compatible(params)) {
+        inst = p_dev_context->inst;
+        debug_msg = p_dev_context->debug_msg;
+        phy_dev = p_dev_context->phy_dev;
+        phy_dev_mem_props = p_dev_context->phy_dev_mem_props;
+        phy_dev_props = p_dev_context->phy_dev_props;
+        qf_props = p_dev_context->qf_props;
+        qf_indices = p_dev_context->qf_indices;
+        dev = p_dev_context->dev;
+        q_graph = p_dev_context->q_graph;
+        calibrated_timestamps = p_dev_context->calibrated_timestamps;
+        return;
+    }
+
+    if (p_dev_context != nullptr)
+        p_dev_context->clean_up();
+
+    create_inst();
+    setup_debug_msg();
+
+    pick_phy_dev();
+    create_dev();
+
+    if (p_dev_context != nullptr) {
+        p_dev_context->inst = inst;
+        p_dev_context->debug_msg = debug_msg;
+        p_dev_context->phy_dev = phy_dev;
+        p_dev_context->phy_dev_mem_props = phy_dev_mem_props;
+        p_dev_context->phy_dev_props = phy_dev_props;
+        p_dev_context->qf_props = qf_props;
+        p_dev_context->qf_indices = qf_indices;
+        p_dev_context->dev = dev;
+        p_dev_context->q_graph = q_graph;
+        p_dev_context->calibrated_timestamps = calibrated_timestamps;
+        p_dev_context->engine = params.engine;
+        p_dev_context->use_textures = params.use_textures;
+
+        VkPipelineCacheCreateInfo cache_info{};
+        cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        if (vkCreatePipelineCache(dev, &cache_info, nullptr, &p_dev_context->pipe_cache) != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline cache.");
+    }
 }
 
 void App::create_vert_buf() {
@@ -190,7 +307,9 @@ void App::create_vert_buf() {
 
     cp_data_to_buf(&staging_buf, vertices.data());
 
-    vert_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    // splat.comp reads vertices and indices as storage buffers
+    vert_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     cp_buf(staging_buf, vert_buf);
@@ -207,7 +326,8 @@ void App::create_index_buf() {
 
     cp_data_to_buf(&staging_buf, indices.data());
 
-    index_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    index_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     cp_buf(staging_buf, index_buf);
@@ -216,7 +336,7 @@ void App::create_index_buf() {
 }
 
 void App::create_unif_buf() {
-    ubo.chunk_res = glm::vec4(glm::vec3(static_cast<float>(params.chunk_res)), 0);
+    ubo.chunk_res = glm::vec4(glm::vec3(static_cast<float>(tile_res)), 0);
 
     VkDeviceSize buf_size = sizeof(VCW_Uniform);
     unif_buf = create_buf(buf_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
@@ -225,8 +345,131 @@ void App::create_unif_buf() {
     cp_data_to_buf(&unif_buf, &ubo);
 }
 
+// every diffuse texture is loaded once, the files are decoded in parallel and uploaded with a full mip chain
+void App::create_textures() {
+    TRACE_SCOPE(__func__);
+    *p_log << "material count: " << materials.size() << std::endl;
+
+    std::vector<int32_t> mat_tex_ids(std::max<size_t>(materials.size(), 1), -1);
+    std::unordered_map<std::string, int32_t> tex_ids;
+    std::vector<std::string> tex_files;
+
+    for (size_t i = 0; i < materials.size(); i++) {
+        const std::string &name = materials[i].diffuse_texname;
+        if (name.empty())
+            continue;
+
+        if (!tex_ids.contains(name)) {
+            tex_ids[name] = static_cast<int32_t>(tex_files.size());
+            tex_files.push_back((std::filesystem::path(params.material_dir) / name).string());
+        }
+
+        mat_tex_ids[i] = tex_ids[name];
+    }
+
+    if (tex_files.size() > DESCRIPTOR_TEXTURE_COUNT)
+        throw std::runtime_error("too many textures, at most " + std::to_string(DESCRIPTOR_TEXTURE_COUNT) +
+                                 " are supported.");
+
+    struct DecodedTexture {
+        int width = 0, height = 0;
+        std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels{nullptr, stbi_image_free};
+    };
+
+    std::vector<std::future<DecodedTexture>> decoded;
+    for (const auto &file: tex_files) {
+        decoded.push_back(std::async(std::launch::async, [file] {
+            DecodedTexture tex{};
+            int channels;
+            tex.pixels.reset(stbi_load(file.c_str(), &tex.width, &tex.height, &channels, STBI_rgb_alpha));
+            return tex;
+        }));
+    }
+
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(phy_dev, VK_FORMAT_R8G8B8A8_UNORM, &format_props);
+    constexpr VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                                   VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    const bool linear_blit = (format_props.optimalTilingFeatures & blit_features) == blit_features;
+
+    try {
+        for (size_t i = 0; i < decoded.size(); i++) {
+            const DecodedTexture tex = decoded[i].get();
+            if (!tex.pixels)
+                throw std::runtime_error("failed to load texture image " + tex_files[i] + ".");
+
+            *p_log << "loaded texture: " << tex_files[i] << " (" << tex.width << "x" << tex.height << ")"
+                   << std::endl;
+
+            const VkDeviceSize img_size = static_cast<VkDeviceSize>(tex.width) * tex.height * 4;
+            VCW_Buffer staging_buf = create_buf(img_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+            cp_data_to_buf(&staging_buf, tex.pixels.get());
+
+            const VkExtent2D extent = {static_cast<uint32_t>(tex.width), static_cast<uint32_t>(tex.height)};
+            const uint32_t max_extent = std::max(extent.width, extent.height);
+            const uint32_t mip_levels = linear_blit ? static_cast<uint32_t>(std::bit_width(max_extent)) : 1;
+
+            VCW_Image tex_img = create_img(extent, VK_FORMAT_R8G8B8A8_UNORM,
+                                           VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                           VK_IMAGE_USAGE_SAMPLED_BIT,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, mip_levels);
+
+            VkCommandBuffer cmd_buf = begin_single_time_cmd();
+            transition_img_layout(cmd_buf, &tex_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            cp_buf_to_img(cmd_buf, staging_buf, tex_img, extent);
+            generate_mipmaps(cmd_buf, &tex_img);
+            end_single_time_cmd(cmd_buf);
+
+            VkImageSubresourceRange subres_range = DEFAULT_SUBRESOURCE_RANGE;
+            subres_range.levelCount = mip_levels;
+            create_img_view(&tex_img, VK_IMAGE_VIEW_TYPE_2D, subres_range);
+
+            clean_up_buf(staging_buf);
+
+            textures.push_back(tex_img);
+        }
+    } catch (...) {
+        // the decodes that are still running are waited for before the error leaves, their pixels are freed with
+        // the futures
+        for (auto &tex: decoded)
+            if (tex.valid())
+                tex.wait();
+        throw;
+    }
+    *p_log << "loaded textures: " << textures.size() << std::endl;
+
+    const VkDeviceSize buf_size = sizeof(int32_t) * mat_tex_ids.size();
+    VCW_Buffer staging_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    cp_data_to_buf(&staging_buf, mat_tex_ids.data());
+
+    mat_tex_buf = create_buf(buf_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    cp_buf(staging_buf, mat_tex_buf);
+
+    clean_up_buf(staging_buf);
+}
+
+void App::create_textures_sampler() {
+    tex_sampler = create_sampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+}
+
+void App::clean_up_textures() const {
+    for (const auto &tex: textures)
+        clean_up_img(tex);
+
+    vkDestroySampler(dev, tex_sampler, nullptr);
+    clean_up_buf(mat_tex_buf);
+}
+
 void App::create_render_target() {
-    VkExtent3D extent = {params.chunk_res, params.chunk_res, params.chunk_res};
+    VkExtent3D extent = {tile_res, tile_res, tile_res};
     render_target = create_img(extent, VK_FORMAT_R8_UINT,
                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
                                VK_IMAGE_USAGE_TRANSFER_DST_BIT,
@@ -234,7 +477,18 @@ void App::create_render_target() {
 
     create_img_view(&render_target, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
 
-    VkDeviceSize size = params.chunk_size * sizeof(uint8_t);
+    create_stats_bufs();
+
+    if (params.write_attributes)
+        create_attrib_targets();
+
+    brick_axis_count = div_ceil(tile_res, BRICK_RES);
+    if (!params.full_readback) {
+        create_brick_bufs();
+        return;
+    }
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(tile_res) * tile_res * tile_res * sizeof(uint8_t);
     transfer_buf = create_buf(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 }
@@ -252,35 +506,139 @@ void App::create_desc_pool_layout() {
     bindings.push_back(uniform_layout_binding);
     last_binding++;
 
-    VkDescriptorSetLayoutBinding render_target_layout_binding{};
-    render_target_layout_binding.binding = last_binding;
-    render_target_layout_binding.descriptorCount = 1;
-    render_target_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    render_target_layout_binding.pImmutableSamplers = nullptr;
-    render_target_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    bindings.push_back(render_target_layout_binding);
-    last_binding++;
+    if (params.engine == ENGINE_HASH) {
+        // hash table and hash info replace the render target
+        for (int i = 0; i < 2; ++i) {
+            VkDescriptorSetLayoutBinding hash_layout_binding{};
+            hash_layout_binding.binding = last_binding;
+            hash_layout_binding.descriptorCount = 1;
+            hash_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            hash_layout_binding.pImmutableSamplers = nullptr;
+            hash_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+            bindings.push_back(hash_layout_binding);
+            last_binding++;
+        }
+    } else {
+        VkDescriptorSetLayoutBinding render_target_layout_binding{};
+        render_target_layout_binding.binding = last_binding;
+        render_target_layout_binding.descriptorCount = 1;
+        render_target_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        render_target_layout_binding.pImmutableSamplers = nullptr;
+        render_target_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings.push_back(render_target_layout_binding);
+        last_binding++;
+
+        if (!params.full_readback) {
+            VkDescriptorSetLayoutBinding brick_layout_binding{};
+            brick_layout_binding.binding = last_binding;
+            brick_layout_binding.descriptorCount = 1;
+            brick_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            brick_layout_binding.pImmutableSamplers = nullptr;
+            brick_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+            bindings.push_back(brick_layout_binding);
+            last_binding++;
+        }
+
+        if (params.write_attributes) {
+            // color, normal and material, fixed bindings in shader.frag
+            for (uint32_t i = 0; i < 3; ++i) {
+                VkDescriptorSetLayoutBinding attrib_layout_binding{};
+                attrib_layout_binding.binding = 3 + i;
+                attrib_layout_binding.descriptorCount = 1;
+                attrib_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                attrib_layout_binding.pImmutableSamplers = nullptr;
+                attrib_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+                bindings.push_back(attrib_layout_binding);
+            }
+        }
+    }
+
+    if (params.use_textures) {
+        VkDescriptorSetLayoutBinding sampler_layout_binding{};
+        sampler_layout_binding.binding = 6;
+        sampler_layout_binding.descriptorCount = 1;
+        sampler_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        sampler_layout_binding.pImmutableSamplers = nullptr;
+        sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings.push_back(sampler_layout_binding);
+
+        VkDescriptorSetLayoutBinding tex_layout_binding{};
+        tex_layout_binding.binding = 7;
+        tex_layout_binding.descriptorCount = DESCRIPTOR_TEXTURE_COUNT;
+        tex_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        tex_layout_binding.pImmutableSamplers = nullptr;
+        tex_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings.push_back(tex_layout_binding);
+
+        VkDescriptorSetLayoutBinding mat_tex_layout_binding{};
+        mat_tex_layout_binding.binding = 8;
+        mat_tex_layout_binding.descriptorCount = 1;
+        mat_tex_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        mat_tex_layout_binding.pImmutableSamplers = nullptr;
+        mat_tex_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings.push_back(mat_tex_layout_binding);
+    }
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
         add_desc_set_layout(static_cast<uint32_t>(bindings.size()), bindings.data());
     }
 
     add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    if (params.engine == ENGINE_HASH) {
+        add_pool_size(2 * MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    } else {
+        add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        if (!params.full_readback)
+            add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        if (params.write_attributes)
+            add_pool_size(3 * MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    }
+    if (params.use_textures) {
+        add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_SAMPLER);
+        add_pool_size(DESCRIPTOR_TEXTURE_COUNT * MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+        add_pool_size(MAX_FRAMES_IN_FLIGHT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    }
+}
+
+std::vector<std::string> App::get_shader_defines() const {
+    std::vector<std::string> defines;
+
+    if (params.engine == ENGINE_HASH)
+        defines.emplace_back("HASH_ENGINE");
+
+    if (params.engine == ENGINE_DENSE && !params.full_readback) {
+        defines.emplace_back("BRICK_READBACK");
+        defines.emplace_back("BRICK_RES=" + std::to_string(BRICK_RES));
+    }
+
+    if (params.write_attributes) {
+        defines.emplace_back("ATTRIBUTES");
+        defines.emplace_back(materials.size() <= UINT8_MAX ? "MAT_FORMAT=r8ui" : "MAT_FORMAT=r16ui");
+    }
+
+    if (params.use_textures && !textures.empty()) {
+        defines.emplace_back("TEXTURES");
+        defines.emplace_back("TEXTURE_COUNT=" + std::to_string(DESCRIPTOR_TEXTURE_COUNT));
+    }
+
+    return defines;
 }
 
 void App::create_pipe() {
-    std::cout << std::endl << "--- Pipeline creation ---" << std::endl;
+    TRACE_SCOPE(__func__);
+    *p_log << std::endl << "--- Pipeline creation ---" << std::endl;
     std::string vert_code = read_file_string("shaders/shader.vert");
     std::string geom_code = read_file_string("shaders/shader.geom");
     std::string frag_code = read_file_string("shaders/shader.frag");
 
-    std::cout << "compiling vertex shader." << std::endl;
-    std::vector<uint32_t> vert_bin = compile_shader(vert_code, shaderc_glsl_vertex_shader, "main");
-    std::cout << "compiling geometry shader." << std::endl;
-    std::vector<uint32_t> geom_bin = compile_shader(geom_code, shaderc_glsl_geometry_shader, "main");
-    std::cout << "compiling fragment shader." << std::endl;
-    std::vector<uint32_t> frag_bin = compile_shader(frag_code, shaderc_glsl_fragment_shader, "main");
+    const std::vector<std::string> defines = get_shader_defines();
+
+    *p_log << "compiling vertex shader." << std::endl;
+    std::vector<uint32_t> vert_bin = compile_shader(vert_code, shaderc_glsl_vertex_shader, "main", defines);
+    *p_log << "compiling geometry shader." << std::endl;
+    std::vector<uint32_t> geom_bin = compile_shader(geom_code, shaderc_glsl_geometry_shader, "main", defines);
+    *p_log << "compiling fragment shader." << std::endl;
+    std::vector<uint32_t> frag_bin = compile_shader(frag_code, shaderc_glsl_fragment_shader, "main", defines);
 
     VkShaderModule vert_module = create_shader_mod(vert_bin);
     VkShaderModule geom_module = create_shader_mod(geom_bin);
@@ -400,7 +758,7 @@ void App::create_pipe() {
     pipe_info.subpass = 0;
     pipe_info.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, 1, &pipe_info, nullptr, &pipe) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(dev, get_pipe_cache(), 1, &pipe_info, nullptr, &pipe) != VK_SUCCESS)
         throw std::runtime_error("failed to create graphics pipeline.");
 
     vkDestroyShaderModule(dev, frag_module, nullptr);
@@ -411,8 +769,34 @@ void App::create_pipe() {
 void App::write_desc_pool() const {
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         write_buf_desc_binding(unif_buf, static_cast<uint32_t>(i), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        write_img_desc_binding(render_target, static_cast<uint32_t>(i), 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                               VK_IMAGE_LAYOUT_GENERAL);
+
+        if (params.engine == ENGINE_HASH) {
+            write_buf_desc_binding(hash_buf, static_cast<uint32_t>(i), 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+            write_buf_desc_binding(hash_info_buf, static_cast<uint32_t>(i), 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        } else {
+            write_img_desc_binding(render_target, static_cast<uint32_t>(i), 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                   VK_IMAGE_LAYOUT_GENERAL);
+            if (!params.full_readback)
+                write_buf_desc_binding(brick_buf, static_cast<uint32_t>(i), 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+            if (params.write_attributes) {
+                write_img_desc_binding(color_target, static_cast<uint32_t>(i), 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                       VK_IMAGE_LAYOUT_GENERAL);
+                write_img_desc_binding(normal_target, static_cast<uint32_t>(i), 4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                       VK_IMAGE_LAYOUT_GENERAL);
+                write_img_desc_binding(mat_target, static_cast<uint32_t>(i), 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                       VK_IMAGE_LAYOUT_GENERAL);
+            }
+        }
+
+        if (params.use_textures && !textures.empty()) {
+            // unused slots repeat the first texture, the array has to be fully written
+            std::vector<VCW_Image> tex_slots(DESCRIPTOR_TEXTURE_COUNT, textures[0]);
+            std::copy(textures.begin(), textures.end(), tex_slots.begin());
+
+            write_sampler_desc_binding(tex_sampler, static_cast<uint32_t>(i), 6);
+            write_img_desc_array(tex_slots, static_cast<uint32_t>(i), 7, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+            write_buf_desc_binding(mat_tex_buf, static_cast<uint32_t>(i), 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        }
     }
 }
 
@@ -421,13 +805,24 @@ void App::update_bufs(const uint32_t index_inflight_frame) {
     push_const.res = {render_extent.width, render_extent.height};
 }
 
-void App::record_cmd_buf(VkCommandBuffer cmd_buf) {
+// records one draw batch, the first batch also clears the targets and the last one reads them back
+void App::record_cmd_buf(VkCommandBuffer cmd_buf, const uint32_t first_tri, const uint32_t tri_count) {
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
     if (vkBeginCommandBuffer(cmd_buf, &begin_info) != VK_SUCCESS)
         throw std::runtime_error("failed to begin recording command buffer.");
 
+    // writes of the previous batch are in an earlier submission
+    if (first_tri == 0)
+        record_vox_begin(cmd_buf);
+    else
+        comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    const uint32_t batch_query = QUERY_BATCH_BEGIN + 2 * cur_frame;
+    vkCmdResetQueryPool(cmd_buf, query_pool, batch_query, 2);
+    record_timestamp(cmd_buf, batch_query, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
     VkRenderPassBeginInfo rendp_begin_info{};
     rendp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     rendp_begin_info.renderPass = rendp;
@@ -435,11 +830,6 @@ void App::record_cmd_buf(VkCommandBuffer cmd_buf) {
     rendp_begin_info.renderArea.offset = {0, 0};
     rendp_begin_info.renderArea.extent = render_extent;
 
-    vkCmdFillBuffer(cmd_buf, transfer_buf.buf, 0, transfer_buf.size, 0);
-
-    transition_img_layout(cmd_buf, &render_target, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT,
-                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-
     vkCmdBeginRenderPass(cmd_buf, &rendp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe);
 
@@ -467,12 +857,92 @@ void App::record_cmd_buf(VkCommandBuffer cmd_buf) {
     vkCmdPushConstants(cmd_buf, pipe_layout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(VCW_PushConstants),
                        &push_const);
 
-    vkCmdDrawIndexed(cmd_buf, static_cast<uint32_t>(indices_count), 1, 0, 0, 0);
+    // a batch can reach from the raster triangles into the parity passes
+    const uint32_t raster_count = first_tri < raster_tri_count ? std::min(tri_count, raster_tri_count - first_tri) : 0;
+    if (raster_count > 0)
+        vkCmdDrawIndexed(cmd_buf, 3 * raster_count, 1, 3 * first_tri, 0, 0);
 
     vkCmdEndRenderPass(cmd_buf);
 
+    if (raster_count < tri_count)
+        record_parity_draws(cmd_buf, first_tri + raster_count - raster_tri_count, tri_count - raster_count);
+
+    record_timestamp(cmd_buf, batch_query + 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    if (first_tri + tri_count == get_draw_tri_count())
+        record_vox_end(cmd_buf);
+
+    if (vkEndCommandBuffer(cmd_buf) != VK_SUCCESS)
+        throw std::runtime_error("failed to record command buffer.");
+}
+
+void App::record_vox_begin(VkCommandBuffer cmd_buf) {
+    vkCmdResetQueryPool(cmd_buf, query_pool, 0, QUERY_BATCH_BEGIN);
+    record_timestamp(cmd_buf, QUERY_VOX_BEGIN, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    if (params.engine == ENGINE_HASH) {
+        // clear hash table to HASH_EMPTY_KEY, reset count and overflow
+        vkCmdFillBuffer(cmd_buf, hash_buf.buf, 0, hash_buf.size, 0xFFFFFFFF);
+        vkCmdFillBuffer(cmd_buf, hash_info_buf.buf, offsetof(VCW_HashInfo, count), 2 * sizeof(uint32_t), 0);
+        vkCmdFillBuffer(cmd_buf, vox_list_buf.buf, 0, vox_list_buf.size, 0xFFFFFFFF);
+        comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        return;
+    }
+
+    if (params.full_readback)
+        vkCmdFillBuffer(cmd_buf, transfer_buf.buf, 0, transfer_buf.size, 0);
+    else
+        vkCmdFillBuffer(cmd_buf, brick_buf.buf, 0, brick_buf.size, 0);
+    record_stats_reset(cmd_buf);
+    if (params.solid_axes > 0)
+        record_parity_clear(cmd_buf);
+    if (params.write_attributes)
+        record_attrib_clear(cmd_buf);
+
+    // bricks are copied as a whole, so voxels that are not written have to be zero
+    transition_img_layout(cmd_buf, &render_target, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    constexpr VkClearColorValue clear_color = {};
+    vkCmdClearColorImage(cmd_buf, render_target.img, VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1,
+                         &DEFAULT_SUBRESOURCE_RANGE);
+    transition_img_layout(cmd_buf, &render_target, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+void App::record_vox_end(VkCommandBuffer cmd_buf) {
+    if (splat_tri_count > 0)
+        record_splat(cmd_buf);
+
+    record_timestamp(cmd_buf, QUERY_VOX_END, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    if (params.engine == ENGINE_HASH) {
+        record_hash_compact(cmd_buf);
+        return;
+    }
+
+    if (params.solid_axes > 0)
+        record_solid_fill(cmd_buf);
+
+    // the palette needs a round trip to the host, the grid is read back after remapping
+    if (params.palette)
+        record_palette_histogram(cmd_buf);
+    else
+        record_grid_readback(cmd_buf);
+}
+
+// statistics and either the occupancy bitmap or the full grid, everything else is copied by cp_img_bricks
+void App::record_grid_readback(VkCommandBuffer cmd_buf) {
+    record_stats(cmd_buf);
+
+    if (!params.full_readback) {
+        record_brick_readback(cmd_buf);
+        return;
+    }
+
     transition_img_layout(cmd_buf, &render_target, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
-                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT);
     buffer_memory_barrier(cmd_buf, &transfer_buf, VK_ACCESS_TRANSFER_WRITE_BIT,
                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
@@ -481,119 +951,373 @@ void App::record_cmd_buf(VkCommandBuffer cmd_buf) {
                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
     buffer_memory_barrier(cmd_buf, &transfer_buf, 0,
                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+}
 
-    if (vkEndCommandBuffer(cmd_buf) != VK_SUCCESS)
-        throw std::runtime_error("failed to record command buffer.");
+FileWriter &App::open_writer(const std::string &filename) {
+    writers.push_back(std::make_unique<FileWriter>(filename));
+    return *writers.back();
 }
 
-void App::comp_vox_grid() {
-    std::cout << std::endl << "--- Voxelization ---" << std::endl;
-    chunk_module.init(min_vert_coord, max_vert_coord, static_cast<float>(params.chunk_res));
+void App::finish_writers() {
+    TRACE_SCOPE(__func__);
+    for (const auto &p_writer: writers) {
+        p_writer->finish();
+        written_bytes += p_writer->get_size();
+        write_busy_ms += p_writer->get_busy_ms();
+    }
+    writers.clear();
+}
 
-    std::vector<uint8_t> cached_output(params.chunk_size);
-    std::cout << "render extent: " << render_extent.width << "x" << render_extent.height << std::endl;
+double App::get_write_throughput() const {
+    if (write_busy_ms <= 0.0)
+        return 0.0;
+    return static_cast<double>(written_bytes) / (1024.0 * 1024.0) / (write_busy_ms / 1000.0);
+}
 
-    BvoxHeader header{};
-    header.chunk_res = params.chunk_res;
-    header.chunk_size = params.chunk_size;
-    header.run_length_encoded = params.run_length_encode;
-    header.morton_encoded = params.morton_encode;
+void App::comp_vox_grid() {
+    *p_log << std::endl << "--- Voxelization ---" << std::endl;
+    chunk_module.init(min_vert_coord, max_vert_coord, static_cast<float>(params.chunk_res));
 
-    write_empty_bvox(params.output_file, header);
+    // the cpu engine and the tiles fill the grid directly, everything after the readback is shared
+    const bool cpu = params.engine == ENGINE_CPU;
+    const bool tiled = tile_count > 1;
+
+    // shared with the writer of the grid, which writes it without a copy
+    const auto p_output = std::make_shared<std::vector<uint8_t>>(params.chunk_size);
+    std::vector<uint8_t> &cached_output = *p_output;
+    if (!cpu)
+        *p_log << "render extent: " << render_extent.width << "x" << render_extent.height << std::endl;
+
+    // a plain bvox is the header and the grid as it is, both go through a writer. the run length stream of vss is
+    // appended to the header at the end, the chunked layout is written in one go.
+    BvoxHeader bvox_header{};
+    bvox_header.chunk_res = params.chunk_res;
+    // fits, see check_grid_res
+    bvox_header.chunk_size = static_cast<uint32_t>(params.chunk_size);
+    bvox_header.run_length_encoded = params.run_length_encode;
+    bvox_header.morton_encoded = params.morton_encode;
+
+    if (params.chunk_codec == CODEC_NONE && !params.grid_sink && params.run_length_encode)
+        write_empty_bvox(params.output_file, bvox_header);
     //
     // rendering / voxelization
     //
     auto start_time = std::chrono::high_resolution_clock::now();
-    render();
+    if (cpu) {
+        voxelize_cpu(cached_output.data());
+    } else if (tiled) {
+        voxelize_tiles(cached_output.data());
+    } else {
+        render();
+        vkQueueWaitIdle(q_graph);
+        trace_gpu_queries("voxelize", QUERY_VOX_BEGIN, QUERY_VOX_END);
+    }
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto voxelization_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    double voxelization_time = static_cast<double>(voxelization_duration.count()) / 1000.0;
+    // the tiles are read back in between, that part is counted as readback
+    stage_times.voxelize = std::chrono::duration<double, std::milli>(end_time - start_time).count() -
+                           stage_times.readback;
     //
-    // copying data to cached output
+    // quantizing colors, the grid holds palette indices afterwards
     //
     start_time = std::chrono::high_resolution_clock::now();
-    cp_data_from_buf(&transfer_buf, cached_output.data());
-
-    auto vox_count = std::count_if(cached_output.begin(), cached_output.end(), [](int x) { return x > 0; });
-
+    if (params.palette) {
+        build_palette();
+        remap_palette();
+    }
     end_time = std::chrono::high_resolution_clock::now();
-    auto copy_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    stage_times.palette = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    //
+    // statistics are read back ahead of the grid
     //
-    // morton encoding
+    if (!cpu && !tiled)
+        read_stats();
+    //
+    // copying data to cached output
+    //
+    std::vector<uint32_t> brick_table;
+    if (!cpu && !tiled) {
+        start_time = std::chrono::high_resolution_clock::now();
+        if (!params.full_readback || params.write_attributes)
+            brick_table = read_brick_table();
+
+        if (params.full_readback)
+            cp_data_from_buf(&transfer_buf, cached_output.data());
+        else
+            cp_occupied_bricks(brick_table, cached_output.data());
+
+        end_time = std::chrono::high_resolution_clock::now();
+        stage_times.readback = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    }
+    //
+    // distance field from the final grid
     //
     start_time = std::chrono::high_resolution_clock::now();
+    if (params.generate_sdf)
+        write_sdf();
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.sdf = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    //
+    // the rest of the device results, attributes are encoded and levels written once the grid is in order
+    //
+    if (params.write_attributes) {
+        start_time = std::chrono::high_resolution_clock::now();
+        read_attrib_bricks(brick_table);
+        end_time = std::chrono::high_resolution_clock::now();
+        stage_times.readback += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    }
 
-    std::vector<uint8_t> morton_encoded(params.chunk_size);
-    if (params.morton_encode || params.generate_svo)
-        morton_encode_3d_grid(cached_output.data(), params.chunk_res, params.chunk_size, morton_encoded.data());
-
+    start_time = std::chrono::high_resolution_clock::now();
+    if (params.lod_levels > 0)
+        read_lod_levels();
     end_time = std::chrono::high_resolution_clock::now();
-    auto morton_encode_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    stage_times.lod = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    double gpu_vox_time = -1.0;
+    double gpu_sdf_time = -1.0;
+    if (!cpu) {
+        gpu_vox_time = get_gpu_time(QUERY_VOX_BEGIN, QUERY_VOX_END);
+        if (params.generate_sdf)
+            gpu_sdf_time = get_gpu_time(QUERY_SDF_BEGIN, QUERY_SDF_END);
+        // only host stages follow, they overlap with the next job of the daemon on the device
+        release_dev();
+    }
     //
-    // generating svo
+    // morton encoding, in place. occupied bricks are already scattered in morton order with -m.
     //
     start_time = std::chrono::high_resolution_clock::now();
-    BsvoHeader bsvo_header{};
-    bsvo_header.max_depth = params.max_depth;
-    bsvo_header.root_res = params.chunk_res;
-
-    Svo svo{};
-    if (params.generate_svo)
-        svo = Svo(morton_encoded, bsvo_header.root_res, bsvo_header.max_depth);
+    if (params.morton_encode && (cpu || params.full_readback)) {
+        TRACE_SCOPE("morton_order_grid");
+        morton_order_grid(cached_output.data(), params.chunk_res);
+    }
     end_time = std::chrono::high_resolution_clock::now();
-    auto svo_gen_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    stage_times.morton = std::chrono::duration<double, std::milli>(end_time - start_time).count();
     //
-    // writing data
+    // writing data, the grid is in the order of the output. the grid goes out in the background while the
+    // attributes are encoded and the svo is built, both only read it. chunks are encoded right away and written in
+    // the background.
     //
     start_time = std::chrono::high_resolution_clock::now();
 
-    if (params.morton_encode)
-        append_to_bvox(params.output_file, morton_encoded);
-    else
-        append_to_bvox(params.output_file, cached_output);
+    FileWriter *p_grid_writer = nullptr;
+    std::future<void> grid_write;
+    if (params.grid_sink) {
+        params.grid_sink(cached_output.data(), params.chunk_res);
+    } else if (params.chunk_codec != CODEC_NONE) {
+        write_cvox(params.output_file, cached_output.data(), params.chunk_res);
+    } else if (params.run_length_encode) {
+        grid_write = std::async(std::launch::async, [&] {
+            TRACE_SCOPE("append_to_bvox");
+            append_to_bvox(params.output_file, cached_output);
+        });
+    } else {
+        p_grid_writer = &open_writer(params.output_file);
+        p_grid_writer->write(&bvox_header, sizeof(BvoxHeader));
+        p_grid_writer->write_shared(cached_output.data(), cached_output.size(), p_output);
+    }
 
-    if (params.generate_svo)
-        write_bsvo(params.svo_file, svo, bsvo_header);
+    if (params.write_attributes)
+        write_attrib_stream(cached_output.data(), brick_table);
+
+    if (params.palette)
+        write_palette();
 
     end_time = std::chrono::high_resolution_clock::now();
-    auto write_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    stage_times.write = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    //
+    // generating svo, a linear grid is reordered once it is written. the layout of the bsvo belongs to vss, it is
+    // written on its own thread while the levels are written.
+    //
+    BsvoHeader bsvo_header{};
+    Svo svo{};
+    std::future<void> svo_write;
+    if (params.generate_svo) {
+        if (!params.morton_encode && (grid_write.valid() || p_grid_writer != nullptr)) {
+            start_time = std::chrono::high_resolution_clock::now();
+            if (grid_write.valid())
+                grid_write.get();
+            else
+                p_grid_writer->finish();
+            end_time = std::chrono::high_resolution_clock::now();
+            stage_times.write += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        }
 
-    vkDeviceWaitIdle(dev);
+        start_time = std::chrono::high_resolution_clock::now();
+        if (!params.morton_encode) {
+            TRACE_SCOPE("morton_order_grid");
+            morton_order_grid(cached_output.data(), params.chunk_res);
+        }
+        end_time = std::chrono::high_resolution_clock::now();
+        stage_times.morton += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+        start_time = std::chrono::high_resolution_clock::now();
+        bsvo_header.max_depth = params.max_depth;
+        bsvo_header.root_res = params.chunk_res;
 
-    std::cout << std::endl << "--- Results ---" << std::endl;
-    std::cout << "voxelization time: " << voxelization_time << "ms" << std::endl;
-    std::cout << "copy time: " << copy_duration.count() << "ms" << std::endl;
+        {
+            TRACE_SCOPE("build_svo");
+            svo = Svo(cached_output, bsvo_header.root_res, bsvo_header.max_depth);
+        }
+        end_time = std::chrono::high_resolution_clock::now();
+        stage_times.svo = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+        if (params.svo_sink) {
+            start_time = std::chrono::high_resolution_clock::now();
+            params.svo_sink(svo);
+            end_time = std::chrono::high_resolution_clock::now();
+            stage_times.write += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        } else {
+            svo_write = std::async(std::launch::async, [&] {
+                TRACE_SCOPE("write_bsvo");
+                write_bsvo(params.svo_file, svo, bsvo_header);
+            });
+        }
+    }
+    //
+    // writing coarser levels, they were reduced on the device
+    //
+    start_time = std::chrono::high_resolution_clock::now();
+    if (params.lod_levels > 0)
+        write_lod_levels();
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.lod += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    //
+    // waiting for the writes still in flight
+    //
+    start_time = std::chrono::high_resolution_clock::now();
+    if (grid_write.valid())
+        grid_write.get();
+    if (svo_write.valid())
+        svo_write.get();
+    finish_writers();
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.write += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    *p_log << std::endl << "--- Results ---" << std::endl;
+    if (cpu) {
+        *p_log << "voxelization time: " << stage_times.voxelize << "ms" << std::endl;
+    } else {
+        *p_log << "voxelization time: " << stage_times.voxelize << "ms (" << batch_count << " draw batches)"
+               << std::endl;
+        if (gpu_vox_time >= 0.0)
+            *p_log << "gpu voxelization time: " << gpu_vox_time << "ms" << std::endl;
+    }
+    if (params.palette)
+        *p_log << "palette time: " << stage_times.palette << "ms (" << palette.size() << " colors)"
+               << std::endl;
+    if (!cpu)
+        *p_log << "copy time: " << stage_times.readback << "ms" << std::endl;
+    if (params.generate_sdf) {
+        *p_log << "sdf time: " << stage_times.sdf << "ms" << std::endl;
+        if (gpu_sdf_time >= 0.0)
+            *p_log << "gpu sdf time: " << gpu_sdf_time << "ms" << std::endl;
+    }
+    if (!cpu && !params.full_readback)
+        *p_log << "occupied bricks: " << brick_table.size() << " / "
+               << brick_axis_count * brick_axis_count * brick_axis_count << std::endl;
     if (params.morton_encode || params.generate_svo)
-        std::cout << "morton encode time: " << morton_encode_duration.count() << "ms" << std::endl;
+        *p_log << "morton encode time: " << stage_times.morton << "ms" << std::endl;
     if (params.generate_svo)
-        std::cout << "svo generation time: " << svo_gen_duration.count() << "ms" << std::endl;
-    std::cout << "write time: " << write_duration.count() << "ms" << std::endl;
-    std::cout << "voxel count: " << vox_count << std::endl;
+        *p_log << "svo generation time: " << stage_times.svo << "ms" << std::endl;
+    *p_log << "write time: " << stage_times.write << "ms" << std::endl;
+    if (written_bytes > 0)
+        *p_log << "write throughput: " << get_write_throughput() << "MiB/s ("
+               << static_cast<double>(written_bytes) / (1024.0 * 1024.0) << "MiB)" << std::endl;
+    if (params.lod_levels > 0)
+        *p_log << "lod time: " << stage_times.lod << "ms" << std::endl;
+    print_stats();
+}
+
+// waits for the device and frees everything of the run on it, the next job of the daemon can take it over then
+void App::release_dev() {
+    vkDeviceWaitIdle(dev);
+    clean_up();
+
+    dev_in_use = false;
+    if (dev_lock.owns_lock())
+        dev_lock.unlock();
+}
+
+// after a failure on the device: frees what the run created so far and resets the context, the device can be in any
+// state. the next run starts over.
+void App::reset_dev() {
+    if (dev != VK_NULL_HANDLE)
+        vkDeviceWaitIdle(dev);
+    clean_up();
+    if (p_dev_context != nullptr)
+        p_dev_context->clean_up();
+
+    dev_in_use = false;
+    if (dev_lock.owns_lock())
+        dev_lock.unlock();
 }
 
+// also after a setup that failed halfway, handles that were never created are null
 void App::clean_up() {
+    for (const auto &worker: tile_workers)
+        worker->clean_up();
+    tile_workers.clear();
+
+    if (dev != VK_NULL_HANDLE)
+        clean_up_run();
+
+    // the device of the library stays for the next run, unless the setup failed before handing it over
+    if (p_dev_context != nullptr && dev != VK_NULL_HANDLE && p_dev_context->dev == dev)
+        return;
+
+    vkDestroyDevice(dev, nullptr);
+
+    // the instance belongs to the main app
+    if (tile_worker || inst == VK_NULL_HANDLE)
+        return;
+
+#ifdef VALIDATION
+    destroy_debug_callback(inst, debug_msg, nullptr);
+#endif
+
+    vkDestroyInstance(inst, nullptr);
+}
+
+// everything the run created on its device
+void App::clean_up_run() {
     clean_up_pipe();
     clean_up_desc();
 
     clean_up_buf(unif_buf);
 
-    clean_up_buf(transfer_buf);
-    clean_up_img(render_target);
+    if (params.use_textures)
+        clean_up_textures();
+
+    if (params.engine == ENGINE_HASH) {
+        clean_up_hash();
+    } else {
+        if (params.full_readback)
+            clean_up_buf(transfer_buf);
+        else
+            clean_up_bricks();
+        clean_up_stats();
+        if (params.solid_axes > 0)
+            clean_up_solid();
+        if (params.palette)
+            clean_up_palette();
+        if (params.lod_levels > 0)
+            clean_up_lod_targets();
+        if (params.generate_sdf)
+            clean_up_sdf();
+        if (splat_tri_count > 0)
+            clean_up_splat_pipe();
+        if (params.write_attributes)
+            clean_up_attrib_targets();
+        clean_up_img(render_target);
+    }
 
     vkDestroyFramebuffer(dev, frame_buf, nullptr);
     vkDestroyRenderPass(dev, rendp, nullptr);
 
     clean_up_sync();
+    vkDestroyQueryPool(dev, query_pool, nullptr);
 
     clean_up_buf(vert_buf);
     clean_up_buf(index_buf);
 
     vkDestroyCommandPool(dev, cmd_pool, nullptr);
-    vkDestroyDevice(dev, nullptr);
-
-#ifdef VALIDATION
-    destroy_debug_callback(inst, debug_msg, nullptr);
-#endif
-
-    vkDestroyInstance(inst, nullptr);
 }
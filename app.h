@@ -8,7 +8,10 @@
 #include "inc.h"
 // ReSharper disable once CppUnusedIncludeDirective
 #include "prop.h"
+#include "trace.h"
 #include "util.h"
+#include "writer.h"
+#include "codec.h"
 
 #include <tiny_obj_loader.h>
 
@@ -48,15 +51,17 @@ struct Vertex {
     static std::array<VkVertexInputAttributeDescription, 5> get_attrib_descs();
 
     bool operator==(const Vertex &other) const {
-        return pos == other.pos && normal == other.normal && uv == other.uv;
+        return pos == other.pos && normal == other.normal && color == other.color && uv == other.uv &&
+               mat_id == other.mat_id;
     }
 };
 
 template<>
 struct std::hash<Vertex> {
     size_t operator()(Vertex const &vertex) const noexcept {
-        return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^ (
+        const size_t geometry = ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^ (
                 hash<glm::vec2>()(vertex.uv) << 1);
+        return ((geometry ^ (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (hash<uint32_t>()(vertex.mat_id) << 1);
     }
 };
 
@@ -72,25 +77,40 @@ struct VCW_Uniform {
 
 struct VCW_Buffer {
     VkDeviceSize size;
-    VkBuffer buf;
+    VkBuffer buf = VK_NULL_HANDLE;
 
-    VkDeviceMemory mem;
+    VkDeviceMemory mem = VK_NULL_HANDLE;
+    VkDeviceSize mem_size = 0;
     void *p_mapped_mem = nullptr;
 
     VkAccessFlags cur_access_mask;
 };
 
+struct VCW_ComputePipe {
+    VkDescriptorSetLayout desc_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool desc_pool = VK_NULL_HANDLE;
+    // the same bindings once per set, so that one pipeline runs on different resources
+    std::vector<VkDescriptorSet> desc_sets;
+
+    VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
+    VkPipeline pipe = VK_NULL_HANDLE;
+
+    uint32_t push_const_size;
+};
+
 struct VCW_Image {
-    VkImage img;
-    VkDeviceMemory mem;
+    VkImage img = VK_NULL_HANDLE;
+    VkDeviceMemory mem = VK_NULL_HANDLE;
+    VkDeviceSize mem_size = 0;
 
-    VkImageView view;
+    VkImageView view = VK_NULL_HANDLE;
 
-    VkSampler sampler;
+    VkSampler sampler = VK_NULL_HANDLE;
     bool combined_img_sampler = false;
 
     VkExtent3D extent;
     VkFormat format;
+    uint32_t mip_levels = 1;
 
     VkImageLayout cur_layout;
     VkAccessFlags cur_access_mask;
@@ -127,9 +147,122 @@ struct VCW_OrthographicChunkModule {
     }
 };
 
+enum VoxelizeEngine : uint32_t {
+    ENGINE_DENSE = 0,
+    ENGINE_HASH = 1,
+    ENGINE_CPU = 2,
+    // dense if a suitable gpu is found, cpu otherwise
+    ENGINE_AUTO = 3
+};
+
+// mirrors HashInfo in shader.frag / hash_compact.comp
+struct VCW_HashInfo {
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t overflow;
+    uint32_t pad;
+};
+
+// mirrors PushConstants in splat.comp
+struct VCW_SplatPushConstants {
+    glm::mat4 view_proj;
+    uint32_t first_index;
+    uint32_t tri_count;
+    uint32_t res;
+};
+
+struct VCW_SortPushConstants {
+    uint32_t j;
+    uint32_t k;
+    uint32_t n;
+};
+
+// output of the hash engine, followed by vox_count morton codes in ascending order
+struct VoxelListHeader {
+    uint32_t chunk_res;
+    uint32_t reserved;
+    uint64_t vox_count;
+};
+
+// mirrors VoxelStats in stats.comp
+struct VCW_VoxelStats {
+    uint32_t vox_count;
+    uint32_t aabb_min[3];
+    uint32_t aabb_max[3];
+    uint32_t pad;
+    uint32_t value_counts[STATS_VALUE_COUNT];
+};
+
+// mirrors PushConstants in parity.vert / parity.frag
+struct VCW_ParityPushConstants {
+    alignas(16) glm::mat4 view_proj;
+    uint32_t axis;
+    uint32_t slot;
+    uint32_t res;
+    uint32_t word_count;
+};
+
+// mirrors PushConstants in solid_scan.comp / solid_fill.comp
+struct VCW_SolidPushConstants {
+    uint32_t res;
+    uint32_t word_count;
+    uint32_t axis_count;
+};
+
+// one record per occupied voxel, in the order of the occupancy output
+struct VoxelAttributes {
+    uint32_t color; // rgb8, sample count in the upper 8 bits
+    uint32_t normal; // octahedral 2x12 bit, sample count in the upper 8 bits
+    uint16_t mat_id;
+    uint16_t reserved;
+};
+
+// header of the attribute stream, followed by vox_count VoxelAttributes
+struct AttribStreamHeader {
+    uint32_t chunk_res;
+    uint32_t record_size;
+    uint64_t vox_count;
+};
+
+// header of the palette file, followed by color_count rgba8 colors, grid value i + 1 refers to color i
+struct PaletteHeader {
+    uint32_t color_count;
+    uint32_t reserved;
+};
+
+// timestamp queries, written in begin / end pairs. every in-flight frame has its own pair for the draw batches.
+// QUERY_CALIBRATE is a single timestamp that aligns the gpu clock with the trace.
+enum TimestampQuery : uint32_t {
+    QUERY_VOX_BEGIN = 0,
+    QUERY_VOX_END,
+    QUERY_SDF_BEGIN,
+    QUERY_SDF_END,
+    QUERY_CALIBRATE,
+    QUERY_BATCH_BEGIN,
+    QUERY_COUNT = QUERY_BATCH_BEGIN + 2 * MAX_FRAMES_IN_FLIGHT
+};
+
+// mirrors PushConstants in sdf_seed.comp / sdf_jfa.comp / sdf_resolve.comp
+struct VCW_SdfPushConstants {
+    uint32_t res;
+    uint32_t step;
+    uint32_t signed_dist;
+    float max_dist;
+};
+
+// header of the sdf file, followed by chunk_res^3 values of bits each in linear order.
+// values map linearly from -max_dist to +max_dist, distances are in voxels.
+struct SdfHeader {
+    uint32_t chunk_res;
+    uint32_t bits;
+    uint32_t signed_dist;
+    float max_dist;
+};
+
 struct VoxelizeParams {
     uint32_t chunk_res;
-    uint32_t chunk_size;
+    // voxels of the grid, beyond 32 bit for large dense grids
+    uint64_t chunk_size;
 
     std::string input_file;
     std::string output_file;
@@ -138,10 +271,120 @@ struct VoxelizeParams {
 
     bool run_length_encode;
     bool morton_encode;
+    // chunked layout instead of the vss grid, see codec.h
+    VoxelCodec chunk_codec;
 
     bool generate_svo;
     uint32_t max_depth;
     std::string svo_file;
+
+    VoxelizeEngine engine;
+    uint32_t hash_capacity;
+
+    bool full_readback;
+
+    // 0 keeps the surface shell, 1 fills along z, 3 takes the majority of all axes
+    uint32_t solid_axes;
+
+    bool write_attributes;
+    std::string attrib_file;
+
+    bool use_textures;
+
+    bool palette;
+    std::string palette_file;
+
+    // number of coarser levels, each halves the resolution
+    uint32_t lod_levels;
+
+    // morton order of the triangles, first use order of the vertices
+    bool sort_tris;
+    bool reorder_verts;
+
+    // point splat tiny triangles, split huge ones
+    bool classify_tris;
+
+    // triangles per draw batch, 0 tunes the batch size towards batch_time_ms per submission
+    uint32_t batch_tris;
+    uint32_t batch_time_ms;
+
+    bool generate_sdf;
+    uint32_t sdf_bits;
+    std::string sdf_file;
+
+    // one json record per run is appended
+    std::string metrics_file;
+
+    // chrome trace event json of the cpu and gpu timelines
+    std::string trace_file;
+
+    // caps the host and the device memory each in MiB, 0 uses what is free
+    uint32_t mem_limit_mib;
+
+    // devices the tiles of a tiled grid are spread across, 0 takes every suitable gpu. more than there are gpus
+    // creates several logical devices on them.
+    uint32_t dev_count;
+
+    // set by the library, the outputs are handed over instead of written to output_file / svo_file. the pointers are
+    // only valid during the call.
+    std::function<void(const uint8_t *p_grid, uint32_t res)> grid_sink;
+    std::function<void(const Svo &svo)> svo_sink;
+    std::function<void(const uint64_t *p_codes, uint64_t count)> list_sink;
+};
+
+// wall time of every stage of the last run in ms, stages that did not run stay at 0
+struct StageTimes {
+    double parse;
+    double dedup;
+    double reorder;
+    // vulkan setup and pipeline creation, includes the upload
+    double init;
+    double upload;
+    double voxelize;
+    double palette;
+    double readback;
+    double sdf;
+    double morton;
+    double svo;
+    double write;
+    double lod;
+};
+
+// one item of the memory budget
+struct MemEstimate {
+    const char *name;
+    uint64_t bytes;
+};
+
+// vulkan instance and device, the library keeps them between runs. the enabled features depend on the engine and on
+// use_textures, a run with other ones needs a new context.
+struct VCW_DeviceContext {
+    VkInstance inst = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT debug_msg;
+
+    VkPhysicalDevice phy_dev = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties phy_dev_mem_props;
+    VkPhysicalDeviceProperties phy_dev_props;
+
+    std::vector<VkQueueFamilyProperties> qf_props;
+    VCW_QueueFamilyIndices qf_indices;
+    VkDevice dev = VK_NULL_HANDLE;
+    VkQueue q_graph;
+
+    bool calibrated_timestamps = false;
+
+    VoxelizeEngine engine;
+    bool use_textures;
+
+    // spir-v by stage, entry point, defines and source
+    std::unordered_map<std::string, std::vector<uint32_t>> shader_cache;
+    VkPipelineCache pipe_cache = VK_NULL_HANDLE;
+
+    bool is_compatible(const VoxelizeParams &params) const {
+        return dev != VK_NULL_HANDLE && engine == params.engine && use_textures == params.use_textures;
+    }
+
+    void clean_up();
 };
 
 class App {
@@ -149,14 +392,51 @@ public:
     VoxelizeParams params;
 
     void run() {
-        load_model();
-        init_app();
-        comp_vox_grid();
-        clean_up();
+        if (params.engine == ENGINE_AUTO)
+            pick_engine();
+
+        // the library hands the mesh over in vertices / indices
+        if (params.input_file.empty())
+            prepare_mesh();
+        else
+            load_model();
+
+        if (params.engine == ENGINE_CPU) {
+            plan_memory();
+            comp_vox_grid();
+        } else {
+            // the daemon runs several jobs at once, each one holds the device until its results are read back
+            if (p_dev_mutex != nullptr)
+                dev_lock = std::unique_lock(*p_dev_mutex);
+            dev_in_use = true;
+
+            const auto start_time = std::chrono::high_resolution_clock::now();
+            init_app();
+            const auto end_time = std::chrono::high_resolution_clock::now();
+            stage_times.init = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+            if (params.engine == ENGINE_HASH)
+                comp_vox_list();
+            else
+                comp_vox_grid();
+        }
+
+        if (!params.metrics_file.empty())
+            write_metrics();
     }
 
-    VkInstance inst;
-    VkDebugUtilsMessengerEXT debug_msg;
+    // set by the library, the device is taken from it or created into it and outlives the run
+    VCW_DeviceContext *p_dev_context = nullptr;
+    // held from the device setup to release_dev if set
+    std::mutex *p_dev_mutex = nullptr;
+    std::unique_lock<std::mutex> dev_lock;
+    // from the device setup to release_dev, a failure in between can leave objects of the device behind
+    bool dev_in_use = false;
+    // progress of the stages, the library and the daemon mute it per run
+    std::ostream *p_log = &std::cout;
+
+    VkInstance inst = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT debug_msg = VK_NULL_HANDLE;
 
     VkPhysicalDevice phy_dev = VK_NULL_HANDLE;
     VkPhysicalDeviceMemoryProperties phy_dev_mem_props;
@@ -164,22 +444,32 @@ public:
 
     std::vector<VkQueueFamilyProperties> qf_props;
     VCW_QueueFamilyIndices qf_indices;
-    VkDevice dev;
+    VkDevice dev = VK_NULL_HANDLE;
     VkQueue q_graph;
 
     VkExtent2D render_extent;
 
-    VkRenderPass rendp;
-    VkFramebuffer frame_buf;
-    VkPipelineLayout pipe_layout;
-    VkPipeline pipe;
+    // the grid is rendered in tile_count^3 tiles of tile_res^3, a single tile of chunk_res^3 when it fits
+    uint32_t tile_count = 1;
+    uint32_t tile_res = 0;
+
+    // the other devices of a tiled run, created by init_tile_workers. a worker renders the tiles planned by the main
+    // app on a device of its instance.
+    std::vector<std::unique_ptr<App>> tile_workers;
+    bool tile_worker = false;
+    uint32_t tile_dev_count = 1;
+
+    VkRenderPass rendp = VK_NULL_HANDLE;
+    VkFramebuffer frame_buf = VK_NULL_HANDLE;
+    VkPipelineLayout pipe_layout = VK_NULL_HANDLE;
+    VkPipeline pipe = VK_NULL_HANDLE;
 
     std::vector<VkDescriptorSetLayout> desc_set_layouts;
     std::vector<VkDescriptorPoolSize> desc_pool_sizes;
-    VkDescriptorPool desc_pool;
+    VkDescriptorPool desc_pool = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> desc_sets;
 
-    VkCommandPool cmd_pool;
+    VkCommandPool cmd_pool = VK_NULL_HANDLE;
     std::vector<VkCommandBuffer> cmd_bufs;
 
     tinyobj::attrib_t attrib;
@@ -196,9 +486,85 @@ public:
     int indices_count;
     VCW_Buffer index_buf;
 
+    // the first raster_tri_count triangles are drawn, the splat_tri_count after them are point splatted
+    uint32_t raster_tri_count;
+    uint32_t splat_tri_count = 0;
+    VCW_ComputePipe splat_pipe;
+
+    std::vector<VCW_Image> textures;
+    VkSampler tex_sampler = VK_NULL_HANDLE;
+    // texture index of every material, -1 without diffuse texture
+    VCW_Buffer mat_tex_buf;
+
     VCW_Image render_target;
     VCW_Buffer transfer_buf;
 
+    VCW_Buffer stats_buf;
+    VCW_Buffer stats_transfer_buf;
+    VCW_ComputePipe stats_pipe;
+    VCW_VoxelStats vox_stats;
+
+    StageTimes stage_times{};
+
+    // device memory of create_buf / create_img and bytes copied to the host, for the metrics
+    mutable VkDeviceSize dev_mem_allocated = 0;
+    mutable VkDeviceSize dev_mem_in_use = 0;
+    mutable VkDeviceSize dev_mem_peak = 0;
+    mutable VkDeviceSize readback_bytes = 0;
+
+    // outputs written in the background, they stay open until the end of the run
+    std::vector<std::unique_ptr<FileWriter>> writers;
+    uint64_t written_bytes = 0;
+    double write_busy_ms = 0.0;
+
+    VCW_Image color_target;
+    VCW_Image normal_target;
+    VCW_Image mat_target;
+    uint32_t mat_texel_size;
+    // packed bricks of the attributes, read back before the device is released
+    std::vector<uint32_t> brick_colors;
+    std::vector<uint32_t> brick_normals;
+    std::vector<uint8_t> brick_mats;
+
+    VCW_Buffer hist_buf;
+    VCW_Buffer hist_transfer_buf;
+    VCW_Buffer palette_lut_buf;
+    VCW_ComputePipe palette_hist_pipe;
+    VCW_ComputePipe palette_remap_pipe;
+    std::vector<uint32_t> palette;
+
+    VCW_Image sdf_seed_imgs[2];
+    VCW_Image sdf_img;
+    VCW_ComputePipe sdf_seed_pipe;
+    VCW_ComputePipe sdf_jfa_pipes[2];
+    VCW_ComputePipe sdf_resolve_pipe;
+    uint32_t sdf_pass_count;
+
+    std::vector<VCW_Image> lod_imgs;
+    // one descriptor set per level
+    VCW_ComputePipe lod_pipe;
+    std::vector<std::vector<uint8_t>> lod_grids;
+
+    uint32_t brick_axis_count;
+    VCW_Buffer brick_buf;
+    VCW_Buffer brick_transfer_buf;
+
+    VCW_Buffer hash_buf;
+    VCW_Buffer hash_info_buf;
+    VCW_Buffer vox_list_buf;
+    VCW_ComputePipe hash_compact_pipe;
+    VCW_ComputePipe sort_pipe;
+
+    uint32_t parity_word_count;
+    VCW_Image parity_img;
+    VkDescriptorSetLayout parity_desc_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool parity_desc_pool = VK_NULL_HANDLE;
+    VkDescriptorSet parity_desc_set = VK_NULL_HANDLE;
+    VkPipelineLayout parity_pipe_layout = VK_NULL_HANDLE;
+    VkPipeline parity_pipe = VK_NULL_HANDLE;
+    VCW_ComputePipe solid_scan_pipe;
+    VCW_ComputePipe solid_fill_pipe;
+
     VCW_PushConstants push_const;
 
     VCW_Uniform ubo;
@@ -206,8 +572,22 @@ public:
 
     std::vector<VkFence> fens;
 
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+
+    // VK_EXT_calibrated_timestamps is enabled, gpu timestamp * period + offset is on the trace timeline
+    bool calibrated_timestamps = false;
+    int64_t gpu_clock_offset_ns = 0;
+
     uint32_t cur_frame = 0;
 
+    // checked between draw batches, may be set from a signal handler
+    std::atomic<bool> abort_requested = false;
+    // the flag that is checked, tile workers share the one of the main app so that ctrl+c stops every device
+    std::atomic<bool> *p_abort_requested = &abort_requested;
+    uint32_t batch_count = 0;
+    // progress of render(), off while several devices render tiles at once
+    bool print_batches = true;
+
     VCW_OrthographicChunkModule chunk_module;
 
     //
@@ -219,10 +599,30 @@ public:
 
     void init_app();
 
+    void init_dev();
+
     void comp_vox_grid();
 
+    void comp_vox_list();
+
+    void release_dev();
+
+    void reset_dev();
+
     void clean_up();
 
+    void clean_up_run();
+
+    void write_metrics() const;
+
+    FileWriter &open_writer(const std::string &filename);
+
+    // waits for all background writes and closes the files
+    void finish_writers();
+
+    // MiB/s while the writers had data in flight
+    double get_write_throughput() const;
+
     //
     // vulkan instance
     //
@@ -244,8 +644,20 @@ public:
 
     static bool check_phy_dev_ext_support(VkPhysicalDevice loc_phy_dev);
 
+    bool check_phy_dev_calibrated_timestamps(VkPhysicalDevice loc_phy_dev) const;
+
+    static bool check_phy_dev_int64_atomics(VkPhysicalDevice loc_phy_dev);
+
+    static bool check_phy_dev_subgroup_support(VkPhysicalDevice loc_phy_dev);
+
+    static bool check_phy_dev_nonuniform_indexing(VkPhysicalDevice loc_phy_dev);
+
+    static bool check_phy_dev_memory_budget(VkPhysicalDevice loc_phy_dev);
+
     bool is_phy_dev_suitable(VkPhysicalDevice loc_phy_dev) const;
 
+    std::vector<VkPhysicalDevice> get_suitable_phy_devs() const;
+
     void pick_phy_dev();
 
     //
@@ -258,6 +670,8 @@ public:
     //
     uint32_t find_mem_type(uint32_t type_filter, VkMemoryPropertyFlags mem_flags) const;
 
+    void track_dev_mem_alloc(VkDeviceSize size) const;
+
     VCW_Buffer create_buf(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_props) const;
 
     void map_buf(VCW_Buffer *p_buf) const;
@@ -286,10 +700,11 @@ public:
     static bool has_stencil_component(VkFormat format);
 
     VCW_Image create_img(VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_props,
-                         VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) const;
+                         VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL, uint32_t mip_levels = 1) const;
 
     VCW_Image create_img(VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags mem_props,
-                         VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL, VkImageType img_type = VK_IMAGE_TYPE_2D) const;
+                         VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL, VkImageType img_type = VK_IMAGE_TYPE_2D,
+                         uint32_t mip_levels = 1) const;
 
     VkImageView get_img_view(VCW_Image img, VkImageViewType img_view_type = VK_IMAGE_VIEW_TYPE_2D,
                              const VkImageSubresourceRange &subres_range = DEFAULT_SUBRESOURCE_RANGE) const;
@@ -329,6 +744,8 @@ public:
 
     static void copy_img(VkCommandBuffer cmd_buf, const VCW_Image &src, const VCW_Image &dst);
 
+    static void generate_mipmaps(VkCommandBuffer cmd_buf, VCW_Image *p_img);
+
     void clean_up_img(const VCW_Image &img) const;
 
     //
@@ -359,14 +776,42 @@ public:
     //
     void create_rendp();
 
-    std::vector<uint32_t> compile_shader(const std::string& source, shaderc_shader_kind kind, const char* entry_point);
+    std::vector<uint32_t> compile_shader(const std::string &source, shaderc_shader_kind kind, const char *entry_point,
+                                         const std::vector<std::string> &defines = {});
+
+    std::vector<std::string> get_shader_defines() const;
 
     VkShaderModule create_shader_mod(const std::vector<uint32_t> &code) const;
 
+    // the pipeline cache of the kept device, none without one
+    VkPipelineCache get_pipe_cache() const;
+
     void create_frame_buf();
 
     void clean_up_pipe() const;
 
+    //
+    // compute pipelines
+    //
+    VCW_ComputePipe create_comp_pipe(const std::string &shader_file, const std::vector<VkDescriptorType> &desc_types,
+                                     uint32_t push_const_size, const std::vector<std::string> &defines = {},
+                                     uint32_t set_count = 1);
+
+    void write_comp_buf_binding(const VCW_ComputePipe &comp_pipe, const VCW_Buffer &buf, uint32_t dst_binding,
+                                uint32_t set = 0) const;
+
+    void write_comp_img_binding(const VCW_ComputePipe &comp_pipe, const VCW_Image &img, uint32_t dst_binding,
+                                uint32_t set = 0) const;
+
+    static void dispatch_comp(VkCommandBuffer cmd_buf, const VCW_ComputePipe &comp_pipe, uint32_t group_count_x,
+                              uint32_t group_count_y = 1, uint32_t group_count_z = 1,
+                              const void *p_push_const = nullptr, uint32_t set = 0);
+
+    static void comp_memory_barrier(VkCommandBuffer cmd_buf, VkPipelineStageFlags src_stage,
+                                    VkPipelineStageFlags dst_stage);
+
+    void clean_up_comp_pipe(const VCW_ComputePipe &comp_pipe) const;
+
     //
     // render prerequisites
     //
@@ -382,6 +827,24 @@ public:
 
     void create_sync();
 
+    void create_query_pool();
+
+    void record_timestamp(VkCommandBuffer cmd_buf, uint32_t query, VkPipelineStageFlagBits stage) const;
+
+    uint64_t get_timestamp_mask() const;
+
+    uint64_t read_timestamp(uint32_t query) const;
+
+    double get_gpu_time(uint32_t begin_query, uint32_t end_query) const;
+
+    void calibrate_gpu_clock();
+
+    void trace_gpu_queries(const char *name, uint32_t begin_query, uint32_t end_query) const;
+
+    uint32_t tune_batch_tris(uint32_t batch_tris, uint32_t done_tris, double batch_time) const;
+
+    uint32_t get_draw_tri_count() const;
+
     void render();
 
     void clean_up_sync() const;
@@ -392,6 +855,30 @@ public:
     //
     void load_model();
 
+    // bounds and triangle order of vertices / indices
+    void prepare_mesh();
+
+    void sort_tris_morton();
+
+    void reorder_vertices();
+
+    void classify_tris();
+
+    //
+    // cpu engine
+    //
+    bool has_suitable_phy_dev();
+
+    void pick_engine();
+
+    void voxelize_cpu(uint8_t *p_grid);
+
+    void create_splat_pipe();
+
+    void record_splat(VkCommandBuffer cmd_buf);
+
+    void clean_up_splat_pipe() const;
+
     void create_vert_buf();
 
     void create_index_buf();
@@ -402,6 +889,8 @@ public:
 
     void create_textures();
 
+    void clean_up_textures() const;
+
     void create_render_target();
 
     void create_desc_pool_layout();
@@ -412,7 +901,160 @@ public:
 
     void update_bufs(uint32_t index_inflight_frame);
 
-    void record_cmd_buf(VkCommandBuffer cmd_buf);
+    void record_cmd_buf(VkCommandBuffer cmd_buf, uint32_t first_tri, uint32_t tri_count);
+
+    void record_vox_begin(VkCommandBuffer cmd_buf);
+
+    void record_vox_end(VkCommandBuffer cmd_buf);
+
+    void record_grid_readback(VkCommandBuffer cmd_buf);
+
+    //
+    // device-side voxel statistics
+    //
+    void create_stats_bufs();
+
+    void create_stats_pipe();
+
+    void record_stats_reset(VkCommandBuffer cmd_buf) const;
+
+    void record_stats(VkCommandBuffer cmd_buf);
+
+    void read_stats();
+
+    void print_stats() const;
+
+    void clean_up_stats() const;
+
+    //
+    // occupied-region readback
+    //
+    void create_brick_bufs();
+
+    void record_brick_readback(VkCommandBuffer cmd_buf);
+
+    std::vector<uint32_t> read_brick_table();
+
+    VCW_Buffer cp_img_bricks(VCW_Image *p_img, const std::vector<uint32_t> &brick_table, uint32_t texel_size);
+
+    void scatter_bricks(const VCW_Buffer &packed_buf, const std::vector<uint32_t> &brick_table, uint32_t texel_size,
+                        uint8_t *p_grid, glm::uvec3 origin = glm::uvec3(0)) const;
+
+    void scatter_bricks_morton(const VCW_Buffer &packed_buf, const std::vector<uint32_t> &brick_table, uint8_t *p_grid,
+                               glm::uvec3 origin) const;
+
+    void cp_occupied_bricks(const std::vector<uint32_t> &brick_table, uint8_t *p_grid,
+                            glm::uvec3 origin = glm::uvec3(0));
+
+    void clean_up_bricks() const;
+
+    //
+    // hash engine
+    //
+    double estimate_surface_voxels() const;
+
+    uint32_t estimate_hash_capacity() const;
+
+    void create_hash_bufs();
+
+    void create_hash_pipes();
+
+    void record_hash_compact(VkCommandBuffer cmd_buf);
+
+    void sort_vox_list(uint32_t count);
+
+    void clean_up_hash();
+
+    //
+    // solid voxelization
+    //
+    void create_solid_resources();
+
+    void create_parity_pipe();
+
+    void record_parity_clear(VkCommandBuffer cmd_buf);
+
+    void record_parity_draws(VkCommandBuffer cmd_buf, uint32_t first_tri, uint32_t tri_count);
+
+    void record_solid_fill(VkCommandBuffer cmd_buf);
+
+    void clean_up_solid() const;
+
+    //
+    // per-voxel attributes
+    //
+    void create_attrib_targets();
+
+    void record_attrib_clear(VkCommandBuffer cmd_buf);
+
+    void read_attrib_bricks(const std::vector<uint32_t> &brick_table);
+
+    void write_attrib_stream(const uint8_t *p_grid, const std::vector<uint32_t> &brick_table);
+
+    void clean_up_attrib_targets() const;
+
+    //
+    // color quantization
+    //
+    void create_palette_resources();
+
+    void record_palette_histogram(VkCommandBuffer cmd_buf);
+
+    void build_palette();
+
+    void remap_palette();
+
+    void write_palette() const;
+
+    void clean_up_palette() const;
+
+    //
+    // lod pyramid
+    //
+    void create_lod_targets();
+
+    std::string get_lod_file(uint32_t level) const;
+
+    void read_lod_levels();
+
+    void write_lod_levels();
+
+    void clean_up_lod_targets() const;
+
+    //
+    // signed distance field
+    //
+    void create_sdf_resources();
+
+    void write_sdf();
+
+    void clean_up_sdf() const;
+
+    //
+    // memory budget
+    //
+    static VkDeviceSize get_dev_mem_budget(VkPhysicalDevice loc_phy_dev);
+
+    uint64_t get_dev_mem_limit(VkPhysicalDevice loc_phy_dev) const;
+
+    bool fits_dev_mem(VkPhysicalDevice loc_phy_dev, uint32_t res, uint64_t dev_budget) const;
+
+    std::vector<MemEstimate> estimate_dev_mem(uint32_t res) const;
+
+    std::vector<MemEstimate> estimate_host_mem(uint32_t res) const;
+
+    void plan_memory();
+
+    void init_tile_workers();
+
+    void render_tile(glm::uvec3 tile, const glm::mat4 &full_proj, uint8_t *p_grid, std::vector<uint8_t> *p_tile_grid);
+
+    void voxelize_tiles(uint8_t *p_grid);
+
+    //
+    // chunked output
+    //
+    void write_cvox(const std::string &filename, const uint8_t *p_grid, uint32_t res);
 };
 
 #endif //VCW_APP_H
@@ -0,0 +1,298 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "args.h"
+
+int string_to_int(std::string &string, uint32_t *p_int, std::ostream &err) {
+    try {
+        *p_int = static_cast<uint32_t>(std::stoul(string));
+        return EXIT_SUCCESS;
+    } catch (const std::exception &) {
+        err << std::endl << "invalid number " << string << "." << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int evaluate_args(std::string &arg, std::string &next_arg, VoxelizeParams *p_params, std::ostream &err) {
+    if (arg == "-h") {
+        return ARG_INVALID;
+    } else if (arg == "-r") {
+        return string_to_int(next_arg, &p_params->chunk_res, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-m") {
+        p_params->morton_encode = true;
+        return ARG_VALID;
+    } else if (arg == "-c") {
+        // the last -c wins
+        if (next_arg == "rle") {
+            p_params->run_length_encode = true;
+            p_params->chunk_codec = CODEC_NONE;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "chunk-rle" || next_arg == "chunk-mask") {
+            p_params->run_length_encode = false;
+            p_params->chunk_codec = next_arg == "chunk-rle" ? CODEC_RLE : CODEC_MASK;
+            return NEXT_ARG_USED;
+        } else {
+            return ARG_INVALID;
+        }
+    } else if (arg == "-z") {
+        std::filesystem::path path(next_arg);
+        if (std::filesystem::exists(path)) {
+            if (std::filesystem::is_directory(path)) {
+                p_params->material_dir = next_arg;
+                return NEXT_ARG_USED;
+            } else {
+                err << std::endl << "specified material dir is not a directory." << std::endl;
+                return ARG_INVALID;
+            }
+        } else {
+            err << std::endl << "specified material dir does not exist." << std::endl;
+            return ARG_INVALID;
+        }
+    } else if (arg == "-i") {
+        std::filesystem::path path(next_arg);
+
+        if (std::filesystem::exists(path)) {
+            if (path.extension() == ".obj") {
+                if (p_params->material_dir == "")
+                    p_params->material_dir = path.parent_path().string();
+
+                p_params->input_file = next_arg;
+                return NEXT_ARG_USED;
+            } else {
+                err << std::endl << "input file must be an .obj file." << std::endl;
+                return ARG_INVALID;
+            }
+        } else {
+            err << std::endl << "specified input file does not exist." << std::endl;
+            return ARG_INVALID;
+        }
+    } else if (arg == "-o") {
+        p_params->output_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "-s") {
+        p_params->generate_svo = true;
+        p_params->svo_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "-d") {
+        return string_to_int(next_arg, &p_params->max_depth, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-e") {
+        if (next_arg == "dense") {
+            p_params->engine = ENGINE_DENSE;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "hash") {
+            p_params->engine = ENGINE_HASH;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "cpu") {
+            p_params->engine = ENGINE_CPU;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "auto") {
+            p_params->engine = ENGINE_AUTO;
+            return NEXT_ARG_USED;
+        } else {
+            return ARG_INVALID;
+        }
+    } else if (arg == "-f") {
+        p_params->full_readback = true;
+        return ARG_VALID;
+    } else if (arg == "-hc") {
+        return string_to_int(next_arg, &p_params->hash_capacity, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-a") {
+        p_params->write_attributes = true;
+        p_params->attrib_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "-lod") {
+        return string_to_int(next_arg, &p_params->lod_levels, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-p") {
+        p_params->palette = true;
+        p_params->palette_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "-sdf") {
+        p_params->generate_sdf = true;
+        p_params->sdf_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "-sdfq") {
+        if (next_arg == "8") {
+            p_params->sdf_bits = 8;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "16") {
+            p_params->sdf_bits = 16;
+            return NEXT_ARG_USED;
+        } else {
+            return ARG_INVALID;
+        }
+    } else if (arg == "-ts") {
+        p_params->sort_tris = true;
+        return ARG_VALID;
+    } else if (arg == "-tc") {
+        p_params->classify_tris = true;
+        return ARG_VALID;
+    } else if (arg == "-vr") {
+        p_params->reorder_verts = true;
+        return ARG_VALID;
+    } else if (arg == "-b") {
+        return string_to_int(next_arg, &p_params->batch_tris, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-bt") {
+        return string_to_int(next_arg, &p_params->batch_time_ms, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "--trace") {
+        p_params->trace_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "--metrics") {
+        p_params->metrics_file = next_arg;
+        return NEXT_ARG_USED;
+    } else if (arg == "--mem-limit") {
+        return string_to_int(next_arg, &p_params->mem_limit_mib, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "--devices") {
+        return string_to_int(next_arg, &p_params->dev_count, err) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
+    } else if (arg == "-t") {
+        p_params->use_textures = true;
+        return ARG_VALID;
+    } else if (arg == "-fill") {
+        if (next_arg == "1") {
+            p_params->solid_axes = 1;
+            return NEXT_ARG_USED;
+        } else if (next_arg == "3") {
+            p_params->solid_axes = 3;
+            return NEXT_ARG_USED;
+        } else {
+            return ARG_INVALID;
+        }
+    } else {
+        err << std::endl << "unknown option " << arg << "." << std::endl;
+        return ARG_INVALID;
+    }
+}
+
+std::string check_grid_res(const VoxelizeParams &params) {
+    if (params.chunk_res == 0)
+        return "resolution must be at least 1.";
+
+    // morton codes of 64 bit
+    if (params.engine == ENGINE_HASH)
+        return params.chunk_res > 1u << 21 ? "the hash engine supports resolutions up to 2097152." : "";
+
+    // the size field of the vss header is 32 bit, larger dense grids are left to the memory plan
+    const uint64_t grid_size = static_cast<uint64_t>(params.chunk_res) * params.chunk_res * params.chunk_res;
+    if (params.chunk_codec == CODEC_NONE && !params.grid_sink && grid_size > UINT32_MAX)
+        return "a .bvox grid must not exceed a resolution of 1625, use -c chunk-rle or -c chunk-mask for larger ones.";
+
+    return "";
+}
+
+int validate_args(VoxelizeParams *p_params, std::ostream &err) {
+    if (const std::string problem = check_grid_res(*p_params); !problem.empty()) {
+        err << std::endl << problem << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->input_file == "") {
+        err << std::endl << "no input file specified." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->material_dir == "") {
+        err << std::endl << "no material directory specified." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->output_file == "") {
+        err << std::endl << "no output file specified." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->engine == ENGINE_HASH &&
+        (p_params->morton_encode || p_params->run_length_encode || p_params->chunk_codec != CODEC_NONE ||
+         p_params->generate_svo)) {
+        err << std::endl << "hash engine output is already morton ordered, -m, -c and -s are not supported."
+            << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->engine == ENGINE_HASH && p_params->solid_axes > 0) {
+        err << std::endl << "solid voxelization is only supported by the dense engine." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->engine == ENGINE_HASH && p_params->write_attributes) {
+        err << std::endl << "attributes are only supported by the dense engine." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->engine == ENGINE_CPU && (p_params->solid_axes > 0 || p_params->write_attributes ||
+                                           p_params->lod_levels > 0 || p_params->generate_sdf)) {
+        err << std::endl << "the cpu engine only writes the surface grid, -fill, -a, -lod and -sdf need a gpu."
+            << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->use_textures && !p_params->write_attributes) {
+        err << std::endl << "texture colors are written to the attribute stream, -t requires -a." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->palette && !p_params->write_attributes) {
+        err << std::endl << "the palette is built from the color attribute, -p requires -a." << std::endl;
+        return ARG_INVALID;
+    }
+
+    if (p_params->lod_levels > 0) {
+        if (p_params->engine == ENGINE_HASH) {
+            err << std::endl << "lod levels are only supported by the dense engine." << std::endl;
+            return ARG_INVALID;
+        }
+
+        if (p_params->lod_levels >= 32 || p_params->chunk_res % (1u << p_params->lod_levels) != 0) {
+            err << std::endl << "resolution must be divisible by 2^<levels>." << std::endl;
+            return ARG_INVALID;
+        }
+    }
+
+    if (p_params->generate_sdf) {
+        if (p_params->engine == ENGINE_HASH) {
+            err << std::endl << "distance fields are only supported by the dense engine." << std::endl;
+            return ARG_INVALID;
+        }
+
+        if (p_params->chunk_res > SDF_MAX_RES) {
+            err << std::endl << "distance fields are limited to a resolution of " << SDF_MAX_RES << "."
+                << std::endl;
+            return ARG_INVALID;
+        }
+    }
+
+    return ARG_VALID;
+}
+
+void set_default_params(VoxelizeParams *p_params) {
+    if (p_params->chunk_res == 0)
+        p_params->chunk_res = 256;
+    p_params->chunk_size = static_cast<uint64_t>(p_params->chunk_res) * p_params->chunk_res * p_params->chunk_res;
+    if (p_params->max_depth == 0)
+        p_params->max_depth = DEFAULT_MAX_DEPTH;
+    if (p_params->sdf_bits == 0)
+        p_params->sdf_bits = 8;
+    if (p_params->batch_time_ms == 0)
+        p_params->batch_time_ms = BATCH_DEFAULT_TIME_MS;
+}
+
+int parse_args(const std::vector<std::string> &args, VoxelizeParams *p_params, std::ostream &err) {
+    for (size_t i = 0; i < args.size(); i++) {
+        std::string arg = args[i];
+        std::string next_arg = i + 1 < args.size() ? args[i + 1] : "";
+
+        const int result = evaluate_args(arg, next_arg, p_params, err);
+        if (result == ARG_INVALID)
+            return ARG_INVALID;
+
+        if (result == NEXT_ARG_USED) {
+            if (i + 1 == args.size()) {
+                err << std::endl << "invalid arguments" << std::endl;
+                return ARG_INVALID;
+            }
+            i++;
+        }
+    }
+
+    set_default_params(p_params);
+    return validate_args(p_params, err);
+}
@@ -0,0 +1,32 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+#ifndef VCW_ARGS_H
+#define VCW_ARGS_H
+
+// command line of the cli, also the job format of the daemon. problems are reported on err, the daemon returns them
+// to the client.
+
+#define ARG_VALID EXIT_SUCCESS
+#define ARG_INVALID EXIT_FAILURE
+#define NEXT_ARG_USED 2
+
+int string_to_int(std::string &string, uint32_t *p_int, std::ostream &err = std::cerr);
+
+// one option, NEXT_ARG_USED if it took next_arg as its value
+int evaluate_args(std::string &arg, std::string &next_arg, VoxelizeParams *p_params, std::ostream &err = std::cerr);
+
+void set_default_params(VoxelizeParams *p_params);
+
+// what keeps a grid of chunk_res^3 from the engine and the output, empty if nothing. shared with the library.
+std::string check_grid_res(const VoxelizeParams &params);
+
+int validate_args(VoxelizeParams *p_params, std::ostream &err = std::cerr);
+
+// all options without the program name, with defaults and validation
+int parse_args(const std::vector<std::string> &args, VoxelizeParams *p_params, std::ostream &err = std::cerr);
+
+#endif //VCW_ARGS_H
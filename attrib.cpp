@@ -0,0 +1,154 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// per-voxel attributes: shader.frag keeps a running average of the color (rgba8, alpha is the sample count) and of the
+// octahedral encoded normal (2x12 bit, 8 bit sample count) with compare-and-swap loops, the material id is written
+// to a separate r8ui / r16ui target. the host interleaves them into a raw attribute stream, one record per occupied
+// voxel in the same order as the occupancy output.
+
+void App::create_attrib_targets() {
+    const VkExtent3D extent = {params.chunk_res, params.chunk_res, params.chunk_res};
+    constexpr VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                        VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    color_target = create_img(extent, VK_FORMAT_R32_UINT, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+    create_img_view(&color_target, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+
+    normal_target = create_img(extent, VK_FORMAT_R32_UINT, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+    create_img_view(&normal_target, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+
+    // byte sized material ids as long as they fit
+    mat_texel_size = materials.size() <= UINT8_MAX ? sizeof(uint8_t) : sizeof(uint16_t);
+    mat_target = create_img(extent, mat_texel_size == sizeof(uint8_t) ? VK_FORMAT_R8_UINT : VK_FORMAT_R16_UINT,
+                            usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+    create_img_view(&mat_target, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+}
+
+// has to be recorded before rendering, a zero color / normal means no samples yet
+void App::record_attrib_clear(VkCommandBuffer cmd_buf) {
+    constexpr VkClearColorValue clear_color = {};
+
+    for (VCW_Image *p_img: {&color_target, &normal_target, &mat_target}) {
+        transition_img_layout(cmd_buf, p_img, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        vkCmdClearColorImage(cmd_buf, p_img->img, VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1,
+                             &DEFAULT_SUBRESOURCE_RANGE);
+        transition_img_layout(cmd_buf, p_img, VK_IMAGE_LAYOUT_GENERAL,
+                              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+}
+
+// copies the attributes of all bricks in brick_table to the host, the stream is written from them once the grid is in
+// the order of the output
+void App::read_attrib_bricks(const std::vector<uint32_t> &brick_table) {
+    TRACE_SCOPE(__func__);
+    auto read_bricks = [&](VCW_Image *p_img, const uint32_t texel_size, void *p_bricks) {
+        VCW_Buffer packed_buf = cp_img_bricks(p_img, brick_table, texel_size);
+        memcpy(p_bricks, packed_buf.p_mapped_mem, packed_buf.size);
+        unmap_buf(&packed_buf);
+        clean_up_buf(packed_buf);
+    };
+
+    const size_t texel_count = brick_table.size() * BRICK_RES * BRICK_RES * BRICK_RES;
+    brick_colors.resize(texel_count);
+    brick_normals.resize(texel_count);
+    brick_mats.resize(texel_count * mat_texel_size);
+
+    read_bricks(&color_target, sizeof(uint32_t), brick_colors.data());
+    read_bricks(&normal_target, sizeof(uint32_t), brick_normals.data());
+    read_bricks(&mat_target, mat_texel_size, brick_mats.data());
+}
+
+// writes one record per occupied voxel of p_grid, which is in the order of the occupancy output. the bricks of
+// brick_table were read back by read_attrib_bricks.
+void App::write_attrib_stream(const uint8_t *p_grid, const std::vector<uint32_t> &brick_table) {
+    TRACE_SCOPE(__func__);
+    const uint32_t *p_colors = brick_colors.data();
+    const uint32_t *p_normals = brick_normals.data();
+    const uint8_t *p_mats = brick_mats.data();
+
+    // packed slot of every brick
+    const uint32_t brick_count = brick_axis_count * brick_axis_count * brick_axis_count;
+    std::vector<uint32_t> brick_slots(brick_count, UINT32_MAX);
+    for (uint32_t i = 0; i < brick_table.size(); i++)
+        brick_slots[brick_table[i]] = i;
+
+    // the count is only known at the end, the header is patched then
+    AttribStreamHeader header{};
+    header.chunk_res = params.chunk_res;
+    header.record_size = sizeof(VoxelAttributes);
+
+    FileWriter &writer = open_writer(params.attrib_file);
+    writer.write(&header, sizeof(AttribStreamHeader));
+
+    // records go out a block at a time while the rest is encoded
+    std::vector<VoxelAttributes> records;
+    records.reserve(WRITER_BLOCK_SIZE / sizeof(VoxelAttributes));
+
+    const uint32_t res = params.chunk_res;
+    size_t grid_index = 0;
+    auto append_record = [&](const uint32_t x, const uint32_t y, const uint32_t z) {
+        if (p_grid[grid_index++] == 0)
+            return;
+
+        const uint32_t brick = x / BRICK_RES + brick_axis_count * (y / BRICK_RES + brick_axis_count * (z / BRICK_RES));
+        const uint32_t slot = brick_slots[brick];
+
+        VoxelAttributes record{};
+        if (slot != UINT32_MAX) {
+            const size_t texel = static_cast<size_t>(slot) * BRICK_RES * BRICK_RES * BRICK_RES +
+                                 ((z % BRICK_RES) * BRICK_RES + y % BRICK_RES) * BRICK_RES + x % BRICK_RES;
+            record.color = p_colors[texel];
+            record.normal = p_normals[texel];
+            if (mat_texel_size == sizeof(uint8_t))
+                record.mat_id = p_mats[texel];
+            else
+                memcpy(&record.mat_id, p_mats + texel * sizeof(uint16_t), sizeof(uint16_t));
+        }
+
+        records.push_back(record);
+        if (records.size() == records.capacity()) {
+            writer.write(records.data(), records.size() * sizeof(VoxelAttributes));
+            header.vox_count += records.size();
+            records.clear();
+        }
+    };
+
+    if (params.morton_encode) {
+        // same order as morton_encode_3d_grid, codes outside of the grid are skipped
+        const uint64_t code_count = static_cast<uint64_t>(next_pow2(res)) * next_pow2(res) * next_pow2(res);
+        for (uint64_t code = 0; code < code_count; code++) {
+            const uint32_t x = compact_by_3(code);
+            const uint32_t y = compact_by_3(code >> 1);
+            const uint32_t z = compact_by_3(code >> 2);
+            if (x < res && y < res && z < res)
+                append_record(x, y, z);
+        }
+    } else {
+        for (uint32_t z = 0; z < res; z++)
+            for (uint32_t y = 0; y < res; y++)
+                for (uint32_t x = 0; x < res; x++)
+                    append_record(x, y, z);
+    }
+
+    // the svo is built afterwards, the bricks are not needed for it
+    brick_colors = {};
+    brick_normals = {};
+    brick_mats = {};
+
+    writer.write(records.data(), records.size() * sizeof(VoxelAttributes));
+    header.vox_count += records.size();
+    writer.patch(0, &header, sizeof(AttribStreamHeader));
+}
+
+void App::clean_up_attrib_targets() const {
+    clean_up_img(color_target);
+    clean_up_img(normal_target);
+    clean_up_img(mat_target);
+}
@@ -0,0 +1,63 @@
+// attribute encoding and running averages shared by shader.frag and splat.comp, the includer declares color_target
+// and normal_target first
+
+// rgb in the lower 24 bits, sample count in the upper 8 bits
+uint pack_color(vec3 color, uint count) {
+    uvec3 c = uvec3(clamp(color, 0.0, 1.0) * 255.0 + 0.5);
+    return c.r | (c.g << 8) | (c.b << 16) | (count << 24);
+}
+
+vec3 unpack_color(uint packed) {
+    return vec3(uvec3(packed, packed >> 8, packed >> 16) & 0xFFu) / 255.0;
+}
+
+// octahedral encoding, 12 bit per component
+uint pack_normal(vec3 n, uint count) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 oct = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    uvec2 q = uvec2(clamp(oct * 0.5 + 0.5, 0.0, 1.0) * 4095.0 + 0.5);
+    return q.x | (q.y << 12) | (count << 24);
+}
+
+vec2 unpack_oct(uint packed) {
+    return vec2(uvec2(packed, packed >> 12) & 0xFFFu) / 4095.0 * 2.0 - 1.0;
+}
+
+vec3 oct_to_normal(vec2 oct) {
+    vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void average_color(ivec3 coord, vec3 color) {
+    uint prev = 0;
+    uint next = pack_color(color, 1);
+
+    // retry until no other fragment changed the voxel in between, saturated voxels are left alone
+    uint cur;
+    while ((cur = imageAtomicCompSwap(color_target, coord, prev, next)) != prev) {
+        prev = cur;
+        uint count = cur >> 24;
+        if (count == 255) return;
+
+        vec3 avg = (unpack_color(cur) * float(count) + color) / float(count + 1);
+        next = pack_color(avg, count + 1);
+    }
+}
+
+void average_normal(ivec3 coord, vec3 normal) {
+    if (dot(normal, normal) == 0.0) return;
+
+    uint prev = 0;
+    uint next = pack_normal(normal, 1);
+
+    uint cur;
+    while ((cur = imageAtomicCompSwap(normal_target, coord, prev, next)) != prev) {
+        prev = cur;
+        uint count = cur >> 24;
+        if (count == 255) return;
+
+        vec3 avg = oct_to_normal(unpack_oct(cur)) * float(count) + normalize(normal);
+        next = dot(avg, avg) > 0.0 ? pack_normal(avg, count + 1) : (cur & 0xFFFFFFu) | ((count + 1) << 24);
+    }
+}
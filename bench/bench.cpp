@@ -0,0 +1,410 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+#include "../app.h"
+
+#include <random>
+
+// benchmark suite: procedural meshes at a requested triangle count are written to obj files and run through the whole
+// pipeline for every resolution. repeated runs are reduced to median and p95 per stage, the report is json.
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_DEFAULT_WARMUP 1
+#define BENCH_SEED 0x9e3779b9
+
+// flat list of triangle corners, three per triangle
+struct BenchMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+
+    void add_tri(const glm::vec3 a, const glm::vec3 b, const glm::vec3 c, const glm::vec3 normal) {
+        positions.insert(positions.end(), {a, b, c});
+        normals.insert(normals.end(), {normal, normal, normal});
+    }
+
+    // quad a b c d split into a grid of 2 * div^2 triangles
+    void add_quad(const glm::vec3 a, const glm::vec3 b, const glm::vec3 c, const glm::vec3 d, const uint32_t div) {
+        const glm::vec3 normal = glm::normalize(glm::cross(b - a, d - a));
+        const auto lerp_quad = [&](const float u, const float v) {
+            return glm::mix(glm::mix(a, b, u), glm::mix(d, c, u), v);
+        };
+
+        const float step = 1.0f / static_cast<float>(div);
+        for (uint32_t j = 0; j < div; j++) {
+            for (uint32_t i = 0; i < div; i++) {
+                const float u = static_cast<float>(i) * step;
+                const float v = static_cast<float>(j) * step;
+                add_tri(lerp_quad(u, v), lerp_quad(u + step, v), lerp_quad(u + step, v + step), normal);
+                add_tri(lerp_quad(u, v), lerp_quad(u + step, v + step), lerp_quad(u, v + step), normal);
+            }
+        }
+    }
+
+    // axis aligned box, faces point outwards or inwards
+    void add_box(const glm::vec3 lo, const glm::vec3 hi, const uint32_t div, const bool inwards) {
+        const glm::vec3 c[8] = {
+                {lo.x, lo.y, lo.z}, {hi.x, lo.y, lo.z}, {hi.x, hi.y, lo.z}, {lo.x, hi.y, lo.z},
+                {lo.x, lo.y, hi.z}, {hi.x, lo.y, hi.z}, {hi.x, hi.y, hi.z}, {lo.x, hi.y, hi.z}
+        };
+        const uint32_t faces[6][4] = {
+                {0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4}, {2, 3, 7, 6}, {0, 4, 7, 3}, {1, 2, 6, 5}
+        };
+
+        for (const auto &face: faces) {
+            if (inwards)
+                add_quad(c[face[3]], c[face[2]], c[face[1]], c[face[0]], div);
+            else
+                add_quad(c[face[0]], c[face[1]], c[face[2]], c[face[3]], div);
+        }
+    }
+
+    uint32_t tri_count() const {
+        return static_cast<uint32_t>(positions.size() / 3);
+    }
+};
+
+static void subdivide_sphere(BenchMesh &mesh, const glm::vec3 a, const glm::vec3 b, const glm::vec3 c,
+                             const uint32_t depth, const float radius, const bool inwards) {
+    if (depth == 0) {
+        // smooth normals, shared corners collapse during deduplication
+        if (inwards) {
+            mesh.positions.insert(mesh.positions.end(), {a * radius, c * radius, b * radius});
+            mesh.normals.insert(mesh.normals.end(), {-a, -c, -b});
+        } else {
+            mesh.positions.insert(mesh.positions.end(), {a * radius, b * radius, c * radius});
+            mesh.normals.insert(mesh.normals.end(), {a, b, c});
+        }
+        return;
+    }
+
+    const glm::vec3 ab = glm::normalize(a + b);
+    const glm::vec3 bc = glm::normalize(b + c);
+    const glm::vec3 ca = glm::normalize(c + a);
+    subdivide_sphere(mesh, a, ab, ca, depth - 1, radius, inwards);
+    subdivide_sphere(mesh, ab, b, bc, depth - 1, radius, inwards);
+    subdivide_sphere(mesh, ca, bc, c, depth - 1, radius, inwards);
+    subdivide_sphere(mesh, ab, bc, ca, depth - 1, radius, inwards);
+}
+
+// 20 * 4^depth triangles, the largest depth that stays under tri_count
+static void add_icosphere(BenchMesh &mesh, const uint32_t tri_count, const float radius, const bool inwards) {
+    uint32_t depth = 0;
+    while (20u << (2 * (depth + 1)) <= tri_count && depth < 10)
+        depth++;
+
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    glm::vec3 v[12] = {
+            {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+            {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+            {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    for (auto &vertex: v)
+        vertex = glm::normalize(vertex);
+
+    const uint32_t faces[20][3] = {
+            {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+            {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+            {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+            {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+    };
+    for (const auto &face: faces)
+        subdivide_sphere(mesh, v[face[0]], v[face[1]], v[face[2]], depth, radius, inwards);
+}
+
+// uniformly distributed small triangles, no coherence between neighbours in the file
+static BenchMesh gen_soup(const uint32_t tri_count) {
+    BenchMesh mesh;
+    std::mt19937 rng(BENCH_SEED);
+    std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> offset(-0.02f, 0.02f);
+
+    for (uint32_t i = 0; i < tri_count; i++) {
+        const glm::vec3 a(coord(rng), coord(rng), coord(rng));
+        const glm::vec3 b = a + glm::vec3(offset(rng), offset(rng), offset(rng));
+        const glm::vec3 c = a + glm::vec3(offset(rng), offset(rng), offset(rng));
+
+        const glm::vec3 normal = glm::cross(b - a, c - a);
+        mesh.add_tri(a, b, c, glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0, 0, 1));
+    }
+
+    return mesh;
+}
+
+// two nested spheres, the gap is thinner than a voxel at every benchmarked resolution
+static BenchMesh gen_shell(const uint32_t tri_count) {
+    BenchMesh mesh;
+    add_icosphere(mesh, tri_count / 2, 1.0f, false);
+    add_icosphere(mesh, tri_count / 2, 0.999f, true);
+    return mesh;
+}
+
+// closed hall with two rows of columns and a gallery floor, large flat faces next to long thin ones
+static BenchMesh gen_rooms(const uint32_t tri_count) {
+    constexpr uint32_t column_count = 12;
+    // hall, gallery and columns, each box has 6 faces of 2 * div^2 triangles
+    constexpr uint32_t box_count = 2 + column_count;
+    const float quads_per_face = static_cast<float>(tri_count) / (12.0f * box_count);
+    const auto div = std::max(1u, static_cast<uint32_t>(std::sqrt(quads_per_face)));
+
+    BenchMesh mesh;
+    mesh.add_box({-4.0f, 0.0f, -1.5f}, {4.0f, 3.0f, 1.5f}, div, true);
+    mesh.add_box({-4.0f, 1.4f, -1.5f}, {4.0f, 1.5f, -1.0f}, div, false);
+
+    for (uint32_t i = 0; i < column_count; i++) {
+        const float x = -3.3f + static_cast<float>(i / 2) * 1.3f;
+        const float z = i % 2 == 0 ? -0.9f : 0.9f;
+        mesh.add_box({x - 0.1f, 0.0f, z - 0.1f}, {x + 0.1f, 3.0f, z + 0.1f}, div, false);
+    }
+
+    return mesh;
+}
+
+static BenchMesh gen_mesh(const std::string &name, const uint32_t tri_count) {
+    if (name == "icosphere") {
+        BenchMesh mesh;
+        add_icosphere(mesh, tri_count, 1.0f, false);
+        return mesh;
+    }
+    if (name == "soup")
+        return gen_soup(tri_count);
+    if (name == "shell")
+        return gen_shell(tri_count);
+    if (name == "rooms")
+        return gen_rooms(tri_count);
+
+    throw std::runtime_error("unknown benchmark mesh " + name + ".");
+}
+
+// every corner gets its own v / vn line, deduplication is part of the benchmark
+static void write_obj(const std::string &filename, const BenchMesh &mesh) {
+    std::ofstream file(filename);
+    if (!file.is_open())
+        throw std::runtime_error("failed to open file " + filename + ".");
+
+    for (const auto &p: mesh.positions)
+        file << "v " << p.x << " " << p.y << " " << p.z << "\n";
+    for (const auto &n: mesh.normals)
+        file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+
+    for (uint32_t tri = 0; tri < mesh.tri_count(); tri++) {
+        file << "f";
+        for (uint32_t corner = 1; corner <= 3; corner++)
+            file << " " << 3 * tri + corner << "//" << 3 * tri + corner;
+        file << "\n";
+    }
+}
+
+struct BenchRun {
+    StageTimes times;
+    uint32_t tri_count;
+    uint32_t vox_count;
+};
+
+static BenchRun run_once(const VoxelizeParams &params) {
+    App app{};
+    app.params = params;
+    app.run();
+
+    return {app.stage_times, app.raster_tri_count + app.splat_tri_count, app.vox_stats.vox_count};
+}
+
+// nearest rank percentile
+static double percentile(std::vector<double> samples, const double p) {
+    std::sort(samples.begin(), samples.end());
+    const auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+static void write_stage(std::ostream &out, const std::string &name, const std::vector<double> &samples,
+                        const bool last) {
+    out << "        \"" << name << "\": {\"median\": " << percentile(samples, 0.5) << ", \"p95\": "
+        << percentile(samples, 0.95) << "}" << (last ? "" : ",") << "\n";
+}
+
+static std::vector<std::string> split_list(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');)
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static std::vector<uint32_t> split_uint_list(const std::string &list) {
+    std::vector<uint32_t> values;
+    for (const auto &item: split_list(list))
+        values.push_back(static_cast<uint32_t>(std::stoul(item)));
+    return values;
+}
+
+void print_usage() {
+    std::cout << "Usage: gpu_mtv_bench [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -h               Display this help message." << std::endl;
+    std::cout << "  -m <meshes>      Comma separated meshes, available: [icosphere, soup, shell, rooms]" << std::endl;
+    std::cout << "                   Defaults to all of them." << std::endl;
+    std::cout << "  -n <triangles>   Comma separated triangle counts, defaults to 10000,100000,1000000." << std::endl;
+    std::cout << "  -r <resolutions> Comma separated grid resolutions, defaults to 128,256,512." << std::endl;
+    std::cout << "  -e <engine>      Voxelization engine, available: [dense, cpu]" << std::endl;
+    std::cout << "                   Defaults to dense." << std::endl;
+    std::cout << "  -i <runs>        Measured runs per configuration, defaults to " << BENCH_DEFAULT_RUNS << "."
+              << std::endl;
+    std::cout << "  -w <runs>        Discarded warmup runs per configuration, defaults to " << BENCH_DEFAULT_WARMUP
+              << "." << std::endl;
+    std::cout << "  -o <file>        Write the json report to <file> instead of stdout." << std::endl;
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> meshes = {"icosphere", "soup", "shell", "rooms"};
+    std::vector<uint32_t> tri_counts = {10000, 100000, 1000000};
+    std::vector<uint32_t> resolutions = {128, 256, 512};
+    VoxelizeEngine engine = ENGINE_DENSE;
+    uint32_t run_count = BENCH_DEFAULT_RUNS;
+    uint32_t warmup_count = BENCH_DEFAULT_WARMUP;
+    std::string report_file;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "-h" || i + 1 >= argc) {
+                print_usage();
+                return arg == "-h" ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
+            const std::string next_arg = argv[++i];
+            if (arg == "-m") {
+                meshes = split_list(next_arg);
+            } else if (arg == "-n") {
+                tri_counts = split_uint_list(next_arg);
+            } else if (arg == "-r") {
+                resolutions = split_uint_list(next_arg);
+            } else if (arg == "-e" && (next_arg == "dense" || next_arg == "cpu")) {
+                engine = next_arg == "cpu" ? ENGINE_CPU : ENGINE_DENSE;
+            } else if (arg == "-i") {
+                run_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-w") {
+                warmup_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-o") {
+                report_file = next_arg;
+            } else {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (run_count == 0 || meshes.empty() || tri_counts.empty() || resolutions.empty()) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path work_dir = std::filesystem::temp_directory_path() / "gpu_mtv_bench";
+    std::filesystem::create_directories(work_dir);
+
+    std::ostringstream report;
+    report << "{\n";
+    report << "  \"engine\": \"" << (engine == ENGINE_CPU ? "cpu" : "dense") << "\",\n";
+    report << "  \"runs\": " << run_count << ",\n";
+    report << "  \"results\": [\n";
+
+    // the app prints every stage, only the report is of interest. cout discards everything without a buffer.
+    std::streambuf *p_cout_buf = std::cout.rdbuf();
+
+    bool first_result = true;
+    try {
+        for (const auto &mesh_name: meshes) {
+            for (const uint32_t tri_count: tri_counts) {
+                const std::string obj_name = mesh_name + "_" + std::to_string(tri_count) + ".obj";
+                const std::string obj_file = (work_dir / obj_name).string();
+                write_obj(obj_file, gen_mesh(mesh_name, tri_count));
+
+                for (const uint32_t res: resolutions) {
+                    std::cerr << mesh_name << " " << tri_count << " triangles at " << res << "^3" << std::endl;
+
+                    VoxelizeParams params{};
+                    params.chunk_res = res;
+                    params.chunk_size = static_cast<uint64_t>(res) * res * res;
+                    params.input_file = obj_file;
+                    params.material_dir = work_dir.string();
+                    params.output_file = (work_dir / "out.bvox").string();
+                    params.morton_encode = true;
+                    params.run_length_encode = true;
+                    params.generate_svo = true;
+                    params.svo_file = (work_dir / "out.bsvo").string();
+                    params.max_depth = DEFAULT_MAX_DEPTH;
+                    params.engine = engine;
+                    params.sdf_bits = 8;
+                    params.batch_time_ms = BATCH_DEFAULT_TIME_MS;
+
+                    std::vector<BenchRun> runs;
+                    std::cout.rdbuf(nullptr);
+                    for (uint32_t run = 0; run < warmup_count + run_count; run++) {
+                        BenchRun bench_run = run_once(params);
+                        if (run >= warmup_count)
+                            runs.push_back(bench_run);
+                    }
+                    std::cout.rdbuf(p_cout_buf);
+
+                    const std::pair<const char *, double StageTimes::*> stages[] = {
+                            {"parse", &StageTimes::parse}, {"dedup", &StageTimes::dedup},
+                            {"reorder", &StageTimes::reorder}, {"upload", &StageTimes::upload},
+                            {"voxelize", &StageTimes::voxelize}, {"readback", &StageTimes::readback},
+                            {"morton", &StageTimes::morton}, {"svo", &StageTimes::svo},
+                            {"write", &StageTimes::write}
+                    };
+
+                    std::vector<double> totals(runs.size(), 0.0);
+                    std::vector<double> vox_times;
+                    for (size_t i = 0; i < runs.size(); i++) {
+                        for (const auto &stage: stages)
+                            totals[i] += runs[i].times.*stage.second;
+                        vox_times.push_back(runs[i].times.voxelize);
+                    }
+
+                    // throughput of the voxelization stage alone, from its median
+                    const double vox_seconds = std::max(percentile(vox_times, 0.5), 1e-6) / 1000.0;
+
+                    report << (first_result ? "" : ",\n");
+                    report << "    {\n";
+                    report << "      \"mesh\": \"" << mesh_name << "\",\n";
+                    report << "      \"triangles\": " << runs[0].tri_count << ",\n";
+                    report << "      \"resolution\": " << res << ",\n";
+                    report << "      \"voxels\": " << runs[0].vox_count << ",\n";
+                    report << "      \"voxels_per_s\": " << runs[0].vox_count / vox_seconds << ",\n";
+                    report << "      \"triangles_per_s\": " << runs[0].tri_count / vox_seconds << ",\n";
+                    report << "      \"stages_ms\": {\n";
+                    for (const auto &stage: stages) {
+                        std::vector<double> samples;
+                        for (const auto &bench_run: runs)
+                            samples.push_back(bench_run.times.*stage.second);
+                        write_stage(report, stage.first, samples, false);
+                    }
+                    write_stage(report, "total", totals, true);
+                    report << "      }\n";
+                    report << "    }";
+                    first_result = false;
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cout.rdbuf(p_cout_buf);
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    report << "\n  ]\n}\n";
+
+    if (report_file.empty()) {
+        std::cout << report.str();
+    } else {
+        std::ofstream file(report_file);
+        file << report.str();
+    }
+
+    return EXIT_SUCCESS;
+}
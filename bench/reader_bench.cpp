@@ -0,0 +1,350 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+#include "../reader/reader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <tuple>
+
+// reader benchmark: random lookups, region extraction, sliced decodes, ray casts and the chunk codecs against bvox
+// files, either the given ones or procedural shells written through vss. repeated runs are reduced to median and p95,
+// the report is json.
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_DEFAULT_LOOKUPS 1000000
+#define BENCH_DEFAULT_RAYS 100000
+#define BENCH_SEED 0x9e3779b9
+#define BENCH_REGION_RES 64
+#define BENCH_DECODE_SLICE (1u << 20)
+
+using BenchClock = std::chrono::steady_clock;
+
+static double elapsed_s(const BenchClock::time_point begin) {
+    return std::chrono::duration<double>(BenchClock::now() - begin).count();
+}
+
+// noisy sphere shell a few voxels thick
+static std::vector<uint8_t> gen_shell(const uint32_t res) {
+    std::vector<uint8_t> grid(static_cast<size_t>(res) * res * res);
+    std::mt19937 rng(BENCH_SEED);
+
+    const float center = static_cast<float>(res) * 0.5f;
+    const float radius = static_cast<float>(res) * 0.4f;
+    const float thickness = std::max(1.0f, static_cast<float>(res) / 64.0f);
+
+    size_t index = 0;
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++) {
+                const glm::vec3 d = glm::vec3(x, y, z) + glm::vec3(0.5f - center);
+                const float dist = std::abs(std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z) - radius);
+                grid[index++] = dist < thickness ? static_cast<uint8_t>(1 + rng() % 255) : 0;
+            }
+        }
+    }
+
+    return grid;
+}
+
+static void write_shell(const std::string &filename, const uint32_t res, const bool morton) {
+    std::vector<uint8_t> grid = gen_shell(res);
+    if (morton) {
+        std::vector<uint8_t> ordered(grid.size());
+        size_t index = 0;
+        for (uint32_t z = 0; z < res; z++)
+            for (uint32_t y = 0; y < res; y++)
+                for (uint32_t x = 0; x < res; x++)
+                    ordered[morton_rank(x, y, z, res)] = grid[index++];
+        grid = std::move(ordered);
+    }
+
+    BvoxHeader header{};
+    header.chunk_res = res;
+    header.chunk_size = res * res * res;
+    header.run_length_encoded = false;
+    header.morton_encoded = morton;
+
+    write_empty_bvox(filename, header);
+    append_to_bvox(filename, grid);
+}
+
+// nearest rank percentile
+static double percentile(std::vector<double> samples, const double p) {
+    std::sort(samples.begin(), samples.end());
+    const auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+static void write_measure(std::ostream &out, const std::string &name, const std::vector<double> &samples,
+                          const bool last) {
+    out << "        \"" << name << "\": {\"median\": " << percentile(samples, 0.5) << ", \"p95\": "
+        << percentile(samples, 0.95) << "}" << (last ? "" : ",") << "\n";
+}
+
+static std::vector<std::string> split_list(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');)
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+struct ReaderRun {
+    double lookups_per_s;
+    double region_gb_per_s;
+    double decode_gb_per_s;
+    double octree_ms;
+    double rays_per_s;
+    double hit_rate;
+    double rle_encode_gb_per_s;
+    double rle_decode_gb_per_s;
+    double mask_encode_gb_per_s;
+    double mask_decode_gb_per_s;
+};
+
+// encodes and decodes the grid in cvox chunks on one thread, returns the throughput of both in GB/s
+static std::pair<double, double> run_codec(const VoxelCodec codec, const std::vector<uint8_t> &grid,
+                                           const uint32_t chunk_voxels) {
+    std::vector<std::vector<uint8_t>> chunks((grid.size() + chunk_voxels - 1) / chunk_voxels);
+    auto chunk_count = [&](const size_t chunk) {
+        return static_cast<uint32_t>(std::min<size_t>(chunk_voxels, grid.size() - chunk * chunk_voxels));
+    };
+
+    auto begin = BenchClock::now();
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+        encode_chunk(codec, grid.data() + chunk * chunk_voxels, chunk_count(chunk), &chunks[chunk]);
+    const double encode_s = elapsed_s(begin);
+
+    std::vector<uint8_t> decoded(grid.size());
+    begin = BenchClock::now();
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+        decode_chunk(codec, chunks[chunk].data(), chunks[chunk].size(), decoded.data() + chunk * chunk_voxels,
+                     chunk_count(chunk));
+    const double decode_s = elapsed_s(begin);
+
+    if (decoded != grid)
+        throw std::runtime_error("chunk codec round trip does not match.");
+
+    const auto bytes = static_cast<double>(grid.size());
+    return {bytes / encode_s / 1e9, bytes / decode_s / 1e9};
+}
+
+static ReaderRun run_once(const std::string &filename, const uint32_t lookup_count, const uint32_t ray_count) {
+    ReaderRun run{};
+    std::mt19937 rng(BENCH_SEED);
+
+    const BvoxReader reader(filename);
+    const uint32_t res = reader.get_res();
+
+    // lookups, the sum keeps them from being optimized out
+    std::vector<glm::uvec3> coords(lookup_count);
+    for (auto &coord: coords)
+        coord = glm::uvec3(rng() % res, rng() % res, rng() % res);
+
+    reader.advise_random();
+    uint64_t sum = 0;
+    auto begin = BenchClock::now();
+    for (const auto &coord: coords)
+        sum += reader.at(coord.x, coord.y, coord.z);
+    run.lookups_per_s = lookup_count / elapsed_s(begin);
+
+    // regions at random positions, until the volume of the grid was copied once
+    const uint32_t region_res = std::min<uint32_t>(BENCH_REGION_RES, res);
+    const glm::uvec3 extent(region_res);
+    std::vector<uint8_t> region(static_cast<size_t>(region_res) * region_res * region_res);
+    const uint64_t region_count = std::max<uint64_t>(1, reader.get_voxel_count() / region.size());
+
+    begin = BenchClock::now();
+    for (uint64_t i = 0; i < region_count; i++) {
+        const glm::uvec3 min(rng() % (res - region_res + 1), rng() % (res - region_res + 1),
+                             rng() % (res - region_res + 1));
+        reader.extract_region(min, extent, region.data());
+        sum += region[i % region.size()];
+    }
+    run.region_gb_per_s = static_cast<double>(region_count * region.size()) / elapsed_s(begin) / 1e9;
+
+    // the whole payload in slices
+    std::vector<uint8_t> slice(BENCH_DECODE_SLICE);
+    begin = BenchClock::now();
+    for (uint64_t first = 0; first < reader.get_voxel_count(); first += slice.size()) {
+        const uint64_t count = std::min<uint64_t>(slice.size(), reader.get_voxel_count() - first);
+        reader.decode(first, count, slice.data());
+        sum += slice[0];
+    }
+    run.decode_gb_per_s = static_cast<double>(reader.get_voxel_count()) / elapsed_s(begin) / 1e9;
+
+    begin = BenchClock::now();
+    const OccupancyOctree octree(reader);
+    run.octree_ms = elapsed_s(begin) * 1000.0;
+
+    // rays from a sphere around the grid towards random points inside of it
+    std::uniform_real_distribution unit(-1.0f, 1.0f);
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays(ray_count);
+    const glm::vec3 center(static_cast<float>(res) * 0.5f);
+    for (auto &[origin, dir]: rays) {
+        glm::vec3 offset(unit(rng), unit(rng), unit(rng));
+        offset = offset * (static_cast<float>(res) / std::max(1e-3f, glm::length(offset)));
+        origin = center + offset;
+        dir = center + glm::vec3(unit(rng), unit(rng), unit(rng)) * (static_cast<float>(res) * 0.5f) - origin;
+    }
+
+    uint32_t hit_count = 0;
+    begin = BenchClock::now();
+    for (const auto &[origin, dir]: rays)
+        hit_count += octree.cast_ray(origin, dir, std::numeric_limits<float>::max()).hit;
+    run.rays_per_s = ray_count / elapsed_s(begin);
+    run.hit_rate = static_cast<double>(hit_count) / ray_count;
+
+    std::vector<uint8_t> grid(reader.get_voxel_count());
+    reader.decode(0, grid.size(), grid.data());
+    const uint32_t chunk_voxels = get_cvox_chunk_voxels(res, reader.is_morton());
+    std::tie(run.rle_encode_gb_per_s, run.rle_decode_gb_per_s) = run_codec(CODEC_RLE, grid, chunk_voxels);
+    std::tie(run.mask_encode_gb_per_s, run.mask_decode_gb_per_s) = run_codec(CODEC_MASK, grid, chunk_voxels);
+
+    if (sum == UINT64_MAX)
+        std::cerr << sum << std::endl;
+
+    return run;
+}
+
+void print_usage() {
+    std::cout << "Usage: gpu_mtv_reader_bench [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -h               Display this help message." << std::endl;
+    std::cout << "  -f <files>       Comma separated bvox files, without run length encoding." << std::endl;
+    std::cout << "                   Defaults to procedural shells." << std::endl;
+    std::cout << "  -r <resolutions> Comma separated resolutions of the shells, defaults to 128,256,512." << std::endl;
+    std::cout << "  -n <lookups>     Random lookups per run, defaults to " << BENCH_DEFAULT_LOOKUPS << "."
+              << std::endl;
+    std::cout << "  -y <rays>        Ray casts per run, defaults to " << BENCH_DEFAULT_RAYS << "." << std::endl;
+    std::cout << "  -i <runs>        Measured runs per file, defaults to " << BENCH_DEFAULT_RUNS << "." << std::endl;
+    std::cout << "  -o <file>        Write the json report to <file> instead of stdout." << std::endl;
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> files;
+    std::vector<std::string> resolutions = {"128", "256", "512"};
+    uint32_t lookup_count = BENCH_DEFAULT_LOOKUPS;
+    uint32_t ray_count = BENCH_DEFAULT_RAYS;
+    uint32_t run_count = BENCH_DEFAULT_RUNS;
+    std::string report_file;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "-h" || i + 1 >= argc) {
+                print_usage();
+                return arg == "-h" ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
+            const std::string next_arg = argv[++i];
+            if (arg == "-f") {
+                files = split_list(next_arg);
+            } else if (arg == "-r") {
+                resolutions = split_list(next_arg);
+            } else if (arg == "-n") {
+                lookup_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-y") {
+                ray_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-i") {
+                run_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-o") {
+                report_file = next_arg;
+            } else {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (run_count == 0 || (files.empty() && resolutions.empty())) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream report;
+    report << "{\n";
+    report << "  \"runs\": " << run_count << ",\n";
+    report << "  \"codec_kernels\": \"" << get_codec_kernel_name() << "\",\n";
+    report << "  \"results\": [\n";
+
+    bool first_result = true;
+    try {
+        // one linear and one morton shell per resolution
+        if (files.empty()) {
+            const std::filesystem::path work_dir = std::filesystem::temp_directory_path() / "gpu_mtv_reader_bench";
+            std::filesystem::create_directories(work_dir);
+
+            for (const auto &res_arg: resolutions) {
+                const auto res = static_cast<uint32_t>(std::stoul(res_arg));
+                for (const bool morton: {false, true}) {
+                    const std::string name = "shell_" + res_arg + (morton ? "_morton" : "_linear") + ".bvox";
+                    files.push_back((work_dir / name).string());
+                    write_shell(files.back(), res, morton);
+                }
+            }
+        }
+
+        for (const auto &file: files) {
+            std::cerr << file << std::endl;
+
+            std::vector<ReaderRun> runs;
+            for (uint32_t run = 0; run < run_count; run++)
+                runs.push_back(run_once(file, lookup_count, ray_count));
+
+            const std::pair<const char *, double ReaderRun::*> measures[] = {
+                    {"lookups_per_s", &ReaderRun::lookups_per_s}, {"region_gb_per_s", &ReaderRun::region_gb_per_s},
+                    {"decode_gb_per_s", &ReaderRun::decode_gb_per_s}, {"octree_ms", &ReaderRun::octree_ms},
+                    {"rays_per_s", &ReaderRun::rays_per_s},
+                    {"rle_encode_gb_per_s", &ReaderRun::rle_encode_gb_per_s},
+                    {"rle_decode_gb_per_s", &ReaderRun::rle_decode_gb_per_s},
+                    {"mask_encode_gb_per_s", &ReaderRun::mask_encode_gb_per_s},
+                    {"mask_decode_gb_per_s", &ReaderRun::mask_decode_gb_per_s}
+            };
+
+            const BvoxReader reader(file);
+            report << (first_result ? "" : ",\n");
+            report << "    {\n";
+            report << "      \"file\": \"" << std::filesystem::path(file).filename().string() << "\",\n";
+            report << "      \"resolution\": " << reader.get_res() << ",\n";
+            report << "      \"morton\": " << (reader.is_morton() ? "true" : "false") << ",\n";
+            report << "      \"ray_hit_rate\": " << runs[0].hit_rate << ",\n";
+            report << "      \"measures\": {\n";
+            for (size_t i = 0; i < std::size(measures); i++) {
+                std::vector<double> samples;
+                for (const auto &run: runs)
+                    samples.push_back(run.*measures[i].second);
+                write_measure(report, measures[i].first, samples, i + 1 == std::size(measures));
+            }
+            report << "      }\n";
+            report << "    }";
+            first_result = false;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    report << "\n  ]\n}\n";
+
+    if (report_file.empty()) {
+        std::cout << report.str();
+    } else {
+        std::ofstream file(report_file);
+        file << report.str();
+    }
+
+    return EXIT_SUCCESS;
+}
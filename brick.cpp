@@ -0,0 +1,197 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// occupied-region readback: shader.frag marks every brick it writes to in a bitmap, the host reads the bitmap first
+// and then only copies the occupied bricks of the render target.
+
+void App::create_brick_bufs() {
+    const uint32_t brick_count = brick_axis_count * brick_axis_count * brick_axis_count;
+    const VkDeviceSize size = div_ceil(brick_count, 32) * sizeof(uint32_t);
+
+    brick_buf = create_buf(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    brick_transfer_buf = create_buf(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+// copies the occupancy bitmap, the grid images stay in general layout until cp_img_bricks
+void App::record_brick_readback(VkCommandBuffer cmd_buf) {
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkBufferCopy cp_region{};
+    cp_region.size = brick_buf.size;
+    vkCmdCopyBuffer(cmd_buf, brick_buf.buf, brick_transfer_buf.buf, 1, &cp_region);
+}
+
+// index of every occupied brick in packing order, with full readback every brick counts as occupied
+std::vector<uint32_t> App::read_brick_table() {
+    TRACE_SCOPE(__func__);
+    std::vector<uint32_t> brick_table;
+    const uint32_t brick_count = brick_axis_count * brick_axis_count * brick_axis_count;
+
+    if (params.full_readback) {
+        brick_table.resize(brick_count);
+        std::iota(brick_table.begin(), brick_table.end(), 0);
+        return brick_table;
+    }
+
+    std::vector<uint32_t> brick_bits(brick_transfer_buf.size / sizeof(uint32_t));
+    cp_data_from_buf(&brick_transfer_buf, brick_bits.data());
+
+    for (uint32_t word = 0; word < brick_bits.size(); word++) {
+        uint32_t bits = brick_bits[word];
+        while (bits != 0) {
+            const uint32_t index = word * 32 + static_cast<uint32_t>(std::countr_zero(bits));
+            if (index < brick_count)
+                brick_table.push_back(index);
+            bits &= bits - 1;
+        }
+    }
+
+    return brick_table;
+}
+
+// copies every brick of the table into a packed host visible buffer, brick i starts at i * BRICK_RES^3 texels.
+// the returned buffer is mapped and has to be cleaned up by the caller.
+VCW_Buffer App::cp_img_bricks(VCW_Image *p_img, const std::vector<uint32_t> &brick_table, const uint32_t texel_size) {
+    TRACE_SCOPE(__func__);
+    constexpr uint32_t brick_size = BRICK_RES * BRICK_RES * BRICK_RES;
+    VCW_Buffer packed_buf = create_buf(static_cast<VkDeviceSize>(brick_table.size()) * brick_size * texel_size,
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    std::vector<VkBufferImageCopy> regions(brick_table.size());
+    for (size_t i = 0; i < brick_table.size(); i++) {
+        const uint32_t index = brick_table[i];
+        const uint32_t x = (index % brick_axis_count) * BRICK_RES;
+        const uint32_t y = (index / brick_axis_count % brick_axis_count) * BRICK_RES;
+        const uint32_t z = (index / (brick_axis_count * brick_axis_count)) * BRICK_RES;
+
+        // edge bricks are cut off, but keep the packed stride of a full brick
+        VkBufferImageCopy &region = regions[i];
+        region.bufferOffset = static_cast<VkDeviceSize>(i) * brick_size * texel_size;
+        region.bufferRowLength = BRICK_RES;
+        region.bufferImageHeight = BRICK_RES;
+        region.imageSubresource = DEFAULT_SUBRESOURCE_LAYERS;
+        region.imageOffset = {static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z)};
+        region.imageExtent = {std::min<uint32_t>(BRICK_RES, tile_res - x),
+                              std::min<uint32_t>(BRICK_RES, tile_res - y),
+                              std::min<uint32_t>(BRICK_RES, tile_res - z)};
+    }
+
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+    transition_img_layout(cmd_buf, p_img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT);
+    if (!regions.empty())
+        vkCmdCopyImageToBuffer(cmd_buf, p_img->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, packed_buf.buf,
+                               static_cast<uint32_t>(regions.size()), regions.data());
+    transition_img_layout(cmd_buf, p_img, VK_IMAGE_LAYOUT_GENERAL, 0,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    end_single_time_cmd(cmd_buf);
+
+    map_buf(&packed_buf);
+    readback_bytes += packed_buf.size;
+    return packed_buf;
+}
+
+// scatters the packed bricks of cp_img_bricks into a linear grid of texel_size bytes per voxel, the render target
+// starts at origin of the grid
+void App::scatter_bricks(const VCW_Buffer &packed_buf, const std::vector<uint32_t> &brick_table,
+                         const uint32_t texel_size, uint8_t *p_grid, const glm::uvec3 origin) const {
+    TRACE_SCOPE(__func__);
+    const auto *p_packed = static_cast<const uint8_t *>(packed_buf.p_mapped_mem);
+    const size_t res = params.chunk_res;
+
+    for (size_t i = 0; i < brick_table.size(); i++) {
+        const uint32_t index = brick_table[i];
+        const uint32_t x = (index % brick_axis_count) * BRICK_RES;
+        const uint32_t y = (index / brick_axis_count % brick_axis_count) * BRICK_RES;
+        const uint32_t z = (index / (brick_axis_count * brick_axis_count)) * BRICK_RES;
+
+        const uint32_t width = std::min<uint32_t>(BRICK_RES, tile_res - x);
+        const uint32_t height = std::min<uint32_t>(BRICK_RES, tile_res - y);
+        const uint32_t depth = std::min<uint32_t>(BRICK_RES, tile_res - z);
+
+        const uint8_t *p_brick = p_packed + i * BRICK_RES * BRICK_RES * BRICK_RES * texel_size;
+        for (uint32_t bz = 0; bz < depth; bz++) {
+            for (uint32_t by = 0; by < height; by++) {
+                const size_t dst = (origin.z + z + bz) * res * res + (origin.y + y + by) * res + origin.x + x;
+                memcpy(p_grid + dst * texel_size, p_brick + (bz * BRICK_RES + by) * BRICK_RES * texel_size,
+                       width * texel_size);
+            }
+        }
+    }
+}
+
+// scatters the packed bricks of the render target straight into the morton order of the grid, so that the grid never
+// has to be reordered. aligned bricks inside the grid are contiguous runs, the ones on the border are placed per voxel.
+void App::scatter_bricks_morton(const VCW_Buffer &packed_buf, const std::vector<uint32_t> &brick_table,
+                                uint8_t *p_grid, const glm::uvec3 origin) const {
+    TRACE_SCOPE(__func__);
+    constexpr uint32_t brick_size = BRICK_RES * BRICK_RES * BRICK_RES;
+    const auto *p_packed = static_cast<const uint8_t *>(packed_buf.p_mapped_mem);
+    const uint32_t res = params.chunk_res;
+
+    // offset of every voxel of a brick in its run
+    std::array<uint32_t, brick_size> brick_offsets{};
+    for (uint32_t i = 0; i < brick_size; i++)
+        brick_offsets[i] = static_cast<uint32_t>(morton_rank(i % BRICK_RES, i / BRICK_RES % BRICK_RES,
+                                                             i / (BRICK_RES * BRICK_RES), BRICK_RES));
+
+    for (size_t i = 0; i < brick_table.size(); i++) {
+        const uint32_t index = brick_table[i];
+        const uint32_t x = (index % brick_axis_count) * BRICK_RES;
+        const uint32_t y = (index / brick_axis_count % brick_axis_count) * BRICK_RES;
+        const uint32_t z = (index / (brick_axis_count * brick_axis_count)) * BRICK_RES;
+        const glm::uvec3 pos = origin + glm::uvec3(x, y, z);
+
+        const uint8_t *p_brick = p_packed + i * brick_size;
+        const bool aligned = pos.x % BRICK_RES == 0 && pos.y % BRICK_RES == 0 && pos.z % BRICK_RES == 0;
+        const bool inside = x + BRICK_RES <= tile_res && y + BRICK_RES <= tile_res && z + BRICK_RES <= tile_res;
+
+        if (aligned && inside) {
+            uint8_t *p_run = p_grid + morton_rank(pos.x, pos.y, pos.z, res);
+            for (uint32_t voxel = 0; voxel < brick_size; voxel++)
+                p_run[brick_offsets[voxel]] = p_brick[voxel];
+            continue;
+        }
+
+        const uint32_t width = std::min<uint32_t>(BRICK_RES, tile_res - x);
+        const uint32_t height = std::min<uint32_t>(BRICK_RES, tile_res - y);
+        const uint32_t depth = std::min<uint32_t>(BRICK_RES, tile_res - z);
+
+        for (uint32_t bz = 0; bz < depth; bz++)
+            for (uint32_t by = 0; by < height; by++)
+                for (uint32_t bx = 0; bx < width; bx++)
+                    p_grid[morton_rank(pos.x + bx, pos.y + by, pos.z + bz, res)] =
+                            p_brick[(bz * BRICK_RES + by) * BRICK_RES + bx];
+    }
+}
+
+// copies every occupied brick of the render target into p_grid at origin, in morton order with -m.
+// p_grid has to be zero initialized.
+void App::cp_occupied_bricks(const std::vector<uint32_t> &brick_table, uint8_t *p_grid, const glm::uvec3 origin) {
+    if (brick_table.empty())
+        return;
+
+    VCW_Buffer packed_buf = cp_img_bricks(&render_target, brick_table, sizeof(uint8_t));
+    if (params.morton_encode)
+        scatter_bricks_morton(packed_buf, brick_table, p_grid, origin);
+    else
+        scatter_bricks(packed_buf, brick_table, sizeof(uint8_t), p_grid, origin);
+
+    unmap_buf(&packed_buf);
+    clean_up_buf(packed_buf);
+}
+
+void App::clean_up_bricks() const {
+    clean_up_buf(brick_buf);
+    clean_up_buf(brick_transfer_buf);
+}
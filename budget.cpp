@@ -0,0 +1,474 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// memory budget: before any grid sized resource is created the footprint of the run is estimated and compared to the
+// free device and host memory, both capped by --mem-limit. a dense grid that does not fit on the device is voxelized
+// in tiles, every tile is rendered with its own projection into a smaller render target and copied into the host grid.
+// the tiles are pulled from a shared queue by every device of the run, see init_tile_workers.
+
+static uint64_t to_mib(const uint64_t bytes) {
+    return (bytes + (1ull << 20) - 1) >> 20;
+}
+
+// prints every item and returns the total
+static uint64_t print_mem_estimates(const std::vector<MemEstimate> &estimates, std::ostream &log) {
+    uint64_t total = 0;
+    for (const auto &estimate: estimates) {
+        log << "  " << estimate.name << ": " << to_mib(estimate.bytes) << " MiB" << std::endl;
+        total += estimate.bytes;
+    }
+    return total;
+}
+
+static uint64_t sum_mem_estimates(const std::vector<MemEstimate> &estimates) {
+    uint64_t total = 0;
+    for (const auto &estimate: estimates)
+        total += estimate.bytes;
+    return total;
+}
+
+// free memory of the largest device local heap. with VK_EXT_memory_budget the usage of other processes is subtracted,
+// otherwise the whole heap counts as free.
+VkDeviceSize App::get_dev_mem_budget(VkPhysicalDevice loc_phy_dev) {
+    const bool use_budget_ext = check_phy_dev_memory_budget(loc_phy_dev);
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props{};
+    budget_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 mem_props{};
+    mem_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (use_budget_ext)
+        mem_props.pNext = &budget_props;
+    vkGetPhysicalDeviceMemoryProperties2(loc_phy_dev, &mem_props);
+
+    VkDeviceSize budget = 0;
+    for (uint32_t i = 0; i < mem_props.memoryProperties.memoryHeapCount; i++) {
+        const VkMemoryHeap &heap = mem_props.memoryProperties.memoryHeaps[i];
+        if (!(heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        VkDeviceSize free = heap.size;
+        if (use_budget_ext)
+            free = budget_props.heapBudget[i] > budget_props.heapUsage[i] ?
+                   budget_props.heapBudget[i] - budget_props.heapUsage[i] : 0;
+        budget = std::max(budget, free);
+    }
+
+    return budget;
+}
+
+// device memory of a run with a render target of res^3, textures and pipelines are not counted
+std::vector<MemEstimate> App::estimate_dev_mem(const uint32_t res) const {
+    std::vector<MemEstimate> estimates;
+    const uint64_t voxels = static_cast<uint64_t>(res) * res * res;
+
+    const uint64_t mesh_bytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t);
+    estimates.push_back({"vertex and index buffers", mesh_bytes});
+
+    if (params.engine == ENGINE_HASH) {
+        estimates.push_back({"hash table and voxel list", 2ull * estimate_hash_capacity() * sizeof(uint64_t)});
+        return estimates;
+    }
+
+    estimates.push_back({"render target", voxels});
+
+    if (params.write_attributes) {
+        const uint64_t mat_size = materials.size() <= UINT8_MAX ? sizeof(uint8_t) : sizeof(uint16_t);
+        estimates.push_back({"attribute targets", voxels * (2 * sizeof(uint32_t) + mat_size)});
+    }
+
+    if (params.solid_axes > 0)
+        estimates.push_back({"parity image", static_cast<uint64_t>(res) * res * div_ceil(res, 32) * params.solid_axes *
+                                             sizeof(uint32_t)});
+
+    if (params.lod_levels > 0) {
+        uint64_t lod_bytes = 0;
+        for (uint32_t level = 1; level <= params.lod_levels; level++)
+            lod_bytes += voxels >> (3 * level);
+        estimates.push_back({"lod levels", 2 * lod_bytes});
+    }
+
+    if (params.generate_sdf)
+        estimates.push_back({"distance field", voxels * (2 * sizeof(uint32_t) + params.sdf_bits / 8)});
+
+    return estimates;
+}
+
+// host memory of a run with a render target of res^3, the svo and the occupied bricks are estimated from the surface
+// area of the mesh
+std::vector<MemEstimate> App::estimate_host_mem(const uint32_t res) const {
+    std::vector<MemEstimate> estimates;
+    const uint64_t grid_bytes = params.chunk_size;
+    const double surface_voxels = estimate_surface_voxels();
+
+    estimates.push_back({"mesh", vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t)});
+
+    if (params.engine == ENGINE_HASH) {
+        // the list is at most half of the table, it is held twice during the readback
+        estimates.push_back({"voxel list", static_cast<uint64_t>(estimate_hash_capacity()) * sizeof(uint64_t)});
+        estimates.push_back({"writer blocks", static_cast<uint64_t>(WRITER_QUEUE_DEPTH + 1) * WRITER_BLOCK_SIZE});
+        return estimates;
+    }
+
+    estimates.push_back({"grid", grid_bytes});
+
+    // a linear grid is reordered in place, with a bit per voxel
+    const bool linear_grid = params.engine == ENGINE_CPU || params.full_readback;
+    if ((params.morton_encode && linear_grid) || (params.generate_svo && !params.morton_encode))
+        estimates.push_back({"morton order bits", grid_bytes / 8});
+
+    // the occupied bricks of a surface hold about BRICK_RES surface voxels each per row of bricks crossed
+    const uint64_t brick_axis = div_ceil(res, BRICK_RES);
+    const uint64_t padded_voxels = brick_axis * brick_axis * brick_axis * BRICK_RES * BRICK_RES * BRICK_RES;
+    const uint64_t brick_voxels = std::min(padded_voxels, static_cast<uint64_t>(surface_voxels * BRICK_RES));
+
+    if (params.engine != ENGINE_CPU)
+        estimates.push_back({"readback buffer", params.full_readback ? static_cast<uint64_t>(res) * res * res :
+                                                brick_voxels});
+
+    if (params.generate_svo)
+        estimates.push_back({"svo", static_cast<uint64_t>(surface_voxels * SVO_BYTES_PER_VOXEL)});
+
+    if (params.write_attributes) {
+        const uint64_t mat_size = materials.size() <= UINT8_MAX ? sizeof(uint8_t) : sizeof(uint16_t);
+        estimates.push_back({"attributes", brick_voxels * (2 * sizeof(uint32_t) + mat_size) + WRITER_BLOCK_SIZE});
+    }
+
+    if (params.generate_sdf)
+        estimates.push_back({"distance field", 2 * padded_voxels * (params.sdf_bits / 8)});
+
+    // runs and masks of the surface, plus a mask per 64 voxels of the rest
+    if (params.chunk_codec != CODEC_NONE)
+        estimates.push_back({"compressed chunks", static_cast<uint64_t>(surface_voxels * 4) + grid_bytes / 64});
+
+    const bool chunked = params.chunk_codec != CODEC_NONE;
+    const uint32_t writer_count = params.write_attributes + params.generate_sdf + (chunked ? 1 + params.lod_levels : 0);
+    if (writer_count > 0)
+        estimates.push_back({"writer blocks", static_cast<uint64_t>(writer_count) * (WRITER_QUEUE_DEPTH + 1) *
+                                              WRITER_BLOCK_SIZE});
+
+    if (params.lod_levels > 0) {
+        uint64_t lod_bytes = 0;
+        for (uint32_t level = 1; level <= params.lod_levels; level++)
+            lod_bytes += grid_bytes >> (3 * level);
+        estimates.push_back({"lod levels", 2 * lod_bytes});
+    }
+
+    return estimates;
+}
+
+// the free device memory of loc_phy_dev less the headroom, capped by --mem-limit
+uint64_t App::get_dev_mem_limit(VkPhysicalDevice loc_phy_dev) const {
+    const uint64_t limit = static_cast<uint64_t>(params.mem_limit_mib) << 20;
+    const auto dev_budget = static_cast<uint64_t>(static_cast<double>(get_dev_mem_budget(loc_phy_dev)) *
+                                                  MEM_BUDGET_HEADROOM);
+    return limit > 0 ? std::min(dev_budget, limit) : dev_budget;
+}
+
+// a run with a render target of res^3 fits into dev_budget and the limits of loc_phy_dev, the render target is a
+// single allocation
+bool App::fits_dev_mem(VkPhysicalDevice loc_phy_dev, const uint32_t res, const uint64_t dev_budget) const {
+    VkPhysicalDeviceMaintenance3Properties maintenance_props{};
+    maintenance_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+    VkPhysicalDeviceProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &maintenance_props;
+    vkGetPhysicalDeviceProperties2(loc_phy_dev, &props);
+
+    const uint64_t voxels = static_cast<uint64_t>(res) * res * res;
+    return sum_mem_estimates(estimate_dev_mem(res)) <= dev_budget &&
+           voxels <= maintenance_props.maxMemoryAllocationSize &&
+           res <= props.properties.limits.maxImageDimension3D;
+}
+
+// picks the smallest tile count per axis whose footprint fits, has to be called before create_render_target. the cpu
+// engine only checks the host memory.
+void App::plan_memory() {
+    TRACE_SCOPE(__func__);
+    *p_log << std::endl << "--- Memory budget ---" << std::endl;
+
+    const bool cpu = params.engine == ENGINE_CPU;
+    const uint64_t limit = static_cast<uint64_t>(params.mem_limit_mib) << 20;
+
+    tile_count = 1;
+    tile_res = params.chunk_res;
+
+    uint64_t dev_total = 0;
+    if (!cpu) {
+        const uint64_t dev_budget = get_dev_mem_limit(phy_dev);
+
+        *p_log << "device budget: " << to_mib(dev_budget) << " MiB"
+               << (check_phy_dev_memory_budget(phy_dev) ? "" : " (heap size, VK_EXT_memory_budget not available)")
+               << std::endl;
+
+        auto fits = [&](const uint32_t res) {
+            return fits_dev_mem(phy_dev, res, dev_budget);
+        };
+
+        // only the surface grid of the dense engine can be split
+        if (params.engine == ENGINE_DENSE && !fits(params.chunk_res)) {
+            tile_count = 0;
+            for (uint32_t count = 2; params.chunk_res % count == 0 && params.chunk_res / count >= BRICK_RES;
+                 count *= 2) {
+                if (fits(params.chunk_res / count)) {
+                    tile_count = count;
+                    break;
+                }
+            }
+        }
+
+        const std::vector<MemEstimate> full_estimates = estimate_dev_mem(params.chunk_res);
+        const uint64_t full_total = print_mem_estimates(full_estimates, *p_log);
+        *p_log << "device total: " << to_mib(full_total) << " MiB" << std::endl;
+
+        const bool tileable = params.engine == ENGINE_DENSE && !params.write_attributes && !params.palette &&
+                              params.solid_axes == 0 && params.lod_levels == 0 && !params.generate_sdf;
+
+        if (params.engine == ENGINE_HASH && full_total > dev_budget)
+            throw std::runtime_error("the hash engine needs " + std::to_string(to_mib(full_total)) + " MiB of device "
+                                     "memory, only " + std::to_string(to_mib(dev_budget)) + " MiB are available. "
+                                     "lower -hc or -r.");
+
+        if (tile_count == 0)
+            throw std::runtime_error("a " + std::to_string(params.chunk_res) + "^3 grid does not fit into " +
+                                     std::to_string(to_mib(dev_budget)) + " MiB of device memory, not even in tiles.");
+
+        if (tile_count > 1 && !tileable)
+            throw std::runtime_error("a " + std::to_string(params.chunk_res) + "^3 grid needs " +
+                                     std::to_string(to_mib(full_total)) + " MiB of device memory, only " +
+                                     std::to_string(to_mib(dev_budget)) + " MiB are available and -a, -p, -fill, "
+                                     "-lod and -sdf do not support tiling.");
+
+        tile_res = params.chunk_res / tile_count;
+        dev_total = sum_mem_estimates(estimate_dev_mem(tile_res));
+        if (tile_count > 1)
+            *p_log << "tiles: " << tile_count << "^3 of " << tile_res << "^3, device total: " << to_mib(dev_total)
+                   << " MiB" << std::endl;
+    }
+
+    uint64_t host_budget = static_cast<uint64_t>(static_cast<double>(get_available_host_mem()) * MEM_BUDGET_HEADROOM);
+    if (limit > 0)
+        host_budget = host_budget > 0 ? std::min(host_budget, limit) : limit;
+    const bool host_budget_known = host_budget > 0;
+
+    // on integrated gpus the device memory is taken from the same pool
+    if (!cpu && phy_dev_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+        host_budget = host_budget > dev_total ? host_budget - dev_total : 0;
+
+    if (host_budget_known)
+        *p_log << "host budget: " << to_mib(host_budget) << " MiB" << std::endl;
+    else
+        *p_log << "host budget: unknown" << std::endl;
+
+    const uint64_t host_total = print_mem_estimates(estimate_host_mem(tile_res), *p_log);
+    *p_log << "host total: " << to_mib(host_total) << " MiB" << std::endl;
+
+    if (host_budget_known && host_total > host_budget)
+        throw std::runtime_error("a " + std::to_string(params.chunk_res) + "^3 grid needs " +
+                                 std::to_string(to_mib(host_total)) + " MiB of host memory, only " +
+                                 std::to_string(to_mib(host_budget)) + " MiB are available.");
+}
+
+// the devices after the first one of a tiled run, --devices in total and every suitable gpu by default. with more
+// devices than gpus every gpu gets several logical devices, in the order of the ranking. the memory limit applies per
+// device, a device that cannot hold a tile is skipped.
+void App::init_tile_workers() {
+    TRACE_SCOPE(__func__);
+    const std::vector<VkPhysicalDevice> phy_devs = get_suitable_phy_devs();
+    const uint32_t dev_count = params.dev_count > 0 ? params.dev_count : static_cast<uint32_t>(phy_devs.size());
+    const uint32_t tile_total = tile_count * tile_count * tile_count;
+
+    *p_log << "device 0: " << phy_dev_props.deviceName << std::endl;
+
+    for (uint32_t i = 1; i < dev_count && tile_workers.size() + 1 < tile_total; i++) {
+        VkPhysicalDevice loc_phy_dev = phy_devs[i % phy_devs.size()];
+
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+
+        // without VK_EXT_memory_budget the logical devices already on the gpu are not part of its budget
+        uint64_t dev_budget = get_dev_mem_limit(loc_phy_dev);
+        if (!check_phy_dev_memory_budget(loc_phy_dev)) {
+            if (phy_dev == loc_phy_dev)
+                dev_budget -= std::min<uint64_t>(dev_budget, dev_mem_in_use);
+            for (const auto &worker: tile_workers)
+                if (worker->phy_dev == loc_phy_dev)
+                    dev_budget -= std::min<uint64_t>(dev_budget, worker->dev_mem_in_use);
+        }
+
+        if (!fits_dev_mem(loc_phy_dev, tile_res, dev_budget)) {
+            *p_log << "device " << i << ": " << props.deviceName << ", skipped, a tile needs more than "
+                   << to_mib(dev_budget) << " MiB" << std::endl;
+            continue;
+        }
+
+        auto worker = std::make_unique<App>();
+        worker->params = params;
+        worker->tile_worker = true;
+        worker->inst = inst;
+        worker->phy_dev = loc_phy_dev;
+        worker->tile_count = tile_count;
+        worker->tile_res = tile_res;
+        worker->materials = materials;
+        worker->raster_tri_count = raster_tri_count;
+        worker->splat_tri_count = splat_tri_count;
+        worker->print_batches = false;
+        worker->p_log = p_log;
+        worker->p_abort_requested = p_abort_requested;
+
+        // the mesh is only read by the upload, it is lent instead of copied
+        const auto lend_mesh = [&] {
+            std::swap(worker->vertices, vertices);
+            std::swap(worker->indices, indices);
+        };
+        lend_mesh();
+        try {
+            worker->init_app();
+        } catch (...) {
+            lend_mesh();
+            // not a worker yet, the clean up of the main app does not reach it
+            worker->clean_up();
+            throw;
+        }
+        lend_mesh();
+
+        *p_log << "device " << i << ": " << props.deviceName << std::endl;
+        tile_workers.push_back(std::move(worker));
+    }
+
+    tile_dev_count = static_cast<uint32_t>(tile_workers.size()) + 1;
+    print_batches = tile_dev_count == 1;
+}
+
+// renders a tile and copies it into p_grid at its offset, vox_stats holds the statistics of the tile afterwards
+void App::render_tile(const glm::uvec3 tile, const glm::mat4 &full_proj, uint8_t *p_grid,
+                      std::vector<uint8_t> *p_tile_grid) {
+    TRACE_SCOPE(__func__);
+    const glm::uvec3 origin = tile * tile_res;
+    const size_t res = params.chunk_res;
+
+    // maps the clip space range of the tile to [-1, 1] on every axis
+    const auto count = static_cast<float>(tile_count);
+    chunk_module.proj = glm::translate(glm::mat4(1.0f), glm::vec3(count - 1.0f) - 2.0f * glm::vec3(tile)) *
+                        glm::scale(glm::mat4(1.0f), glm::vec3(count)) * full_proj;
+
+    render();
+    vkQueueWaitIdle(q_graph);
+    trace_gpu_queries("voxelize", QUERY_VOX_BEGIN, QUERY_VOX_END);
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    read_stats();
+
+    if (params.full_readback) {
+        cp_data_from_buf(&transfer_buf, p_tile_grid->data());
+        for (size_t z = 0; z < tile_res; z++) {
+            for (size_t y = 0; y < tile_res; y++) {
+                memcpy(p_grid + ((origin.z + z) * res + origin.y + y) * res + origin.x,
+                       p_tile_grid->data() + (z * tile_res + y) * tile_res, tile_res);
+            }
+        }
+    } else {
+        cp_occupied_bricks(read_brick_table(), p_grid, origin);
+    }
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    stage_times.readback += std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
+
+// every device pulls the next tile from a shared counter until none are left. the tiles cover disjoint parts of
+// p_grid, only the statistics are merged under a lock. p_grid has to be zero initialized.
+void App::voxelize_tiles(uint8_t *p_grid) {
+    TRACE_SCOPE(__func__);
+    const glm::mat4 full_proj = chunk_module.proj;
+    const uint32_t tile_total = tile_count * tile_count * tile_count;
+
+    VCW_VoxelStats total_stats{};
+    std::fill(std::begin(total_stats.aabb_min), std::end(total_stats.aabb_min), UINT32_MAX);
+
+    // this app is device 0
+    std::vector<App *> devs = {this};
+    for (const auto &worker: tile_workers) {
+        worker->chunk_module = chunk_module;
+        devs.push_back(worker.get());
+    }
+
+    // the readback of this app before the tiles, the time of the tiles is measured per device
+    const double prev_readback = stage_times.readback;
+    stage_times.readback = 0.0;
+
+    std::atomic<uint32_t> next_tile = 0;
+    std::mutex merge_mutex;
+    std::exception_ptr error;
+
+    const auto run_dev = [&](const uint32_t dev_index) {
+        App *p_dev = devs[dev_index];
+
+        std::vector<uint8_t> tile_grid;
+        if (params.full_readback)
+            tile_grid.resize(static_cast<size_t>(tile_res) * tile_res * tile_res);
+
+        try {
+            for (uint32_t index = next_tile++; index < tile_total; index = next_tile++) {
+                // a failed device or ctrl+c stops the others before their next tile, inside of a tile after the
+                // current draw batch
+                if (*p_abort_requested)
+                    throw std::runtime_error("voxelization aborted.");
+
+                const glm::uvec3 tile = {index % tile_count, index / tile_count % tile_count,
+                                         index / (tile_count * tile_count)};
+
+                std::ostringstream line;
+                line << "tile (" << tile.x << ", " << tile.y << ", " << tile.z << ")";
+                if (devs.size() > 1)
+                    line << " on device " << dev_index;
+                *p_log << line.str() + "\n" << std::flush;
+
+                p_dev->render_tile(tile, full_proj, p_grid, &tile_grid);
+
+                const VCW_VoxelStats &stats = p_dev->vox_stats;
+                if (stats.vox_count == 0)
+                    continue;
+
+                const glm::uvec3 origin = tile * tile_res;
+                std::lock_guard lock(merge_mutex);
+                total_stats.vox_count += stats.vox_count;
+                for (int axis = 0; axis < 3; axis++) {
+                    uint32_t &aabb_min = total_stats.aabb_min[axis];
+                    uint32_t &aabb_max = total_stats.aabb_max[axis];
+                    aabb_min = std::min(aabb_min, stats.aabb_min[axis] + origin[axis]);
+                    aabb_max = std::max(aabb_max, stats.aabb_max[axis] + origin[axis]);
+                }
+                for (uint32_t i = 0; i < STATS_VALUE_COUNT; i++)
+                    total_stats.value_counts[i] += stats.value_counts[i];
+            }
+        } catch (...) {
+            std::lock_guard lock(merge_mutex);
+            if (!error)
+                error = std::current_exception();
+            *p_abort_requested = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < devs.size(); i++)
+        threads.emplace_back(run_dev, i);
+    run_dev(0);
+    for (auto &thread: threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    // the devices read back at the same time, the slowest of them is counted
+    double max_readback = stage_times.readback;
+    for (const auto &worker: tile_workers) {
+        max_readback = std::max(max_readback, worker->stage_times.readback);
+        readback_bytes += worker->readback_bytes;
+    }
+    stage_times.readback = prev_readback + max_readback;
+
+    chunk_module.proj = full_proj;
+    vox_stats = total_stats;
+}
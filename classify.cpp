@@ -0,0 +1,159 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// triangle classification: triangles with a bounding box under one voxel skip the geometry shader and are point
+// splatted by splat.comp, triangles with an edge longer than TRI_SPLIT_VOXELS are halved along their longest edge
+// until they are not. the index buffer holds the raster triangles first and the splat triangles after them.
+
+static Vertex lerp_vertex(const Vertex &a, const Vertex &b) {
+    Vertex vertex = a;
+    vertex.pos = (a.pos + b.pos) * 0.5f;
+    vertex.color = (a.color + b.color) * 0.5f;
+    vertex.uv = (a.uv + b.uv) * 0.5f;
+
+    const glm::vec3 normal = a.normal + b.normal;
+    if (glm::dot(normal, normal) > 0.0f)
+        vertex.normal = glm::normalize(normal);
+
+    return vertex;
+}
+
+static bool is_finite(const glm::vec3 &v) {
+    return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+// has to be called after the bounds of the model are known
+void App::classify_tris() {
+    TRACE_SCOPE(__func__);
+    const float voxel_size = max_component(dim) / static_cast<float>(params.chunk_res);
+    const float max_edge = TRI_SPLIT_VOXELS * voxel_size;
+
+    // the splat path writes neither hash table nor texture colors
+    const bool splat = params.engine == ENGINE_DENSE && !params.use_textures;
+
+    std::vector<uint32_t> raster_indices;
+    std::vector<uint32_t> splat_indices;
+    raster_indices.reserve(indices.size());
+
+    std::vector<std::array<uint32_t, 3>> pending;
+    uint32_t split_count = 0;
+    uint32_t skip_count = 0;
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const std::array<uint32_t, 3> tri = {indices[i], indices[i + 1], indices[i + 2]};
+
+        const glm::vec3 &p0 = vertices[tri[0]].pos;
+        const glm::vec3 &p1 = vertices[tri[1]].pos;
+        const glm::vec3 &p2 = vertices[tri[2]].pos;
+        // nan or inf would never get short enough to stop splitting, and has no voxel to cover anyway
+        if (!is_finite(p0) || !is_finite(p1) || !is_finite(p2)) {
+            skip_count++;
+            continue;
+        }
+        if (splat && max_component(glm::max(p0, glm::max(p1, p2)) - glm::min(p0, glm::min(p1, p2))) < voxel_size) {
+            splat_indices.insert(splat_indices.end(), tri.begin(), tri.end());
+            continue;
+        }
+
+        pending.push_back(tri);
+        while (!pending.empty()) {
+            std::array<uint32_t, 3> cur = pending.back();
+            pending.pop_back();
+
+            // rotate the longest edge to cur[0] -> cur[1], the winding stays the same
+            float edge_lengths[3];
+            for (uint32_t e = 0; e < 3; e++)
+                edge_lengths[e] = glm::distance(vertices[cur[e]].pos, vertices[cur[(e + 1) % 3]].pos);
+            const auto longest = static_cast<uint32_t>(std::max_element(edge_lengths, edge_lengths + 3) - edge_lengths);
+            std::rotate(cur.begin(), cur.begin() + longest, cur.end());
+
+            // the edges of a finite triangle can still overflow
+            if (!std::isfinite(edge_lengths[longest])) {
+                skip_count++;
+                continue;
+            }
+            if (edge_lengths[longest] <= max_edge) {
+                raster_indices.insert(raster_indices.end(), cur.begin(), cur.end());
+                continue;
+            }
+
+            const auto mid = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(lerp_vertex(vertices[cur[0]], vertices[cur[1]]));
+
+            pending.push_back({cur[0], mid, cur[2]});
+            pending.push_back({mid, cur[1], cur[2]});
+            split_count++;
+        }
+    }
+
+    raster_tri_count = static_cast<uint32_t>(raster_indices.size() / 3);
+    splat_tri_count = static_cast<uint32_t>(splat_indices.size() / 3);
+
+    indices = std::move(raster_indices);
+    indices.insert(indices.end(), splat_indices.begin(), splat_indices.end());
+
+    *p_log << "raster triangles: " << raster_tri_count << " (" << split_count << " splits)" << std::endl;
+    *p_log << "splat triangles: " << splat_tri_count << std::endl;
+    if (skip_count > 0)
+        *p_log << "skipped triangles with non-finite positions: " << skip_count << std::endl;
+}
+
+void App::create_splat_pipe() {
+    std::vector<VkDescriptorType> desc_types = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+    std::vector<std::string> defines = {"VERTEX_STRIDE=" + std::to_string(sizeof(Vertex) / sizeof(float))};
+
+    if (params.write_attributes) {
+        desc_types.insert(desc_types.end(), 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        defines.emplace_back("ATTRIBUTES");
+        defines.emplace_back(mat_texel_size == sizeof(uint8_t) ? "MAT_FORMAT=r8ui" : "MAT_FORMAT=r16ui");
+    }
+
+    const auto brick_binding = static_cast<uint32_t>(desc_types.size());
+    if (!params.full_readback) {
+        desc_types.push_back(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        defines.emplace_back("BRICK_READBACK");
+        defines.emplace_back("BRICK_RES=" + std::to_string(BRICK_RES));
+        defines.emplace_back("BRICK_BINDING=" + std::to_string(brick_binding));
+    }
+
+    splat_pipe = create_comp_pipe("splat.comp", desc_types, sizeof(VCW_SplatPushConstants), defines);
+    write_comp_img_binding(splat_pipe, render_target, 0);
+    write_comp_buf_binding(splat_pipe, vert_buf, 1);
+    write_comp_buf_binding(splat_pipe, index_buf, 2);
+
+    if (params.write_attributes) {
+        write_comp_img_binding(splat_pipe, color_target, 3);
+        write_comp_img_binding(splat_pipe, normal_target, 4);
+        write_comp_img_binding(splat_pipe, mat_target, 5);
+    }
+
+    if (!params.full_readback)
+        write_comp_buf_binding(splat_pipe, brick_buf, brick_binding);
+}
+
+// has to be recorded after the raster batches, the targets are in general layout
+void App::record_splat(VkCommandBuffer cmd_buf) {
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    VCW_SplatPushConstants splat_const{};
+    splat_const.view_proj = push_const.view_proj;
+    splat_const.first_index = 3 * raster_tri_count;
+    splat_const.tri_count = splat_tri_count;
+    splat_const.res = tile_res;
+
+    const uint32_t group_count = std::min(div_ceil(splat_tri_count, COMP_LOCAL_SIZE),
+                                          phy_dev_props.limits.maxComputeWorkGroupCount[0]);
+    dispatch_comp(cmd_buf, splat_pipe, group_count, 1, 1, &splat_const);
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                        VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+void App::clean_up_splat_pipe() const {
+    clean_up_comp_pipe(splat_pipe);
+}
@@ -0,0 +1,449 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "codec.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CODEC_X86
+#endif
+
+// like the cpu engine, the avx2 and sse4 kernels are compiled for every x86 build with gcc / clang and picked at
+// runtime, msvc needs /arch:AVX2
+#if defined(CODEC_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CODEC_AVX2_KERNEL __attribute__((target("avx2")))
+#define CODEC_SSE4_KERNEL __attribute__((target("sse4.1")))
+#elif defined(CODEC_X86) && defined(__AVX2__)
+#define CODEC_AVX2_KERNEL
+#define CODEC_SSE4_KERNEL
+#endif
+
+// the kernels compare whole spans against a broadcast value, movemask turns them into bit masks and tzcnt finds the
+// first mismatch. the formats are the same for every kernel set.
+
+#define MASK_FLAG_BINARY 1u
+// occupancy masks computed per kernel call
+#define MASK_BATCH_WORDS 64u
+
+// bounds checked reads from a chunk
+class ChunkCursor {
+public:
+    ChunkCursor(const uint8_t *p_src, const size_t size) : p_cur(p_src), p_end(p_src + size) {
+    }
+
+    bool at_end() const {
+        return p_cur == p_end;
+    }
+
+    uint8_t read_byte() {
+        if (p_cur == p_end)
+            throw std::runtime_error("malformed chunk.");
+        return *p_cur++;
+    }
+
+    uint64_t read_varint() {
+        // most runs and skips fit into one byte
+        if (p_cur != p_end && *p_cur < 0x80)
+            return *p_cur++;
+
+        uint64_t value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = read_byte();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        throw std::runtime_error("malformed chunk.");
+    }
+
+    uint64_t read_u64() {
+        if (p_end - p_cur < static_cast<ptrdiff_t>(sizeof(uint64_t)))
+            throw std::runtime_error("malformed chunk.");
+        uint64_t value;
+        std::memcpy(&value, p_cur, sizeof(uint64_t));
+        p_cur += sizeof(uint64_t);
+        return value;
+    }
+
+    void read_bytes(uint8_t *p_dst, const size_t size) {
+        if (static_cast<size_t>(p_end - p_cur) < size)
+            throw std::runtime_error("malformed chunk.");
+        std::memcpy(p_dst, p_cur, size);
+        p_cur += size;
+    }
+
+private:
+    const uint8_t *p_cur;
+    const uint8_t *p_end;
+};
+
+static void write_varint(uint64_t value, std::vector<uint8_t> *p_out) {
+    while (value >= 0x80) {
+        p_out->push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    p_out->push_back(static_cast<uint8_t>(value));
+}
+
+static void write_u64(const uint64_t value, std::vector<uint8_t> *p_out) {
+    const size_t size = p_out->size();
+    p_out->resize(size + sizeof(uint64_t));
+    std::memcpy(p_out->data() + size, &value, sizeof(uint64_t));
+}
+
+// byte i of the result is value, eight at a time
+static uint64_t broadcast_byte(const uint8_t value) {
+    return value * 0x0101010101010101ull;
+}
+
+//
+// scalar kernels, eight bytes at a time
+//
+
+// first index after begin whose value differs from p_src[begin], or count
+static uint32_t run_end_scalar(const uint8_t *p_src, const uint32_t begin, const uint32_t count) {
+    const uint8_t value = p_src[begin];
+    const uint64_t pattern = broadcast_byte(value);
+
+    uint32_t i = begin + 1;
+    for (; count - i >= 8; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p_src + i, sizeof(uint64_t));
+        if (const uint64_t diff = word ^ pattern; diff != 0)
+            return i + static_cast<uint32_t>(std::countr_zero(diff)) / 8;
+    }
+
+    while (i < count && p_src[i] == value)
+        i++;
+    return i;
+}
+
+// occupancy of up to 64 voxels, bit i is set if p_src[i] is not 0
+static uint64_t word_mask_scalar(const uint8_t *p_src, const uint32_t bit_count) {
+    uint64_t mask = 0;
+    for (uint32_t bit = 0; bit < bit_count; bit++)
+        mask |= static_cast<uint64_t>(p_src[bit] != 0) << bit;
+    return mask;
+}
+
+static void word_masks_scalar(const uint8_t *p_src, const uint32_t word_count, uint64_t *p_masks) {
+    for (uint32_t word = 0; word < word_count; word++)
+        p_masks[word] = word_mask_scalar(p_src + word * 64, 64);
+}
+
+static bool is_binary_scalar(const uint8_t *p_src, const uint32_t count) {
+    return std::all_of(p_src, p_src + count, [](const uint8_t value) { return value <= 1; });
+}
+
+// 64 voxels, 1 where the bit of mask is set and 0 elsewhere
+static void expand_mask_scalar(const uint64_t mask, uint8_t *p_dst) {
+    for (uint32_t bit = 0; bit < 64; bit++)
+        p_dst[bit] = static_cast<uint8_t>(mask >> bit & 1);
+}
+
+#ifdef CODEC_AVX2_KERNEL
+//
+// avx2 kernels, 64 bytes per iteration
+//
+
+CODEC_AVX2_KERNEL static uint32_t run_end_avx2(const uint8_t *p_src, const uint32_t begin, const uint32_t count) {
+    const __m256i pattern = _mm256_set1_epi8(static_cast<char>(p_src[begin]));
+
+    uint32_t i = begin + 1;
+    for (; count - i >= 64; i += 64) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_src + i));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_src + i + 32));
+        const auto equal_lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, pattern)));
+        const auto equal_hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, pattern)));
+
+        if (const uint64_t diff = ~(static_cast<uint64_t>(equal_hi) << 32 | equal_lo); diff != 0)
+            return i + static_cast<uint32_t>(std::countr_zero(diff));
+    }
+
+    return i < count ? run_end_scalar(p_src, i - 1, count) : count;
+}
+
+CODEC_AVX2_KERNEL static void word_masks_avx2(const uint8_t *p_src, const uint32_t word_count, uint64_t *p_masks) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (uint32_t word = 0; word < word_count; word++) {
+        const uint8_t *p_word = p_src + word * 64;
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_word));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_word + 32));
+        const auto empty_lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero)));
+        const auto empty_hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero)));
+        p_masks[word] = ~(static_cast<uint64_t>(empty_hi) << 32 | empty_lo);
+    }
+}
+
+CODEC_AVX2_KERNEL static bool is_binary_avx2(const uint8_t *p_src, const uint32_t count) {
+    const __m256i one = _mm256_set1_epi8(1);
+
+    // saturating subtraction leaves only values above 1
+    uint32_t i = 0;
+    for (; count - i >= 64; i += 64) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_src + i));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p_src + i + 32));
+        const __m256i above = _mm256_or_si256(_mm256_subs_epu8(lo, one), _mm256_subs_epu8(hi, one));
+        if (!_mm256_testz_si256(above, above))
+            return false;
+    }
+
+    return is_binary_scalar(p_src + i, count - i);
+}
+
+CODEC_AVX2_KERNEL static void expand_mask_avx2(const uint64_t mask, uint8_t *p_dst) {
+    // byte j of a lane gets mask byte j / 8 of the lane's 16 bits and keeps bit j % 8
+    const __m256i shuffle = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                             2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ull));
+    const __m256i one = _mm256_set1_epi8(1);
+
+    for (uint32_t half = 0; half < 2; half++) {
+        const __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(mask >> 32 * half)), shuffle);
+        const __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(spread, bits), bits);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p_dst + 32 * half), _mm256_and_si256(set, one));
+    }
+}
+#endif
+
+#ifdef CODEC_SSE4_KERNEL
+//
+// sse4 kernels, 64 bytes per iteration in four registers
+//
+
+CODEC_SSE4_KERNEL static uint64_t equal_mask_sse4(const uint8_t *p_src, const __m128i pattern) {
+    uint64_t mask = 0;
+    for (uint32_t part = 0; part < 4; part++) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_src + 16 * part));
+        mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern))))
+                << 16 * part;
+    }
+    return mask;
+}
+
+CODEC_SSE4_KERNEL static uint32_t run_end_sse4(const uint8_t *p_src, const uint32_t begin, const uint32_t count) {
+    const __m128i pattern = _mm_set1_epi8(static_cast<char>(p_src[begin]));
+
+    uint32_t i = begin + 1;
+    for (; count - i >= 64; i += 64) {
+        if (const uint64_t diff = ~equal_mask_sse4(p_src + i, pattern); diff != 0)
+            return i + static_cast<uint32_t>(std::countr_zero(diff));
+    }
+
+    return i < count ? run_end_scalar(p_src, i - 1, count) : count;
+}
+
+CODEC_SSE4_KERNEL static void word_masks_sse4(const uint8_t *p_src, const uint32_t word_count, uint64_t *p_masks) {
+    for (uint32_t word = 0; word < word_count; word++)
+        p_masks[word] = ~equal_mask_sse4(p_src + word * 64, _mm_setzero_si128());
+}
+
+CODEC_SSE4_KERNEL static bool is_binary_sse4(const uint8_t *p_src, const uint32_t count) {
+    const __m128i one = _mm_set1_epi8(1);
+
+    uint32_t i = 0;
+    for (; count - i >= 64; i += 64) {
+        __m128i above = _mm_setzero_si128();
+        for (uint32_t part = 0; part < 4; part++) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p_src + i + 16 * part));
+            above = _mm_or_si128(above, _mm_subs_epu8(v, one));
+        }
+        if (!_mm_testz_si128(above, above))
+            return false;
+    }
+
+    return is_binary_scalar(p_src + i, count - i);
+}
+
+CODEC_SSE4_KERNEL static void expand_mask_sse4(const uint64_t mask, uint8_t *p_dst) {
+    const __m128i shuffle = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits = _mm_set1_epi64x(static_cast<int64_t>(0x8040201008040201ull));
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (uint32_t part = 0; part < 4; part++) {
+        const __m128i spread = _mm_shuffle_epi8(_mm_set1_epi16(static_cast<short>(mask >> 16 * part)), shuffle);
+        const __m128i set = _mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p_dst + 16 * part), _mm_and_si128(set, one));
+    }
+}
+#endif
+
+struct CodecKernels {
+    const char *name;
+    uint32_t (*run_end)(const uint8_t *p_src, uint32_t begin, uint32_t count);
+    // masks of word_count whole words
+    void (*word_masks)(const uint8_t *p_src, uint32_t word_count, uint64_t *p_masks);
+    bool (*is_binary)(const uint8_t *p_src, uint32_t count);
+    void (*expand_mask)(uint64_t mask, uint8_t *p_dst);
+};
+
+static CodecKernels pick_kernels() {
+#ifdef CODEC_AVX2_KERNEL
+#if defined(__GNUC__) || defined(__clang__)
+    const bool avx2 = __builtin_cpu_supports("avx2");
+    const bool sse4 = __builtin_cpu_supports("sse4.1");
+#else
+    const bool avx2 = true;
+    const bool sse4 = true;
+#endif
+    if (avx2)
+        return {"avx2", run_end_avx2, word_masks_avx2, is_binary_avx2, expand_mask_avx2};
+    if (sse4)
+        return {"sse4", run_end_sse4, word_masks_sse4, is_binary_sse4, expand_mask_sse4};
+#endif
+
+    return {"scalar", run_end_scalar, word_masks_scalar, is_binary_scalar, expand_mask_scalar};
+}
+
+static const CodecKernels &get_kernels() {
+    static const CodecKernels kernels = pick_kernels();
+    return kernels;
+}
+
+const char *get_codec_kernel_name() {
+    return get_kernels().name;
+}
+
+uint32_t get_cvox_chunk_voxels(const uint32_t res, const bool morton) {
+    const uint64_t voxel_count = static_cast<uint64_t>(res) * res * res;
+    if (morton)
+        return static_cast<uint32_t>(std::min<uint64_t>(CVOX_CHUNK_VOXELS, voxel_count));
+
+    // a chunk holds at least one slice, which takes more than 32 bits from a res of 65536 on
+    const uint64_t slice = static_cast<uint64_t>(res) * res;
+    if (slice > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("grid slices are too large for cvox chunks.");
+    const uint64_t slices = std::clamp<uint64_t>(CVOX_CHUNK_VOXELS / std::max<uint64_t>(slice, 1), 1,
+                                                 std::max(res, 1u));
+    return static_cast<uint32_t>(slices * slice);
+}
+
+static void encode_rle(const uint8_t *p_src, const uint32_t count, std::vector<uint8_t> *p_out) {
+    const auto run_end = get_kernels().run_end;
+    for (uint32_t i = 0; i < count;) {
+        const uint32_t end = run_end(p_src, i, count);
+        p_out->push_back(p_src[i]);
+        write_varint(end - i, p_out);
+        i = end;
+    }
+}
+
+static void decode_rle(ChunkCursor cursor, uint8_t *p_dst, const uint32_t count) {
+    for (uint32_t i = 0; i < count;) {
+        const uint8_t value = cursor.read_byte();
+        const uint64_t run = cursor.read_varint();
+        if (run == 0 || run > count - i)
+            throw std::runtime_error("malformed chunk.");
+
+        // short runs are stored 32 bytes wide if there is room, the next run overwrites the rest
+        if (run <= 32 && count - i >= 32) {
+            const uint64_t pattern = broadcast_byte(value);
+            for (uint32_t part = 0; part < 4; part++)
+                std::memcpy(p_dst + i + 8 * part, &pattern, sizeof(uint64_t));
+        } else {
+            std::memset(p_dst + i, value, run);
+        }
+        i += static_cast<uint32_t>(run);
+    }
+
+    if (!cursor.at_end())
+        throw std::runtime_error("malformed chunk.");
+}
+
+static void encode_mask(const uint8_t *p_src, const uint32_t count, std::vector<uint8_t> *p_out) {
+    const CodecKernels &kernels = get_kernels();
+    const bool binary = kernels.is_binary(p_src, count);
+    p_out->push_back(binary ? MASK_FLAG_BINARY : 0);
+
+    // trailing empty words are implied by the voxel count
+    uint64_t skip = 0;
+    auto put_word = [&](const uint8_t *p_word, const uint64_t mask) {
+        if (mask == 0) {
+            skip++;
+            return;
+        }
+
+        write_varint(skip, p_out);
+        write_u64(mask, p_out);
+        if (!binary) {
+            for (uint64_t bits = mask; bits != 0; bits &= bits - 1)
+                p_out->push_back(p_word[std::countr_zero(bits)]);
+        }
+        skip = 0;
+    };
+
+    const uint32_t full_words = count / 64;
+    uint64_t masks[MASK_BATCH_WORDS];
+    for (uint32_t first = 0; first < full_words; first += MASK_BATCH_WORDS) {
+        const uint32_t word_count = std::min(MASK_BATCH_WORDS, full_words - first);
+        kernels.word_masks(p_src + first * 64, word_count, masks);
+        for (uint32_t word = 0; word < word_count; word++)
+            put_word(p_src + (first + word) * 64, masks[word]);
+    }
+
+    if (count % 64 != 0)
+        put_word(p_src + full_words * 64, word_mask_scalar(p_src + full_words * 64, count % 64));
+}
+
+static void decode_mask(ChunkCursor cursor, uint8_t *p_dst, const uint32_t count) {
+    std::memset(p_dst, 0, count);
+
+    const auto expand_mask = get_kernels().expand_mask;
+    const bool binary = cursor.read_byte() & MASK_FLAG_BINARY;
+    const uint64_t word_count = (static_cast<uint64_t>(count) + 63) / 64;
+
+    for (uint64_t word = 0; !cursor.at_end(); word++) {
+        word += cursor.read_varint();
+        if (word >= word_count)
+            throw std::runtime_error("malformed chunk.");
+
+        const uint64_t mask = cursor.read_u64();
+        const uint64_t bit_count = std::min<uint64_t>(64, count - word * 64);
+        if (bit_count < 64 && mask >> bit_count != 0)
+            throw std::runtime_error("malformed chunk.");
+
+        uint8_t *p_word = p_dst + word * 64;
+        if (binary && bit_count == 64) {
+            expand_mask(mask, p_word);
+        } else if (!binary && mask == ~0ull) {
+            cursor.read_bytes(p_word, 64);
+        } else {
+            for (uint64_t bits = mask; bits != 0; bits &= bits - 1)
+                p_word[std::countr_zero(bits)] = binary ? 1 : cursor.read_byte();
+        }
+    }
+}
+
+void encode_chunk(const VoxelCodec codec, const uint8_t *p_src, const uint32_t count, std::vector<uint8_t> *p_out) {
+    switch (codec) {
+        case CODEC_RLE:
+            encode_rle(p_src, count, p_out);
+            break;
+        case CODEC_MASK:
+            encode_mask(p_src, count, p_out);
+            break;
+        default:
+            throw std::runtime_error("unknown chunk codec.");
+    }
+}
+
+void decode_chunk(const VoxelCodec codec, const uint8_t *p_src, const size_t size, uint8_t *p_dst,
+                  const uint32_t count) {
+    switch (codec) {
+        case CODEC_RLE:
+            decode_rle(ChunkCursor(p_src, size), p_dst, count);
+            break;
+        case CODEC_MASK:
+            decode_mask(ChunkCursor(p_src, size), p_dst, count);
+            break;
+        default:
+            throw std::runtime_error("unknown chunk codec.");
+    }
+}
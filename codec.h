@@ -0,0 +1,54 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef VCW_CODEC_H
+#define VCW_CODEC_H
+
+// chunked voxel layout (.cvox): the grid in file order, linear or morton, is cut into chunks of chunk_voxels which
+// are compressed independently. the header is followed by chunk_count + 1 offsets from the start of the file, chunk i
+// spans [offsets[i], offsets[i + 1]). linear grids are cut into whole z slabs, morton grids into aligned code ranges,
+// so a region only needs the chunks it overlaps. without vulkan, the reader library shares it.
+
+#define CVOX_MAGIC 0x584f5643u
+#define CVOX_VERSION 1
+// voxels per chunk, linear grids round it to whole slices
+#define CVOX_CHUNK_VOXELS (1u << 18)
+
+enum VoxelCodec : uint32_t {
+    // not chunked, the grid goes through vss
+    CODEC_NONE = 0,
+    // runs of equal values, value byte and varint length
+    CODEC_RLE = 1,
+    // per 64 voxels a varint count of empty words before, the occupancy mask and the values of the occupied voxels.
+    // a flag byte in front of the chunk drops the values if all of them are 1.
+    CODEC_MASK = 2
+};
+
+struct CvoxHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_res;
+    uint32_t morton_encoded;
+    uint32_t codec;
+    uint32_t chunk_voxels;
+    uint32_t chunk_count;
+    uint32_t reserved;
+};
+
+uint32_t get_cvox_chunk_voxels(uint32_t res, bool morton);
+
+// avx2, sse4 or scalar, picked on first use
+const char *get_codec_kernel_name();
+
+// appends the compressed count voxels of p_src to p_out
+void encode_chunk(VoxelCodec codec, const uint8_t *p_src, uint32_t count, std::vector<uint8_t> *p_out);
+
+// decodes a whole chunk of count voxels, throws if it is malformed
+void decode_chunk(VoxelCodec codec, const uint8_t *p_src, size_t size, uint8_t *p_dst, uint32_t count);
+
+#endif //VCW_CODEC_H
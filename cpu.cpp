@@ -0,0 +1,334 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CPU_X86
+#endif
+
+// the avx2 kernel is compiled for every x86 build with gcc / clang and picked at runtime, msvc needs /arch:AVX2
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_AVX2_KERNEL __attribute__((target("avx2")))
+#elif defined(CPU_X86) && defined(__AVX2__)
+#define CPU_AVX2_KERNEL
+#endif
+
+// cpu engine: triangles are binned into BRICK_RES^3 bricks, worker threads take one brick at a time and test every
+// voxel row of a triangle's bounds inside the brick with the separating axis theorem. the rows are vectorized with
+// avx2 or sse, whichever the cpu supports. the grid is filled with the same values the dense engine reads back.
+
+// the three box axes are covered by the voxel bounds, the other ten are the triangle normal and the nine cross
+// products of the edges with the box axes. a voxel with center c overlaps if dot(axis, c) is in [lo, hi] for all.
+struct CpuTriSetup {
+    float axis_x[10];
+    float axis_y[10];
+    float axis_z[10];
+    float lo[10];
+    float hi[10];
+    float radius[10];
+
+    uint32_t min[3];
+    uint32_t max[3];
+};
+
+// tolerance in voxels, touching counts as overlapping
+#define CPU_SAT_EPSILON 1e-3f
+
+using RowKernel = void (*)(const CpuTriSetup &tri, const float *p_base, uint32_t x_begin, uint32_t x_end,
+                           uint8_t *p_row);
+
+// p_v is in voxel space, returns false if the triangle is outside of the grid
+static bool setup_tri(const glm::vec3 *p_v, const uint32_t res, CpuTriSetup *p_tri) {
+    const glm::vec3 lo = glm::min(p_v[0], glm::min(p_v[1], p_v[2]));
+    const glm::vec3 hi = glm::max(p_v[0], glm::max(p_v[1], p_v[2]));
+    if (glm::any(glm::lessThan(hi, glm::vec3(0.0f))) ||
+        glm::any(glm::greaterThanEqual(lo, glm::vec3(static_cast<float>(res)))))
+        return false;
+
+    for (uint32_t i = 0; i < 3; i++) {
+        p_tri->min[i] = static_cast<uint32_t>(std::clamp(std::floor(lo[i]), 0.0f, static_cast<float>(res - 1)));
+        p_tri->max[i] = static_cast<uint32_t>(std::clamp(std::floor(hi[i]), 0.0f, static_cast<float>(res - 1)));
+    }
+
+    const glm::vec3 edges[3] = {p_v[1] - p_v[0], p_v[2] - p_v[1], p_v[0] - p_v[2]};
+    glm::vec3 axes[10];
+    axes[0] = glm::cross(edges[0], edges[1]);
+    for (uint32_t i = 0; i < 3; i++) {
+        for (uint32_t j = 0; j < 3; j++) {
+            glm::vec3 box_axis(0.0f);
+            box_axis[j] = 1.0f;
+            axes[1 + 3 * i + j] = glm::cross(edges[i], box_axis);
+        }
+    }
+
+    // normalized, so the tolerance is in voxels. degenerate axes stay zero and always pass.
+    for (uint32_t a = 0; a < 10; a++) {
+        const float length = glm::length(axes[a]);
+        const glm::vec3 axis = length > 0.0f ? axes[a] / length : glm::vec3(0.0f);
+
+        const float d0 = glm::dot(axis, p_v[0]);
+        const float d1 = glm::dot(axis, p_v[1]);
+        const float d2 = glm::dot(axis, p_v[2]);
+        const float radius = 0.5f * (std::abs(axis.x) + std::abs(axis.y) + std::abs(axis.z));
+
+        p_tri->axis_x[a] = axis.x;
+        p_tri->axis_y[a] = axis.y;
+        p_tri->axis_z[a] = axis.z;
+        p_tri->lo[a] = std::min(d0, std::min(d1, d2)) - radius - CPU_SAT_EPSILON;
+        p_tri->hi[a] = std::max(d0, std::max(d1, d2)) + radius + CPU_SAT_EPSILON;
+        p_tri->radius[a] = radius;
+    }
+
+    return true;
+}
+
+// same test for a cube of scale voxels, used to bin triangles into bricks
+static bool overlaps_box(const CpuTriSetup &tri, const glm::vec3 &center, const float scale) {
+    for (uint32_t a = 0; a < 10; a++) {
+        const float d = tri.axis_x[a] * center.x + tri.axis_y[a] * center.y + tri.axis_z[a] * center.z;
+        const float extra = (scale - 1.0f) * tri.radius[a];
+        if (d < tri.lo[a] - extra || d > tri.hi[a] + extra)
+            return false;
+    }
+    return true;
+}
+
+// p_base holds axis_y * y + axis_z * z of the row center for every axis
+#ifndef CPU_X86
+static void test_row_scalar(const CpuTriSetup &tri, const float *p_base, const uint32_t x_begin,
+                            const uint32_t x_end, uint8_t *p_row) {
+    for (uint32_t x = x_begin; x < x_end; x++) {
+        const float cx = static_cast<float>(x) + 0.5f;
+
+        bool inside = true;
+        for (uint32_t a = 0; a < 10 && inside; a++) {
+            const float d = tri.axis_x[a] * cx + p_base[a];
+            inside = d >= tri.lo[a] && d <= tri.hi[a];
+        }
+
+        if (inside)
+            p_row[x] = 1;
+    }
+}
+#else
+static void test_row_sse(const CpuTriSetup &tri, const float *p_base, const uint32_t x_begin, const uint32_t x_end,
+                         uint8_t *p_row) {
+    const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (uint32_t x = x_begin; x < x_end; x += 4) {
+        const __m128 cx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lane_offsets);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (uint32_t a = 0; a < 10; a++) {
+            const __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.axis_x[a]), cx), _mm_set1_ps(p_base[a]));
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(d, _mm_set1_ps(tri.lo[a])),
+                                                   _mm_cmple_ps(d, _mm_set1_ps(tri.hi[a]))));
+        }
+
+        auto mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+        if (x_end - x < 4)
+            mask &= (1u << (x_end - x)) - 1;
+
+        while (mask != 0) {
+            p_row[x + static_cast<uint32_t>(std::countr_zero(mask))] = 1;
+            mask &= mask - 1;
+        }
+    }
+}
+#endif
+
+#ifdef CPU_AVX2_KERNEL
+CPU_AVX2_KERNEL static void test_row_avx2(const CpuTriSetup &tri, const float *p_base, const uint32_t x_begin,
+                                          const uint32_t x_end, uint8_t *p_row) {
+    const __m256 lane_offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+    for (uint32_t x = x_begin; x < x_end; x += 8) {
+        const __m256 cx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane_offsets);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t a = 0; a < 10; a++) {
+            const __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.axis_x[a]), cx),
+                                           _mm256_set1_ps(p_base[a]));
+            inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(d, _mm256_set1_ps(tri.lo[a]), _CMP_GE_OQ),
+                                                         _mm256_cmp_ps(d, _mm256_set1_ps(tri.hi[a]), _CMP_LE_OQ)));
+        }
+
+        auto mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        if (x_end - x < 8)
+            mask &= (1u << (x_end - x)) - 1;
+
+        while (mask != 0) {
+            p_row[x + static_cast<uint32_t>(std::countr_zero(mask))] = 1;
+            mask &= mask - 1;
+        }
+    }
+}
+#endif
+
+static RowKernel pick_row_kernel(std::string *p_name) {
+#ifdef CPU_AVX2_KERNEL
+#if defined(__GNUC__) || defined(__clang__)
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    const bool avx2 = true;
+#endif
+    if (avx2) {
+        *p_name = "avx2";
+        return test_row_avx2;
+    }
+#endif
+
+#ifdef CPU_X86
+    *p_name = "sse";
+    return test_row_sse;
+#else
+    *p_name = "scalar";
+    return test_row_scalar;
+#endif
+}
+
+// -e auto: the dense engine if a gpu supports it, the cpu engine otherwise
+void App::pick_engine() {
+    params.engine = ENGINE_DENSE;
+    if (!has_suitable_phy_dev())
+        params.engine = ENGINE_CPU;
+
+    *p_log << "engine: " << (params.engine == ENGINE_CPU ? "cpu" : "dense") << std::endl;
+
+    if (params.engine == ENGINE_CPU &&
+        (params.write_attributes || params.generate_sdf || params.lod_levels > 0 || params.solid_axes > 0))
+        throw std::runtime_error("no suitable GPU found and the requested outputs need one.");
+}
+
+void App::voxelize_cpu(uint8_t *p_grid) {
+    TRACE_SCOPE(__func__);
+    const uint32_t res = params.chunk_res;
+    const auto tri_count = static_cast<uint32_t>(indices.size() / 3);
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    //
+    // triangle setup in voxel space, same transform as shader.vert and shader.frag
+    //
+    std::vector<CpuTriSetup> tris(tri_count);
+    std::vector<uint8_t> tri_valid(tri_count);
+    parallel_ranges(tri_count, thread_count, [&](uint32_t, const uint32_t begin, const uint32_t end) {
+        for (uint32_t tri = begin; tri < end; tri++) {
+            glm::vec3 v[3];
+            for (uint32_t i = 0; i < 3; i++) {
+                const glm::vec4 clip = chunk_module.proj * glm::vec4(vertices[indices[3 * tri + i]].pos, 1.0f);
+                v[i] = static_cast<float>(res) * (glm::vec3(clip) * 0.5f + 0.5f);
+            }
+            tri_valid[tri] = setup_tri(v, res, &tris[tri]);
+        }
+    });
+
+    //
+    // binning, brick b holds brick_tris[brick_offsets[b], brick_offsets[b + 1])
+    //
+    const uint32_t brick_axis = div_ceil(res, BRICK_RES);
+    const uint32_t brick_count = brick_axis * brick_axis * brick_axis;
+
+    auto for_each_brick = [&](const CpuTriSetup &tri, auto func) {
+        for (uint32_t bz = tri.min[2] / BRICK_RES; bz <= tri.max[2] / BRICK_RES; bz++) {
+            for (uint32_t by = tri.min[1] / BRICK_RES; by <= tri.max[1] / BRICK_RES; by++) {
+                for (uint32_t bx = tri.min[0] / BRICK_RES; bx <= tri.max[0] / BRICK_RES; bx++) {
+                    const glm::vec3 center = (glm::vec3(bx, by, bz) + 0.5f) * static_cast<float>(BRICK_RES);
+                    if (overlaps_box(tri, center, BRICK_RES))
+                        func(bx + brick_axis * (by + brick_axis * bz));
+                }
+            }
+        }
+    };
+
+    std::vector<uint32_t> brick_offsets(brick_count + 1, 0);
+    for (uint32_t tri = 0; tri < tri_count; tri++) {
+        if (tri_valid[tri])
+            for_each_brick(tris[tri], [&](const uint32_t brick) { brick_offsets[brick + 1]++; });
+    }
+    std::partial_sum(brick_offsets.begin(), brick_offsets.end(), brick_offsets.begin());
+
+    std::vector<uint32_t> brick_tris(brick_offsets.back());
+    std::vector<uint32_t> brick_fill(brick_offsets.begin(), brick_offsets.end() - 1);
+    for (uint32_t tri = 0; tri < tri_count; tri++) {
+        if (tri_valid[tri])
+            for_each_brick(tris[tri], [&](const uint32_t brick) { brick_tris[brick_fill[brick]++] = tri; });
+    }
+
+    //
+    // voxelization, bricks are disjoint so the workers never write the same voxel
+    //
+    std::string kernel_name;
+    const RowKernel test_row = pick_row_kernel(&kernel_name);
+    *p_log << "cpu kernel: " << kernel_name << ", " << thread_count << " threads" << std::endl;
+
+    std::atomic<uint32_t> next_brick = 0;
+    std::vector<VCW_VoxelStats> thread_stats(thread_count);
+
+    parallel_ranges(thread_count, thread_count, [&](const uint32_t thread, uint32_t, uint32_t) {
+        VCW_VoxelStats &stats = thread_stats[thread];
+        std::fill_n(stats.aabb_min, 3, UINT32_MAX);
+
+        uint32_t brick;
+        while ((brick = next_brick++) < brick_count) {
+            if (brick_offsets[brick] == brick_offsets[brick + 1])
+                continue;
+
+            const uint32_t origin[3] = {brick % brick_axis * BRICK_RES, brick / brick_axis % brick_axis * BRICK_RES,
+                                        brick / (brick_axis * brick_axis) * BRICK_RES};
+            uint32_t end[3];
+            for (uint32_t i = 0; i < 3; i++)
+                end[i] = std::min(origin[i] + BRICK_RES, res);
+
+            for (uint32_t i = brick_offsets[brick]; i < brick_offsets[brick + 1]; i++) {
+                const CpuTriSetup &tri = tris[brick_tris[i]];
+
+                const uint32_t x_begin = std::max(tri.min[0], origin[0]);
+                const uint32_t x_end = std::min(tri.max[0] + 1, end[0]);
+                for (uint32_t z = std::max(tri.min[2], origin[2]); z < std::min(tri.max[2] + 1, end[2]); z++) {
+                    for (uint32_t y = std::max(tri.min[1], origin[1]); y < std::min(tri.max[1] + 1, end[1]); y++) {
+                        float base[10];
+                        for (uint32_t a = 0; a < 10; a++)
+                            base[a] = tri.axis_y[a] * (static_cast<float>(y) + 0.5f) +
+                                      tri.axis_z[a] * (static_cast<float>(z) + 0.5f);
+
+                        test_row(tri, base, x_begin, x_end, p_grid + (static_cast<size_t>(z) * res + y) * res);
+                    }
+                }
+            }
+
+            // statistics of the finished brick, the same as stats.comp computes
+            for (uint32_t z = origin[2]; z < end[2]; z++) {
+                for (uint32_t y = origin[1]; y < end[1]; y++) {
+                    for (uint32_t x = origin[0]; x < end[0]; x++) {
+                        const uint8_t value = p_grid[(static_cast<size_t>(z) * res + y) * res + x];
+                        if (value == 0)
+                            continue;
+
+                        stats.vox_count++;
+                        stats.value_counts[value]++;
+                        const uint32_t coord[3] = {x, y, z};
+                        for (uint32_t i = 0; i < 3; i++) {
+                            stats.aabb_min[i] = std::min(stats.aabb_min[i], coord[i]);
+                            stats.aabb_max[i] = std::max(stats.aabb_max[i], coord[i]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    vox_stats = {};
+    std::fill_n(vox_stats.aabb_min, 3, UINT32_MAX);
+    for (const auto &stats: thread_stats) {
+        vox_stats.vox_count += stats.vox_count;
+        for (uint32_t i = 0; i < 3; i++) {
+            vox_stats.aabb_min[i] = std::min(vox_stats.aabb_min[i], stats.aabb_min[i]);
+            vox_stats.aabb_max[i] = std::max(vox_stats.aabb_max[i], stats.aabb_max[i]);
+        }
+        for (uint32_t i = 0; i < STATS_VALUE_COUNT; i++)
+            vox_stats.value_counts[i] += stats.value_counts[i];
+    }
+}
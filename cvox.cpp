@@ -0,0 +1,44 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// writes p_grid, which is in the order of the output, in the chunked layout of codec.h. the chunks are encoded on all
+// cores, empty ones are cheap, so the threads take the next chunk from a shared counter instead of fixed ranges.
+void App::write_cvox(const std::string &filename, const uint8_t *p_grid, const uint32_t res) {
+    TRACE_SCOPE(__func__);
+    const uint64_t voxel_count = static_cast<uint64_t>(res) * res * res;
+
+    CvoxHeader header{};
+    header.magic = CVOX_MAGIC;
+    header.version = CVOX_VERSION;
+    header.chunk_res = res;
+    header.morton_encoded = params.morton_encode;
+    header.codec = params.chunk_codec;
+    header.chunk_voxels = get_cvox_chunk_voxels(res, params.morton_encode);
+    header.chunk_count = static_cast<uint32_t>((voxel_count + header.chunk_voxels - 1) / header.chunk_voxels);
+
+    std::vector<std::vector<uint8_t>> chunks(header.chunk_count);
+    std::atomic<uint32_t> next_chunk = 0;
+
+    const uint32_t thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, header.chunk_count);
+    parallel_ranges(thread_count, thread_count, [&](uint32_t, uint32_t, uint32_t) {
+        for (uint32_t chunk = next_chunk++; chunk < header.chunk_count; chunk = next_chunk++) {
+            const uint64_t first = static_cast<uint64_t>(chunk) * header.chunk_voxels;
+            const auto count = static_cast<uint32_t>(std::min<uint64_t>(header.chunk_voxels, voxel_count - first));
+            encode_chunk(params.chunk_codec, p_grid + first, count, &chunks[chunk]);
+        }
+    });
+
+    std::vector<uint64_t> offsets(header.chunk_count + 1);
+    offsets[0] = sizeof(CvoxHeader) + offsets.size() * sizeof(uint64_t);
+    for (uint32_t chunk = 0; chunk < header.chunk_count; chunk++)
+        offsets[chunk + 1] = offsets[chunk] + chunks[chunk].size();
+
+    FileWriter &writer = open_writer(filename);
+    writer.write(&header, sizeof(CvoxHeader));
+    writer.write(offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (auto &chunk: chunks)
+        writer.write_owned(std::move(chunk));
+}
@@ -0,0 +1,615 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+#include "../app.h"
+#include "../args.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// voxelization daemon: keeps the vulkan devices, the compiled shaders and the pipeline caches warm between jobs and
+// takes the jobs over a unix domain socket. every message is a frame of a little endian uint32 size and the payload.
+//
+// requests are nul separated strings, the first one is the command:
+//   run <cli options>   voxelizes like the cli, the reply comes once the job is done
+//   stats               queue depth, job counts and latencies
+// replies are one json object each. paths are relative to the working directory of the daemon.
+//
+// a full queue blocks run requests until there is room, clients that send faster than the jobs finish wait instead
+// of piling up work. the jobs run on several workers, the device is used by one job at a time until its results are
+// read back. the encoding and writing of one job overlaps with the device work of the next.
+
+#define DAEMON_DEFAULT_SOCKET "/tmp/gpu_mtv.sock"
+#define DAEMON_DEFAULT_QUEUE_DEPTH 16
+#define DAEMON_DEFAULT_WORKERS 2
+#define DAEMON_MAX_FRAME (1u << 20)
+// finished jobs the latency percentiles are taken over
+#define DAEMON_LATENCY_WINDOW 1024
+
+// a client that went away must not end the daemon, SIGPIPE is also ignored where send has no flag for it
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using DaemonClock = std::chrono::steady_clock;
+
+static double elapsed_ms(const DaemonClock::time_point begin, const DaemonClock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// nearest rank percentile, 0 without samples
+static double percentile(std::vector<double> samples, const double p) {
+    if (samples.empty())
+        return 0.0;
+    std::sort(samples.begin(), samples.end());
+    const auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+static std::string error_reply(const std::string &message) {
+    return "{\"status\": \"error\", \"message\": \"" + json_escape(message) + "\"}";
+}
+
+// what parse_args / validate_args reported, without the blank lines around it
+static std::string option_error(const std::ostringstream &problems) {
+    std::string message = problems.str();
+    const size_t begin = message.find_first_not_of('\n');
+    if (begin == std::string::npos)
+        return "invalid job options, they are the ones of the cli.";
+
+    message = message.substr(begin, message.find_last_not_of('\n') + 1 - begin);
+    std::replace(message.begin(), message.end(), '\n', ' ');
+    return message;
+}
+
+//
+// framing
+//
+static bool read_all(const int fd, void *p_data, size_t size) {
+    auto *p_cur = static_cast<uint8_t *>(p_data);
+    while (size > 0) {
+        const ssize_t result = read(fd, p_cur, size);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        p_cur += result;
+        size -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+static bool write_all(const int fd, const void *p_data, size_t size) {
+    auto *p_cur = static_cast<const uint8_t *>(p_data);
+    while (size > 0) {
+        const ssize_t result = send(fd, p_cur, size, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        p_cur += result;
+        size -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+// false at the end of the connection or for a frame over DAEMON_MAX_FRAME
+static bool read_frame(const int fd, std::string *p_payload) {
+    uint32_t size;
+    if (!read_all(fd, &size, sizeof(uint32_t)) || size > DAEMON_MAX_FRAME)
+        return false;
+
+    p_payload->resize(size);
+    return read_all(fd, p_payload->data(), size);
+}
+
+static bool write_frame(const int fd, const std::string &payload) {
+    const auto size = static_cast<uint32_t>(payload.size());
+    return write_all(fd, &size, sizeof(uint32_t)) && write_all(fd, payload.data(), payload.size());
+}
+
+static std::vector<std::string> split_request(const std::string &payload) {
+    std::vector<std::string> strings;
+    size_t begin = 0;
+    while (begin < payload.size()) {
+        size_t end = payload.find('\0', begin);
+        if (end == std::string::npos)
+            end = payload.size();
+        strings.push_back(payload.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return strings;
+}
+
+static std::string join_request(const std::vector<std::string> &strings) {
+    std::string payload;
+    for (const auto &string: strings) {
+        payload += string;
+        payload += '\0';
+    }
+    return payload;
+}
+
+//
+// job queue
+//
+struct DaemonJob {
+    VoxelizeParams params;
+    DaemonClock::time_point queued;
+    std::promise<std::string> reply;
+};
+
+// bounded, push blocks while it is full
+class JobQueue {
+public:
+    explicit JobQueue(const size_t capacity) : capacity(capacity) {
+    }
+
+    // false once the queue is closed
+    bool push(std::shared_ptr<DaemonJob> job) {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [&] { return closed || jobs.size() < capacity; });
+        if (closed)
+            return false;
+
+        jobs.push_back(std::move(job));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // nullptr once the queue is closed and drained
+    std::shared_ptr<DaemonJob> pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [&] { return closed || !jobs.empty(); });
+        if (jobs.empty())
+            return nullptr;
+
+        std::shared_ptr<DaemonJob> job = std::move(jobs.front());
+        jobs.pop_front();
+        not_full.notify_one();
+        return job;
+    }
+
+    // the queued jobs still run, new ones are refused
+    void close() {
+        std::lock_guard lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard lock(mutex);
+        return jobs.size();
+    }
+
+    size_t get_capacity() const {
+        return capacity;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<std::shared_ptr<DaemonJob>> jobs;
+    const size_t capacity;
+    bool closed = false;
+};
+
+struct DaemonStats {
+    std::mutex mutex;
+    uint32_t running = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    // time in the queue and time running of the last DAEMON_LATENCY_WINDOW jobs
+    std::deque<double> queue_ms;
+    std::deque<double> run_ms;
+};
+
+struct ClientThread {
+    std::thread thread;
+    int fd;
+    std::atomic<bool> done = false;
+};
+
+class Daemon {
+public:
+    Daemon(std::string socket_path, const uint32_t queue_depth, const uint32_t worker_count, const bool verbose)
+        : socket_path(std::move(socket_path)), queue(queue_depth), worker_count(worker_count), verbose(verbose) {
+    }
+
+    // until stop is called
+    void serve();
+
+    // safe to call from a signal handler
+    void stop() {
+        stopping = true;
+        if (listen_fd >= 0)
+            shutdown(listen_fd, SHUT_RDWR);
+    }
+
+private:
+    std::string socket_path;
+    std::atomic<int> listen_fd = -1;
+    std::atomic<bool> stopping = false;
+
+    JobQueue queue;
+    uint32_t worker_count;
+    // the progress of the jobs, muted per job otherwise
+    bool verbose;
+    DaemonStats stats;
+
+    // what -e auto resolves to, decided once at the start
+    VoxelizeEngine auto_engine = ENGINE_DENSE;
+
+    // one job at a time on the device. the contexts are kept by the hash engine and the textures, the two enable
+    // other device features.
+    std::mutex dev_mutex;
+    VCW_DeviceContext dev_contexts[2][2];
+
+    std::mutex client_mutex;
+    std::list<ClientThread> clients;
+
+    void run_worker();
+
+    void serve_client(ClientThread *p_client);
+
+    std::string handle_request(const std::vector<std::string> &request);
+
+    std::string submit(const std::vector<std::string> &args);
+
+    std::string get_stats();
+};
+
+void Daemon::serve() {
+    {
+        App probe{};
+        probe.params.engine = ENGINE_DENSE;
+        auto_engine = probe.has_suitable_phy_dev() ? ENGINE_DENSE : ENGINE_CPU;
+        std::cerr << "engine for -e auto: " << (auto_engine == ENGINE_CPU ? "cpu" : "dense") << std::endl;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path is too long.");
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // a socket left behind by a daemon that did not shut down cleanly refuses connections and is replaced, one that
+    // is still served or that cannot be probed is kept
+    if (std::filesystem::is_socket(socket_path)) {
+        const int probe_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe_fd < 0)
+            throw std::runtime_error("failed to create socket.");
+        const bool connected = connect(probe_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        const int probe_error = errno;
+        close(probe_fd);
+
+        if (connected)
+            throw std::runtime_error("a daemon is already listening on " + socket_path + ".");
+        if (probe_error != ECONNREFUSED)
+            throw std::runtime_error("failed to probe " + socket_path + ".");
+        std::filesystem::remove(socket_path);
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("failed to create socket.");
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to listen on " + socket_path + ".");
+    }
+    listen_fd = fd;
+    std::cerr << "listening on " << socket_path << std::endl;
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < worker_count; i++)
+        workers.emplace_back(&Daemon::run_worker, this);
+
+    while (!stopping) {
+        const int client_fd = accept(fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        std::lock_guard lock(client_mutex);
+        // joins the connections that were closed in the meantime
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (it->done) {
+                it->thread.join();
+                it = clients.erase(it);
+            } else {
+                it++;
+            }
+        }
+
+        ClientThread &client = clients.emplace_back();
+        client.fd = client_fd;
+        client.thread = std::thread(&Daemon::serve_client, this, &client);
+    }
+
+    // the queued jobs finish and are answered, connections end after their current request
+    std::cerr << "shutting down" << std::endl;
+    queue.close();
+    {
+        std::lock_guard lock(client_mutex);
+        for (auto &client: clients)
+            if (!client.done)
+                shutdown(client.fd, SHUT_RD);
+    }
+    for (auto &worker: workers)
+        worker.join();
+    for (auto &client: clients)
+        client.thread.join();
+
+    {
+        std::lock_guard lock(dev_mutex);
+        for (auto &contexts: dev_contexts)
+            for (auto &context: contexts)
+                context.clean_up();
+    }
+
+    listen_fd = -1;
+    close(fd);
+    std::filesystem::remove(socket_path);
+}
+
+void Daemon::run_worker() {
+    NullStreamBuf null_buf;
+    std::ostream null_log(&null_buf);
+
+    while (const std::shared_ptr<DaemonJob> job = queue.pop()) {
+        const auto start_time = DaemonClock::now();
+        {
+            std::lock_guard lock(stats.mutex);
+            stats.running++;
+        }
+
+        const auto p_app = std::make_unique<App>();
+        p_app->params = job->params;
+        VCW_DeviceContext &dev_context = dev_contexts[job->params.engine == ENGINE_HASH][job->params.use_textures];
+        p_app->p_dev_context = &dev_context;
+        p_app->p_dev_mutex = &dev_mutex;
+        if (!verbose)
+            p_app->p_log = &null_log;
+
+        std::string reply;
+        bool ok = true;
+        try {
+            p_app->run();
+        } catch (const std::exception &e) {
+            // a failure on the device can leave it in any state, the next job starts over. the app still holds the
+            // device then, failures before or after that keep it warm.
+            if (p_app->dev_in_use)
+                p_app->reset_dev();
+            reply = error_reply(e.what());
+            ok = false;
+        }
+
+        const auto end_time = DaemonClock::now();
+        const double queue_ms = elapsed_ms(job->queued, start_time);
+        const double run_ms = elapsed_ms(start_time, end_time);
+
+        if (ok) {
+            std::ostringstream record;
+            record << "{\"status\": \"ok\", \"queue_ms\": " << queue_ms << ", \"run_ms\": " << run_ms
+                   << ", \"voxels\": " << p_app->vox_stats.vox_count << "}";
+            reply = record.str();
+        }
+
+        {
+            std::lock_guard lock(stats.mutex);
+            stats.running--;
+            (ok ? stats.completed : stats.failed)++;
+            stats.queue_ms.push_back(queue_ms);
+            stats.run_ms.push_back(run_ms);
+            if (stats.queue_ms.size() > DAEMON_LATENCY_WINDOW) {
+                stats.queue_ms.pop_front();
+                stats.run_ms.pop_front();
+            }
+        }
+
+        job->reply.set_value(reply);
+    }
+}
+
+void Daemon::serve_client(ClientThread *p_client) {
+    std::string payload;
+    while (read_frame(p_client->fd, &payload)) {
+        std::string reply;
+        try {
+            reply = handle_request(split_request(payload));
+        } catch (const std::exception &e) {
+            reply = error_reply(e.what());
+        }
+
+        if (!write_frame(p_client->fd, reply))
+            break;
+    }
+
+    std::lock_guard lock(client_mutex);
+    close(p_client->fd);
+    p_client->done = true;
+}
+
+std::string Daemon::handle_request(const std::vector<std::string> &request) {
+    if (request.empty())
+        return error_reply("empty request.");
+
+    if (request[0] == "stats")
+        return get_stats();
+
+    if (request[0] == "run")
+        return submit(std::vector<std::string>(request.begin() + 1, request.end()));
+
+    return error_reply("unknown command, available: [run, stats]");
+}
+
+std::string Daemon::submit(const std::vector<std::string> &args) {
+    const auto job = std::make_shared<DaemonJob>();
+    std::ostringstream problems;
+    if (parse_args(args, &job->params, problems) == ARG_INVALID)
+        return error_reply(option_error(problems));
+
+    if (!job->params.trace_file.empty())
+        return error_reply("the trace is process wide, --trace is not supported by the daemon.");
+
+    if (job->params.engine == ENGINE_AUTO) {
+        job->params.engine = auto_engine;
+        if (validate_args(&job->params, problems) == ARG_INVALID)
+            return error_reply("no suitable GPU found, " + option_error(problems));
+    }
+
+    job->queued = DaemonClock::now();
+    std::future<std::string> reply = job->reply.get_future();
+    if (!queue.push(job))
+        return error_reply("the daemon is shutting down.");
+
+    return reply.get();
+}
+
+std::string Daemon::get_stats() {
+    std::lock_guard lock(stats.mutex);
+
+    const std::vector<double> queue_ms(stats.queue_ms.begin(), stats.queue_ms.end());
+    const std::vector<double> run_ms(stats.run_ms.begin(), stats.run_ms.end());
+
+    std::ostringstream record;
+    record << "{\"queue_depth\": " << queue.size();
+    record << ", \"queue_capacity\": " << queue.get_capacity();
+    record << ", \"workers\": " << worker_count;
+    record << ", \"running\": " << stats.running;
+    record << ", \"completed\": " << stats.completed;
+    record << ", \"failed\": " << stats.failed;
+    record << ", \"queue_ms\": {\"median\": " << percentile(queue_ms, 0.5) << ", \"p95\": "
+           << percentile(queue_ms, 0.95) << "}";
+    record << ", \"run_ms\": {\"median\": " << percentile(run_ms, 0.5) << ", \"p95\": " << percentile(run_ms, 0.95)
+           << "}}";
+    return record.str();
+}
+
+//
+// client
+//
+static int send_request(const std::string &socket_path, const std::vector<std::string> &request) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path is too long.");
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error("failed to connect to " + socket_path + ".");
+    }
+
+    std::string reply;
+    const bool ok = write_frame(fd, join_request(request)) && read_frame(fd, &reply);
+    close(fd);
+    if (!ok)
+        throw std::runtime_error("connection to the daemon was lost.");
+
+    std::cout << reply << std::endl;
+    return reply.find("\"status\": \"error\"") == std::string::npos ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Daemon *p_signal_daemon = nullptr;
+
+void handle_stop(int) {
+    if (p_signal_daemon != nullptr)
+        p_signal_daemon->stop();
+}
+
+void print_usage() {
+    std::cout << "Usage: gpu_mtv_daemon [options]" << std::endl;
+    std::cout << "       gpu_mtv_daemon [options] run <cli options>" << std::endl;
+    std::cout << "       gpu_mtv_daemon [options] stats" << std::endl;
+    std::cout << "Without a command it serves jobs, with one it sends the command to a running daemon." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -h               Display this help message." << std::endl;
+    std::cout << "  -s <socket>      Path of the unix domain socket, defaults to " << DAEMON_DEFAULT_SOCKET << "."
+              << std::endl;
+    std::cout << "  -q <jobs>        Jobs the queue holds before requests block, defaults to "
+              << DAEMON_DEFAULT_QUEUE_DEPTH << "." << std::endl;
+    std::cout << "  -w <workers>     Jobs in flight at once, their gpu parts run one after another." << std::endl;
+    std::cout << "                   Defaults to " << DAEMON_DEFAULT_WORKERS << "." << std::endl;
+    std::cout << "  -v               Print the progress of the jobs, muted by default." << std::endl;
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string socket_path = DAEMON_DEFAULT_SOCKET;
+    uint32_t queue_depth = DAEMON_DEFAULT_QUEUE_DEPTH;
+    uint32_t worker_count = DAEMON_DEFAULT_WORKERS;
+    bool verbose = false;
+    std::vector<std::string> request;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "run" || arg == "stats") {
+                request.assign(argv + i, argv + argc);
+                break;
+            }
+
+            if (arg == "-v") {
+                verbose = true;
+                continue;
+            }
+
+            if (arg == "-h" || i + 1 >= argc) {
+                print_usage();
+                return arg == "-h" ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
+            const std::string next_arg = argv[++i];
+            if (arg == "-s") {
+                socket_path = next_arg;
+            } else if (arg == "-q") {
+                queue_depth = static_cast<uint32_t>(std::stoul(next_arg));
+            } else if (arg == "-w") {
+                worker_count = static_cast<uint32_t>(std::stoul(next_arg));
+            } else {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (queue_depth == 0 || worker_count == 0) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (!request.empty())
+            return send_request(socket_path, request);
+
+        Daemon daemon(socket_path, queue_depth, worker_count, verbose);
+        p_signal_daemon = &daemon;
+        std::signal(SIGINT, handle_stop);
+        std::signal(SIGTERM, handle_stop);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        daemon.serve();
+        p_signal_daemon = nullptr;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// the hash engine stores the morton code of every occupied voxel in an open-addressing hash table instead of a
+// dense render target, so memory scales with the surface area of the mesh instead of the volume.
+
+// occupied voxels of the surface shell, from the surface area of the mesh in voxel units
+double App::estimate_surface_voxels() const {
+    if (max_component(dim) <= 0.f)
+        return 0.0;
+
+    const double scale = static_cast<double>(params.chunk_res) / max_component(dim);
+    double area = 0.0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3 a = vertices[indices[i + 0]].pos;
+        const glm::vec3 b = vertices[indices[i + 1]].pos;
+        const glm::vec3 c = vertices[indices[i + 2]].pos;
+        area += 0.5 * static_cast<double>(glm::length(glm::cross(b - a, c - a)));
+    }
+
+    const double est_voxels = area * scale * scale * HASH_SURFACE_FACTOR;
+    return std::min(est_voxels, std::pow(static_cast<double>(params.chunk_res), 3));
+}
+
+uint32_t App::estimate_hash_capacity() const {
+    if (params.hash_capacity != 0)
+        return next_pow2(std::clamp(params.hash_capacity, HASH_MIN_CAPACITY, 1u << 31));
+
+    const double est_voxels = estimate_surface_voxels();
+
+    // keep load factor at or below 0.5
+    const double slots = std::clamp(2.0 * est_voxels, static_cast<double>(HASH_MIN_CAPACITY),
+                                    static_cast<double>(1u << 31));
+
+    return next_pow2(static_cast<uint32_t>(slots));
+}
+
+void App::create_hash_bufs() {
+    const uint32_t capacity = estimate_hash_capacity();
+    *p_log << "hash table capacity: " << capacity << " slots." << std::endl;
+
+    const VkDeviceSize keys_size = static_cast<VkDeviceSize>(capacity) * sizeof(uint64_t);
+
+    hash_buf = create_buf(keys_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    vox_list_buf = create_buf(keys_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VCW_HashInfo hash_info{};
+    hash_info.capacity = capacity;
+
+    VCW_Buffer staging_buf = create_buf(sizeof(VCW_HashInfo), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    cp_data_to_buf(&staging_buf, &hash_info);
+
+    hash_info_buf = create_buf(sizeof(VCW_HashInfo), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    cp_buf(staging_buf, hash_info_buf);
+
+    clean_up_buf(staging_buf);
+}
+
+void App::create_hash_pipes() {
+    hash_compact_pipe = create_comp_pipe("hash_compact.comp",
+                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER}, 0);
+    write_comp_buf_binding(hash_compact_pipe, hash_buf, 0);
+    write_comp_buf_binding(hash_compact_pipe, hash_info_buf, 1);
+    write_comp_buf_binding(hash_compact_pipe, vox_list_buf, 2);
+
+    sort_pipe = create_comp_pipe("bitonic_sort.comp", {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER},
+                                 sizeof(VCW_SortPushConstants));
+    write_comp_buf_binding(sort_pipe, vox_list_buf, 0);
+}
+
+// moves all occupied slots of the hash table to the front of vox_list_buf, the tail keeps HASH_EMPTY_KEY
+void App::record_hash_compact(VkCommandBuffer cmd_buf) {
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    const uint32_t slot_count = static_cast<uint32_t>(hash_buf.size / sizeof(uint64_t));
+    const uint32_t group_count = std::min(div_ceil(slot_count, COMP_LOCAL_SIZE),
+                                          phy_dev_props.limits.maxComputeWorkGroupCount[0]);
+    dispatch_comp(cmd_buf, hash_compact_pipe, group_count);
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+// bitonic sort of the first next_pow2(count) keys, padding keys are HASH_EMPTY_KEY and end up at the back
+void App::sort_vox_list(const uint32_t count) {
+    TRACE_SCOPE(__func__);
+    const uint32_t n = next_pow2(count);
+    if (n < 2)
+        return;
+
+    const uint32_t group_count = std::min(div_ceil(n, COMP_LOCAL_SIZE),
+                                          phy_dev_props.limits.maxComputeWorkGroupCount[0]);
+
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+
+    VCW_SortPushConstants sort_const{};
+    sort_const.n = n;
+    for (uint32_t k = 2; k <= n; k <<= 1) {
+        for (uint32_t j = k >> 1; j > 0; j >>= 1) {
+            sort_const.j = j;
+            sort_const.k = k;
+            dispatch_comp(cmd_buf, sort_pipe, group_count, 1, 1, &sort_const);
+            comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+    }
+
+    end_single_time_cmd(cmd_buf);
+}
+
+void App::comp_vox_list() {
+    *p_log << std::endl << "--- Voxelization ---" << std::endl;
+    chunk_module.init(min_vert_coord, max_vert_coord, static_cast<float>(params.chunk_res));
+
+    *p_log << "render extent: " << render_extent.width << "x" << render_extent.height << std::endl;
+    //
+    // rendering / voxelization / compaction
+    //
+    auto start_time = std::chrono::high_resolution_clock::now();
+    render();
+    vkQueueWaitIdle(q_graph);
+    trace_gpu_queries("voxelize", QUERY_VOX_BEGIN, QUERY_VOX_END);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    stage_times.voxelize = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    VCW_Buffer info_transfer_buf = create_buf(sizeof(VCW_HashInfo), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    cp_buf(hash_info_buf, info_transfer_buf);
+
+    VCW_HashInfo hash_info{};
+    cp_data_from_buf(&info_transfer_buf, &hash_info);
+    clean_up_buf(info_transfer_buf);
+
+    if (hash_info.overflow > 0)
+        throw std::runtime_error("hash table overflow, increase the capacity with -hc.");
+
+    // only the count of the stats is known without a grid
+    vox_stats.vox_count = hash_info.count;
+    //
+    // sorting by morton code
+    //
+    start_time = std::chrono::high_resolution_clock::now();
+    sort_vox_list(hash_info.count);
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.morton = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    //
+    // copying only the occupied voxels
+    //
+    start_time = std::chrono::high_resolution_clock::now();
+    std::vector<uint64_t> vox_list(hash_info.count);
+
+    if (hash_info.count > 0) {
+        VCW_Buffer list_transfer_buf = create_buf(hash_info.count * sizeof(uint64_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkCommandBuffer cmd_buf = begin_single_time_cmd();
+        VkBufferCopy cp_region{};
+        cp_region.size = list_transfer_buf.size;
+        vkCmdCopyBuffer(cmd_buf, vox_list_buf.buf, list_transfer_buf.buf, 1, &cp_region);
+        end_single_time_cmd(cmd_buf);
+
+        cp_data_from_buf(&list_transfer_buf, vox_list.data());
+        clean_up_buf(list_transfer_buf);
+    }
+
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.readback = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    // only the write follows, it overlaps with the next job of the daemon on the device
+    release_dev();
+    //
+    // writing data
+    //
+    start_time = std::chrono::high_resolution_clock::now();
+
+    VoxelListHeader header{};
+    header.chunk_res = params.chunk_res;
+    header.vox_count = hash_info.count;
+
+    if (params.list_sink) {
+        params.list_sink(vox_list.data(), vox_list.size());
+    } else {
+        TRACE_SCOPE("write_vox_list");
+        FileWriter &writer = open_writer(params.output_file);
+        writer.write(&header, sizeof(VoxelListHeader));
+        writer.write_owned(std::move(vox_list));
+        finish_writers();
+    }
+
+    end_time = std::chrono::high_resolution_clock::now();
+    stage_times.write = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+    *p_log << std::endl << "--- Results ---" << std::endl;
+    *p_log << "voxelization time: " << stage_times.voxelize << "ms (" << batch_count << " draw batches)"
+           << std::endl;
+    *p_log << "sort time: " << stage_times.morton << "ms" << std::endl;
+    *p_log << "copy time: " << stage_times.readback << "ms" << std::endl;
+    *p_log << "write time: " << stage_times.write << "ms" << std::endl;
+    *p_log << "write throughput: " << get_write_throughput() << "MiB/s" << std::endl;
+    *p_log << "voxel count: " << hash_info.count << std::endl;
+}
+
+void App::clean_up_hash() {
+    clean_up_comp_pipe(hash_compact_pipe);
+    clean_up_comp_pipe(sort_pipe);
+
+    clean_up_buf(hash_buf);
+    clean_up_buf(hash_info_buf);
+    clean_up_buf(vox_list_buf);
+}
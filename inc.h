@@ -32,5 +32,12 @@
 #include <cmath>
 #include <string>
 #include <filesystem>
+#include <bit>
+#include <numeric>
+#include <future>
+#include <atomic>
+#include <csignal>
+#include <thread>
+#include <mutex>
 
 #include "vss.h"
\ No newline at end of file
@@ -0,0 +1,122 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+#include "vss/include/bvox.h"
+
+// lod pyramid: every coarser level is reduced from the previous one by lod_reduce.comp, only the top level is ever
+// voxelized at full resolution. each level is written to its own bvox file next to the output file.
+
+void App::create_lod_targets() {
+    // every level reduces the one above it with the same pipeline, in its own descriptor set
+    lod_pipe = create_comp_pipe("lod_reduce.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+                                0, {}, params.lod_levels);
+
+    uint32_t res = params.chunk_res;
+    for (uint32_t level = 1; level <= params.lod_levels; level++) {
+        res /= 2;
+
+        const VkExtent3D extent = {res, res, res};
+        VCW_Image lod_img = create_img(extent, VK_FORMAT_R8_UINT,
+                                       VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+        create_img_view(&lod_img, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+
+        write_comp_img_binding(lod_pipe, level == 1 ? render_target : lod_imgs.back(), 0, level - 1);
+        write_comp_img_binding(lod_pipe, lod_img, 1, level - 1);
+
+        lod_imgs.push_back(lod_img);
+    }
+}
+
+std::string App::get_lod_file(const uint32_t level) const {
+    std::filesystem::path path(params.output_file);
+    path.replace_filename(path.stem().string() + "_lod" + std::to_string(level) + path.extension().string());
+    return path.string();
+}
+
+// has to be called after the top level was read back, the levels are kept on the host for write_lod_levels
+void App::read_lod_levels() {
+    TRACE_SCOPE(__func__);
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    for (size_t i = 0; i < lod_imgs.size(); i++) {
+        const uint32_t res = lod_imgs[i].extent.width;
+
+        transition_img_layout(cmd_buf, &lod_imgs[i], VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        dispatch_comp(cmd_buf, lod_pipe, div_ceil(res, 8), div_ceil(res, 8), div_ceil(res, 4), nullptr,
+                      static_cast<uint32_t>(i));
+        comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    // all levels together are at most 1/7 of the top level
+    std::vector<VCW_Buffer> level_bufs;
+    for (auto &lod_img: lod_imgs) {
+        const VkExtent3D extent = lod_img.extent;
+        level_bufs.push_back(create_buf(static_cast<VkDeviceSize>(extent.width) * extent.height * extent.depth,
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+        transition_img_layout(cmd_buf, &lod_img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        cp_img_to_buf(cmd_buf, lod_img, level_bufs.back(), extent);
+    }
+
+    end_single_time_cmd(cmd_buf);
+
+    lod_grids.resize(level_bufs.size());
+    for (size_t i = 0; i < level_bufs.size(); i++) {
+        lod_grids[i].resize(level_bufs[i].size);
+        cp_data_from_buf(&level_bufs[i], lod_grids[i].data());
+        clean_up_buf(level_bufs[i]);
+    }
+}
+
+void App::write_lod_levels() {
+    TRACE_SCOPE(__func__);
+    uint32_t res = params.chunk_res;
+    for (size_t i = 0; i < lod_grids.size(); i++) {
+        res /= 2;
+        const uint64_t size = static_cast<uint64_t>(res) * res * res;
+        std::vector<uint8_t> &grid = lod_grids[i];
+
+        const std::string file = get_lod_file(static_cast<uint32_t>(i) + 1);
+        if (params.morton_encode)
+            morton_order_grid(grid.data(), res);
+
+        if (params.chunk_codec != CODEC_NONE) {
+            write_cvox(file, grid.data(), res);
+        } else {
+            BvoxHeader header{};
+            header.chunk_res = res;
+            header.chunk_size = static_cast<uint32_t>(size);
+            header.run_length_encoded = params.run_length_encode;
+            header.morton_encoded = params.morton_encode;
+
+            // the run length stream belongs to vss, a plain level is the header and the grid in the background
+            if (params.run_length_encode) {
+                write_empty_bvox(file, header);
+                append_to_bvox(file, grid);
+            } else {
+                FileWriter &writer = open_writer(file);
+                writer.write(&header, sizeof(BvoxHeader));
+                writer.write_owned(std::move(grid));
+            }
+        }
+
+        *p_log << "lod " << i + 1 << ": " << res << "^3 written to " << file << std::endl;
+    }
+}
+
+void App::clean_up_lod_targets() const {
+    clean_up_comp_pipe(lod_pipe);
+
+    for (const auto &lod_img: lod_imgs)
+        clean_up_img(lod_img);
+}
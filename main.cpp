@@ -2,10 +2,7 @@
 // Created by Ludw on 4/25/2024.
 //
 #include "app.h"
-
-#define ARG_VALID EXIT_SUCCESS
-#define ARG_INVALID EXIT_FAILURE
-#define NEXT_ARG_USED 2
+#include "args.h"
 
 void print_usage() {
     std::cout << "Usage: gpu_mtv [options] -i <input_file> -o <output_file>" << std::endl;
@@ -14,106 +11,47 @@ void print_usage() {
     std::cout << "  -r <resolution>  Set resolution of voxel grid." << std::endl;
     std::cout << "                   Defaults to 256 cubic." << std::endl;
     std::cout << "  -m               Morton encode the output." << std::endl;
-    std::cout << "  -c <method>      Compression method, available: [rle]" << std::endl;
+    std::cout << "  -c <method>      Compression method, available: [rle, chunk-rle, chunk-mask]" << std::endl;
+    std::cout << "                   chunk-* write a .cvox grid of independently compressed chunks with an index,"
+              << std::endl;
+    std::cout << "                   chunk-mask stores occupancy masks and is faster on sparse grids." << std::endl;
     std::cout << "  -z <path>        Specify folder with the materials. (the corresponding .mtl file)" << std::endl;
     std::cout << "                   Defaults to the directory of the .obj file." << std::endl;
     std::cout << "  -s <file>        Additionally generate sparse voxel octree." << std::endl;
     std::cout << "  -d <depth>       Specify max depth for the svo." << std::endl;
     std::cout << "                   Defaults to a depth of " << DEFAULT_MAX_DEPTH << "." << std::endl;
+    std::cout << "  -e <engine>      Voxelization engine, available: [dense, hash, cpu, auto]" << std::endl;
+    std::cout << "                   hash writes a sorted list of occupied morton codes instead of a grid." << std::endl;
+    std::cout << "                   Defaults to dense." << std::endl;
+    std::cout << "  -f               Read back the full grid instead of only the occupied bricks." << std::endl;
+    std::cout << "  -hc <slots>      Hash table capacity of the hash engine." << std::endl;
+    std::cout << "                   Defaults to an estimate from the surface area of the mesh." << std::endl;
+    std::cout << "  -fill <axes>     Fill the interior of the mesh, available: [1, 3]" << std::endl;
+    std::cout << "                   3 takes a majority vote of all axes, for meshes that are not watertight." << std::endl;
+    std::cout << "  -a <file>        Additionally write color, normal and material of every occupied voxel." << std::endl;
+    std::cout << "  -t               Sample voxel colors from the diffuse textures of the materials, requires -a." << std::endl;
+    std::cout << "  -p <file>        Quantize voxel colors to a palette of " << PALETTE_MAX_COLORS
+              << " colors, requires -a." << std::endl;
+    std::cout << "                   The grid stores palette index + 1, the palette is written to <file>." << std::endl;
+    std::cout << "  -lod <levels>    Additionally write <levels> coarser grids, each at half the resolution." << std::endl;
+    std::cout << "                   Written next to the output file as <name>_lod<level>.<ext>." << std::endl;
+    std::cout << "  -sdf <file>      Additionally write a distance field, signed together with -fill." << std::endl;
+    std::cout << "  -sdfq <bits>     Bits per distance value, available: [8, 16]" << std::endl;
+    std::cout << "  -ts              Sort triangles by the morton code of their centroid before rendering." << std::endl;
+    std::cout << "  -tc              Point splat triangles under one voxel and split ones longer than "
+              << TRI_SPLIT_VOXELS << " voxels." << std::endl;
+    std::cout << "  -vr              Renumber vertices in the order the triangles first use them." << std::endl;
+    std::cout << "  -b <triangles>   Triangles per draw batch, tuned from the measured throughput by default." << std::endl;
+    std::cout << "  -bt <ms>         Target time of a tuned draw batch, defaults to " << BATCH_DEFAULT_TIME_MS << "ms."
+              << std::endl;
+    std::cout << "  --trace <file>   Write a trace of the cpu and gpu timelines, opens in perfetto." << std::endl;
+    std::cout << "  --metrics <file> Append a json record with stage times, memory and sizes of the run to <file>."
+              << std::endl;
+    std::cout << "  --mem-limit <MiB> Cap host and device memory each, defaults to the free memory." << std::endl;
+    std::cout << "                   A surface grid too large for the device is voxelized in tiles." << std::endl;
+    std::cout << "  --devices <count> Devices to spread the tiles across, defaults to every suitable gpu." << std::endl;
+    std::cout << "                   More than there are gpus creates several logical devices on them." << std::endl;
     std::cout << std::endl;
-    std::cout << "Currently unsupported, will be added later." << std::endl;
-    std::cout << "  -t               Use textures and generate color palette." << std::endl;
-    std::cout << std::endl;
-}
-
-int string_to_int(std::string &string, uint32_t *p_int) {
-    try {
-        *p_int = static_cast<uint32_t>(std::stoul(string));
-        return EXIT_SUCCESS;
-    } catch (const std::exception &e) {
-        std::cerr << std::endl << e.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-}
-
-int evaluate_args(std::string &arg, std::string &next_arg, VoxelizeParams *p_params) {
-    if (arg == "-h") {
-        return ARG_INVALID;
-    } else if (arg == "-r") {
-        return string_to_int(next_arg, &p_params->chunk_res) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
-    } else if (arg == "-m") {
-        p_params->morton_encode = true;
-        return ARG_VALID;
-    } else if (arg == "-c") {
-        if (next_arg == "rle") {
-            p_params->run_length_encode = true;
-            return NEXT_ARG_USED;
-        } else {
-            return ARG_INVALID;
-        }
-    } else if (arg == "-z") {
-        std::filesystem::path path(next_arg);
-        if (std::filesystem::exists(path)) {
-            if (std::filesystem::is_directory(path)) {
-                p_params->material_dir = next_arg;
-                return NEXT_ARG_USED;
-            } else {
-                std::cerr << std::endl << "specified material dir is not a directory." << std::endl;
-                return ARG_INVALID;
-            }
-        } else {
-            std::cerr << std::endl << "specified material dir does not exist." << std::endl;
-            return ARG_INVALID;
-        }
-    } else if (arg == "-i") {
-        std::filesystem::path path(next_arg);
-
-        if (std::filesystem::exists(path)) {
-            if (path.extension() == ".obj") {
-                if (p_params->material_dir == "")
-                    p_params->material_dir = path.parent_path().string();
-
-                p_params->input_file = next_arg;
-                return NEXT_ARG_USED;
-            } else {
-                std::cerr << std::endl << "input file must be an .obj file." << std::endl;
-                return ARG_INVALID;
-            }
-        } else {
-            std::cerr << std::endl << "specified input file does not exist." << std::endl;
-            return ARG_INVALID;
-        }
-    } else if (arg == "-o") {
-        p_params->output_file = next_arg;
-        return NEXT_ARG_USED;
-    } else if (arg == "-s") {
-        p_params->generate_svo = true;
-        p_params->svo_file = next_arg;
-        return NEXT_ARG_USED;
-    } else if (arg == "-d") {
-        return string_to_int(next_arg, &p_params->max_depth) == EXIT_SUCCESS ? NEXT_ARG_USED : ARG_INVALID;
-    } else {
-        return ARG_INVALID;
-    }
-}
-
-int validate_args(VoxelizeParams *p_params) {
-    if (p_params->input_file == "") {
-        std::cerr << std::endl << "no input file specified." << std::endl;
-        return ARG_INVALID;
-    }
-
-    if (p_params->material_dir == "") {
-        std::cerr << std::endl << "no material directory specified." << std::endl;
-        return ARG_INVALID;
-    }
-
-    if (p_params->output_file == "") {
-        std::cerr << std::endl << "no output file specified." << std::endl;
-        return ARG_INVALID;
-    }
-
-    return ARG_VALID;
 }
 
 void print_params(VoxelizeParams p_params) {
@@ -128,41 +66,55 @@ void print_params(VoxelizeParams p_params) {
 
     std::cout << "morton encode: " << p_params.morton_encode << std::endl;
     std::cout << "run length encode: " << p_params.run_length_encode << std::endl;
+    std::cout << "chunk codec: " << p_params.chunk_codec << std::endl;
 
     std::cout << "generate svo: " << p_params.generate_svo << std::endl;
     std::cout << "svo file: " << p_params.svo_file << std::endl;
-}
 
-int main(int argc, char *argv[]) {
-    VoxelizeParams params{};
-    for (int i = 1; i < argc; i++) {
-        std::string arg = std::string(argv[i]);
-        std::string next_arg = std::string(argv[i + 1]);
+    constexpr const char *engine_names[] = {"dense", "hash", "cpu", "auto"};
+    std::cout << "engine: " << engine_names[p_params.engine] << std::endl;
+    std::cout << "full readback: " << p_params.full_readback << std::endl;
+    std::cout << "solid axes: " << p_params.solid_axes << std::endl;
 
-        int result = evaluate_args(arg, next_arg, &params);
+    std::cout << "write attributes: " << p_params.write_attributes << std::endl;
+    std::cout << "attribute file: " << p_params.attrib_file << std::endl;
+    std::cout << "use textures: " << p_params.use_textures << std::endl;
 
-        if (result == ARG_INVALID) {
-            print_usage();
-            return EXIT_FAILURE;
-        }
+    std::cout << "palette: " << p_params.palette << std::endl;
+    std::cout << "palette file: " << p_params.palette_file << std::endl;
 
-        if (result == NEXT_ARG_USED)
-            i++;
+    std::cout << "lod levels: " << p_params.lod_levels << std::endl;
 
-        if (i == (argc - 2) && result != NEXT_ARG_USED) {
-            std::cerr << std::endl << "invalid arguments" << std::endl;
-            print_usage();
-            return EXIT_FAILURE;
-        }
-    }
+    std::cout << "generate sdf: " << p_params.generate_sdf << std::endl;
+    std::cout << "sdf file: " << p_params.sdf_file << std::endl;
+    std::cout << "sdf bits: " << p_params.sdf_bits << std::endl;
+
+    std::cout << "sort triangles: " << p_params.sort_tris << std::endl;
+    std::cout << "classify triangles: " << p_params.classify_tris << std::endl;
+    std::cout << "reorder vertices: " << p_params.reorder_verts << std::endl;
+
+    std::cout << "batch triangles: " << (p_params.batch_tris > 0 ? std::to_string(p_params.batch_tris) : "auto")
+              << std::endl;
+    std::cout << "batch time: " << p_params.batch_time_ms << "ms" << std::endl;
 
-    if (params.chunk_res == 0)
-        params.chunk_res = 256;
-    params.chunk_size = static_cast<uint32_t>(pow(params.chunk_res, 3));
-    if (params.max_depth == 0)
-        params.max_depth = DEFAULT_MAX_DEPTH;
+    std::cout << "metrics file: " << p_params.metrics_file << std::endl;
+    std::cout << "trace file: " << p_params.trace_file << std::endl;
+    std::cout << "memory limit: " << (p_params.mem_limit_mib > 0 ? std::to_string(p_params.mem_limit_mib) + " MiB" :
+                                      "free memory") << std::endl;
+    std::cout << "devices: " << (p_params.dev_count > 0 ? std::to_string(p_params.dev_count) : "all") << std::endl;
+}
+
+// ctrl+c stops the voxelization after the current draw batch
+static App *p_signal_app = nullptr;
 
-    if (validate_args(&params) == ARG_INVALID) {
+void handle_interrupt(int) {
+    if (p_signal_app != nullptr)
+        p_signal_app->abort_requested = true;
+}
+
+int main(int argc, char *argv[]) {
+    VoxelizeParams params{};
+    if (parse_args(std::vector<std::string>(argv + 1, argv + argc), &params) == ARG_INVALID) {
         print_usage();
         return EXIT_FAILURE;
     }
@@ -177,12 +129,27 @@ int main(int argc, char *argv[]) {
     App app{};
     app.params = params;
 
+    p_signal_app = &app;
+    std::signal(SIGINT, handle_interrupt);
+
+    if (!params.trace_file.empty())
+        trace_begin();
+
+    // the trace is also written for a failed run, that is when it is needed most
+    int result = EXIT_SUCCESS;
     try {
         app.run();
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
-        return EXIT_FAILURE;
+        result = EXIT_FAILURE;
+    }
+
+    try {
+        trace_end(params.trace_file);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        result = EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    return result;
 }
\ No newline at end of file
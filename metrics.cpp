@@ -0,0 +1,80 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// metrics report: one json object per run is appended as a single line to the metrics file, so that runs of a whole
+// fleet can be concatenated and aggregated line by line.
+
+void App::write_metrics() const {
+    const bool cpu = params.engine == ENGINE_CPU;
+    constexpr const char *engine_names[] = {"dense", "hash", "cpu", "auto"};
+
+    uint64_t output_bytes = 0;
+    if (std::filesystem::exists(params.output_file))
+        output_bytes = std::filesystem::file_size(params.output_file);
+
+    // the uncompressed dense grid the output stands in for
+    const uint64_t raw_bytes = params.chunk_size;
+
+    const auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::ostringstream record;
+    record << "{";
+    record << "\"timestamp\": " << timestamp;
+    record << ", \"input_file\": \"" << json_escape(params.input_file) << "\"";
+    record << ", \"output_file\": \"" << json_escape(params.output_file) << "\"";
+    record << ", \"engine\": \"" << engine_names[params.engine] << "\"";
+    record << ", \"resolution\": " << params.chunk_res;
+    record << ", \"tiles\": " << tile_count;
+    record << ", \"devices\": " << (cpu ? 0 : tile_dev_count);
+
+    if (cpu) {
+        record << ", \"device\": null, \"driver_version\": null, \"api_version\": null";
+    } else {
+        record << ", \"device\": \"" << json_escape(phy_dev_props.deviceName) << "\"";
+        record << ", \"driver_version\": " << phy_dev_props.driverVersion;
+        record << ", \"api_version\": \"" << VK_API_VERSION_MAJOR(phy_dev_props.apiVersion) << "."
+               << VK_API_VERSION_MINOR(phy_dev_props.apiVersion) << "."
+               << VK_API_VERSION_PATCH(phy_dev_props.apiVersion) << "\"";
+    }
+
+    record << ", \"stages_ms\": {";
+    record << "\"parse\": " << stage_times.parse;
+    record << ", \"dedup\": " << stage_times.dedup;
+    record << ", \"reorder\": " << stage_times.reorder;
+    record << ", \"init\": " << stage_times.init;
+    record << ", \"upload\": " << stage_times.upload;
+    record << ", \"voxelize\": " << stage_times.voxelize;
+    record << ", \"palette\": " << stage_times.palette;
+    record << ", \"readback\": " << stage_times.readback;
+    record << ", \"sdf\": " << stage_times.sdf;
+    record << ", \"morton\": " << stage_times.morton;
+    record << ", \"svo\": " << stage_times.svo;
+    record << ", \"write\": " << stage_times.write;
+    record << ", \"lod\": " << stage_times.lod;
+    record << "}";
+
+    record << ", \"triangles\": " << raster_tri_count + splat_tri_count;
+    record << ", \"vertices\": " << vertices.size();
+    record << ", \"voxels\": " << vox_stats.vox_count;
+
+    record << ", \"peak_rss_bytes\": " << get_peak_rss();
+    record << ", \"device_mem_allocated_bytes\": " << dev_mem_allocated;
+    record << ", \"device_mem_peak_bytes\": " << dev_mem_peak;
+    record << ", \"readback_bytes\": " << readback_bytes;
+    record << ", \"written_bytes\": " << written_bytes;
+    record << ", \"write_busy_ms\": " << write_busy_ms;
+    record << ", \"write_mib_per_s\": " << get_write_throughput();
+
+    record << ", \"raw_bytes\": " << raw_bytes;
+    record << ", \"output_bytes\": " << output_bytes;
+    record << ", \"compression_ratio\": "
+           << (output_bytes > 0 ? static_cast<double>(raw_bytes) / static_cast<double>(output_bytes) : 0.0);
+    record << "}\n";
+
+    const std::string line = record.str();
+    append_to_file(params.metrics_file, line.data(), static_cast<std::streamsize>(line.size()));
+}
@@ -0,0 +1,72 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "morton.h"
+
+#include <algorithm>
+#include <bit>
+
+uint64_t spread_by_3(const uint32_t a) {
+    uint64_t x = a & 0x1fffffull;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+uint32_t compact_by_3(uint64_t x) {
+    x &= 0x1249249249249249ull;
+    x = (x | x >> 2) & 0x10c30c30c30c30c3ull;
+    x = (x | x >> 4) & 0x100f00f00f00f00full;
+    x = (x | x >> 8) & 0x1f0000ff0000ffull;
+    x = (x | x >> 16) & 0x1f00000000ffffull;
+    x = (x | x >> 32) & 0x1fffffull;
+    return static_cast<uint32_t>(x);
+}
+
+// voxels of the lower and the upper half of a node at origin that lie inside the grid, along one axis
+static void clip_halves(const uint32_t origin, const uint32_t half, const uint32_t res, uint64_t *p_lower,
+                        uint64_t *p_upper) {
+    *p_lower = origin >= res ? 0 : std::min(half, res - origin);
+    *p_upper = origin + half >= res ? 0 : std::min(half, res - origin - half);
+}
+
+// position of voxel (x, y, z) in the morton order of a res^3 grid, codes outside of the grid are skipped like
+// morton_encode_3d_grid does. nodes that lie inside the grid are numbered by their morton code directly, only the ones
+// cut by the border are descended.
+uint64_t morton_rank(const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t res) {
+    uint64_t rank = 0;
+    uint32_t x0 = 0, y0 = 0, z0 = 0;
+
+    for (uint32_t size = std::bit_ceil(res); size > 1; size /= 2) {
+        if (x0 + size <= res && y0 + size <= res && z0 + size <= res)
+            return rank + (spread_by_3(x - x0) | spread_by_3(y - y0) << 1 | spread_by_3(z - z0) << 2);
+
+        const uint32_t half = size / 2;
+        const bool cx = x - x0 >= half;
+        const bool cy = y - y0 >= half;
+        const bool cz = z - z0 >= half;
+
+        uint64_t lx, ux, ly, uy, lz, uz;
+        clip_halves(x0, half, res, &lx, &ux);
+        clip_halves(y0, half, res, &ly, &uy);
+        clip_halves(z0, half, res, &lz, &uz);
+
+        // the octants in front of the one of the voxel, z is the most significant bit of the octant
+        if (cz)
+            rank += lz * (ly + uy) * (lx + ux);
+        if (cy)
+            rank += (cz ? uz : lz) * ly * (lx + ux);
+        if (cx)
+            rank += (cz ? uz : lz) * (cy ? uy : ly) * lx;
+
+        x0 += cx ? half : 0;
+        y0 += cy ? half : 0;
+        z0 += cz ? half : 0;
+    }
+
+    return rank;
+}
@@ -0,0 +1,20 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include <cstdint>
+
+#ifndef VCW_MORTON_H
+#define VCW_MORTON_H
+
+// morton order of the output grids, without vulkan so that the reader library can share it
+
+// spreads the lower 21 bits of a, so that there are two zero bits between each bit
+uint64_t spread_by_3(uint32_t a);
+
+// removes the two zero bits between each bit, inverse of spread_by_3 and of its copy in shader.frag
+uint32_t compact_by_3(uint64_t x);
+
+uint64_t morton_rank(uint32_t x, uint32_t y, uint32_t z, uint32_t res);
+
+#endif //VCW_MORTON_H
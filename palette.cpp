@@ -0,0 +1,196 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// color quantization: palette_hist.comp counts the averaged voxel colors in 15 bit buckets, the host runs median cut
+// over the small histogram and palette_remap.comp replaces every voxel with its palette index before readback. the
+// full resolution color grid never leaves the device.
+
+struct ColorBox {
+    std::vector<uint32_t> buckets;
+    uint64_t count;
+};
+
+static uint32_t bucket_channel(const uint32_t bucket, const uint32_t channel) {
+    return (bucket >> (5 * channel)) & 0x1F;
+}
+
+void App::create_palette_resources() {
+    const VkDeviceSize size = PALETTE_BUCKET_COUNT * sizeof(uint32_t);
+
+    hist_buf = create_buf(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    hist_transfer_buf = create_buf(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    palette_lut_buf = create_buf(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    palette_hist_pipe = create_comp_pipe("palette_hist.comp",
+                                         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER}, 0);
+    write_comp_img_binding(palette_hist_pipe, render_target, 0);
+    write_comp_img_binding(palette_hist_pipe, color_target, 1);
+    write_comp_buf_binding(palette_hist_pipe, hist_buf, 2);
+
+    palette_remap_pipe = create_comp_pipe("palette_remap.comp",
+                                          {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER}, 0);
+    write_comp_img_binding(palette_remap_pipe, render_target, 0);
+    write_comp_img_binding(palette_remap_pipe, color_target, 1);
+    write_comp_buf_binding(palette_remap_pipe, palette_lut_buf, 2);
+}
+
+// has to be recorded after rendering, copies the histogram to hist_transfer_buf
+void App::record_palette_histogram(VkCommandBuffer cmd_buf) {
+    vkCmdFillBuffer(cmd_buf, hist_buf.buf, 0, hist_buf.size, 0);
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    const uint32_t group_count = div_ceil(params.chunk_res, 8);
+    dispatch_comp(cmd_buf, palette_hist_pipe, group_count, group_count, div_ceil(params.chunk_res, 4));
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkBufferCopy cp_region{};
+    cp_region.size = hist_buf.size;
+    vkCmdCopyBuffer(cmd_buf, hist_buf.buf, hist_transfer_buf.buf, 1, &cp_region);
+}
+
+// median cut over the non empty buckets, uploads the bucket to palette index lookup table
+void App::build_palette() {
+    TRACE_SCOPE(__func__);
+    std::vector<uint32_t> hist(PALETTE_BUCKET_COUNT);
+    cp_data_from_buf(&hist_transfer_buf, hist.data());
+
+    std::vector<ColorBox> boxes(1);
+    for (uint32_t bucket = 0; bucket < PALETTE_BUCKET_COUNT; bucket++) {
+        if (hist[bucket] == 0)
+            continue;
+        boxes[0].buckets.push_back(bucket);
+        boxes[0].count += hist[bucket];
+    }
+
+    if (boxes[0].buckets.empty())
+        boxes.clear();
+
+    while (boxes.size() < PALETTE_MAX_COLORS) {
+        // most populated box that still holds more than one bucket
+        auto split = boxes.end();
+        for (auto it = boxes.begin(); it != boxes.end(); ++it)
+            if (it->buckets.size() > 1 && (split == boxes.end() || it->count > split->count))
+                split = it;
+
+        if (split == boxes.end())
+            break;
+
+        // longest channel
+        uint32_t axis = 0;
+        uint32_t max_range = 0;
+        for (uint32_t channel = 0; channel < 3; channel++) {
+            const auto [min_it, max_it] = std::minmax_element(
+                    split->buckets.begin(), split->buckets.end(), [channel](const uint32_t a, const uint32_t b) {
+                        return bucket_channel(a, channel) < bucket_channel(b, channel);
+                    });
+            const uint32_t range = bucket_channel(*max_it, channel) - bucket_channel(*min_it, channel);
+            if (range >= max_range) {
+                max_range = range;
+                axis = channel;
+            }
+        }
+
+        std::sort(split->buckets.begin(), split->buckets.end(), [axis](const uint32_t a, const uint32_t b) {
+            return bucket_channel(a, axis) < bucket_channel(b, axis);
+        });
+
+        // weighted median, both halves keep at least one bucket
+        uint64_t acc = 0;
+        size_t median = 1;
+        for (; median < split->buckets.size() - 1; median++) {
+            acc += hist[split->buckets[median - 1]];
+            if (2 * acc >= split->count)
+                break;
+        }
+
+        ColorBox upper{};
+        upper.buckets.assign(split->buckets.begin() + static_cast<std::ptrdiff_t>(median), split->buckets.end());
+        split->buckets.resize(median);
+
+        split->count = 0;
+        for (const uint32_t bucket: split->buckets)
+            split->count += hist[bucket];
+        for (const uint32_t bucket: upper.buckets)
+            upper.count += hist[bucket];
+
+        boxes.push_back(std::move(upper));
+    }
+
+    // weighted mean of every box, buckets are sampled at their center
+    std::vector<uint32_t> lut(PALETTE_BUCKET_COUNT, 0);
+    palette.clear();
+    for (uint32_t i = 0; i < boxes.size(); i++) {
+        glm::dvec3 sum(0.0);
+        for (const uint32_t bucket: boxes[i].buckets) {
+            const glm::dvec3 center(bucket_channel(bucket, 0) << 3 | 4, bucket_channel(bucket, 1) << 3 | 4,
+                                    bucket_channel(bucket, 2) << 3 | 4);
+            sum += center * static_cast<double>(hist[bucket]);
+            lut[bucket] = i;
+        }
+
+        const glm::uvec3 mean = glm::uvec3(glm::round(sum / static_cast<double>(boxes[i].count)));
+        palette.push_back(mean.r | mean.g << 8 | mean.b << 16 | 0xFFu << 24);
+    }
+
+    // voxels without color samples use the first entry, which has to exist
+    if (palette.empty())
+        palette.push_back(0xFFFFFFFF);
+
+    VCW_Buffer staging_buf = create_buf(palette_lut_buf.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    cp_data_to_buf(&staging_buf, lut.data());
+    cp_buf(staging_buf, palette_lut_buf);
+
+    clean_up_buf(staging_buf);
+}
+
+// replaces the occupancy with palette indices and reads the grid back
+void App::remap_palette() {
+    TRACE_SCOPE(__func__);
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    const uint32_t group_count = div_ceil(params.chunk_res, 8);
+    dispatch_comp(cmd_buf, palette_remap_pipe, group_count, group_count, div_ceil(params.chunk_res, 4));
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    record_grid_readback(cmd_buf);
+
+    end_single_time_cmd(cmd_buf);
+}
+
+void App::write_palette() const {
+    TRACE_SCOPE(__func__);
+    PaletteHeader header{};
+    header.color_count = static_cast<uint32_t>(palette.size());
+
+    write_file(params.palette_file, &header, sizeof(PaletteHeader));
+    append_to_file(params.palette_file, palette.data(),
+                   static_cast<std::streamsize>(palette.size() * sizeof(uint32_t)));
+}
+
+void App::clean_up_palette() const {
+    clean_up_comp_pipe(palette_hist_pipe);
+    clean_up_comp_pipe(palette_remap_pipe);
+
+    clean_up_buf(hist_buf);
+    clean_up_buf(hist_transfer_buf);
+    clean_up_buf(palette_lut_buf);
+}
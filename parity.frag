@@ -0,0 +1,24 @@
+#version 450
+
+layout (push_constant) uniform PushConstants {
+    mat4 view_proj;
+    uint axis;
+    uint slot;
+    uint res;
+    uint word_count;
+} pc;
+
+// crossing bits, packed 32 per texel along the projection axis, one slab of word_count texels per axis
+layout (set = 0, binding = 0, r32ui) uniform uimage3D parity;
+
+layout (location = 0) in float vs_depth;
+
+void main() {
+    // the crossing toggles the first voxel whose center lies behind it
+    int t = int(floor(vs_depth + 0.5));
+    if (t >= int(pc.res)) return;
+    t = max(t, 0);
+
+    ivec3 coord = ivec3(ivec2(gl_FragCoord.xy), int(pc.slot * pc.word_count) + (t >> 5));
+    imageAtomicXor(parity, coord, 1u << (t & 31));
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 450
+
+// projects the mesh along one axis without dilation, every pixel center is covered exactly once per surface crossing
+
+layout (push_constant) uniform PushConstants {
+    mat4 view_proj;
+    uint axis;
+    uint slot;
+    uint res;
+    uint word_count;
+} pc;
+
+layout (location = 0) in vec3 in_pos;
+
+layout (location = 0) out float vs_depth;
+
+void main() {
+    vec4 pos = pc.view_proj * vec4(in_pos, 1.0);
+
+    switch (pc.axis) {
+        case 0:  gl_Position = vec4(pos.yz, 0, pos.w);  vs_depth = pos.x;  break;
+        case 1:  gl_Position = vec4(pos.xz, 0, pos.w);  vs_depth = pos.y;  break;
+        default: gl_Position = vec4(pos.xy, 0, pos.w);  vs_depth = pos.z;  break;
+    }
+
+    // same mapping as the voxel address in shader.frag
+    vs_depth = (vs_depth * 0.5 + 0.5) * float(pc.res);
+}
\ No newline at end of file
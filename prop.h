@@ -18,6 +18,52 @@
 // set max allowed textures
 #define DESCRIPTOR_TEXTURE_COUNT 32
 
+// workgroup size of all 1d compute shaders, must match local_size_x
+#define COMP_LOCAL_SIZE 256
+
+// edge length of the bricks used for occupied-region readback
+#define BRICK_RES 16
+
+// number of distinct voxel values counted by stats.comp
+#define STATS_VALUE_COUNT 256
+
+// color quantization, 5 bit per channel buckets, index 0 of the grid stays empty
+#define PALETTE_BUCKET_COUNT (1u << 15)
+#define PALETTE_MAX_COLORS 255
+
+// jump flood seeds are packed with 10 bit per axis
+#define SDF_MAX_RES 1024
+// distances are quantized in [-chunk_res / SDF_RANGE_DIVISOR, chunk_res / SDF_RANGE_DIVISOR]
+#define SDF_RANGE_DIVISOR 4
+
+// smallest range of elements a radix sort thread is started for
+#define RADIX_MIN_RANGE (1u << 16)
+
+// triangles with a longer edge are split by the triangle classification
+#define TRI_SPLIT_VOXELS 64.0f
+
+// draw batching, the first batch is measured to tune the size of the following ones
+#define BATCH_INITIAL_TRIS (1u << 16)
+#define BATCH_MIN_TRIS (1u << 12)
+#define BATCH_DEFAULT_TIME_MS 20
+
+// hash engine, slots are 64 bit morton codes
+#define HASH_EMPTY_KEY 0xFFFFFFFFFFFFFFFFull
+#define HASH_MIN_CAPACITY (1u << 16)
+// expected occupied voxels per voxel of surface area, with conservative dilation
+#define HASH_SURFACE_FACTOR 4.f
+
+// share of the free memory the budget plans with, the rest is left for textures, pipelines and the driver
+#define MEM_BUDGET_HEADROOM 0.9
+// rough svo size per occupied surface voxel, nodes included
+#define SVO_BYTES_PER_VOXEL 8
+
+// output writer, staging blocks per file and the writes in flight at once, pwrite threads without io_uring
+#define WRITER_BLOCK_SIZE (4u << 20)
+#define WRITER_BLOCK_ALIGN 4096
+#define WRITER_QUEUE_DEPTH 8
+#define WRITER_THREADS 4
+
 const std::vector<const char *> val_layers = {
     "VK_LAYER_KHRONOS_validation"
 };
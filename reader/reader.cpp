@@ -0,0 +1,533 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t grid_index(const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t res,
+                           const bool morton) {
+    if (morton)
+        return morton_rank(x, y, z, res);
+    return (static_cast<uint64_t>(z) * res + y) * res + x;
+}
+
+static void check_region(const glm::uvec3 min, const glm::uvec3 extent, const uint32_t res) {
+    const glm::u64vec3 max = glm::u64vec3(min) + glm::u64vec3(extent);
+    if (max.x > res || max.y > res || max.z > res)
+        throw std::runtime_error("region is outside of the grid.");
+}
+
+// copies the box [min, min + extent) out of p_part, which holds the voxels from first on of a grid in file order
+static void gather_region(const uint8_t *p_part, const uint64_t first, const uint32_t res, const bool morton,
+                          const glm::uvec3 min, const glm::uvec3 extent, uint8_t *p_dst) {
+    const glm::uvec3 max = min + extent;
+
+    if (!morton) {
+        for (uint32_t z = min.z; z < max.z; z++) {
+            for (uint32_t y = min.y; y < max.y; y++) {
+                std::memcpy(p_dst, p_part + grid_index(min.x, y, z, res, false) - first, extent.x);
+                p_dst += extent.x;
+            }
+        }
+        return;
+    }
+
+    // the rank of a power of two grid is the morton code, the spread x of a row is reused for every row
+    if (std::has_single_bit(res)) {
+        std::vector<uint64_t> row_codes(extent.x);
+        for (uint32_t x = 0; x < extent.x; x++)
+            row_codes[x] = spread_by_3(min.x + x);
+
+        for (uint32_t z = min.z; z < max.z; z++) {
+            for (uint32_t y = min.y; y < max.y; y++) {
+                const uint64_t yz_code = spread_by_3(y) << 1 | spread_by_3(z) << 2;
+                for (const uint64_t x_code: row_codes)
+                    *p_dst++ = p_part[(yz_code | x_code) - first];
+            }
+        }
+        return;
+    }
+
+    for (uint32_t z = min.z; z < max.z; z++)
+        for (uint32_t y = min.y; y < max.y; y++)
+            for (uint32_t x = min.x; x < max.x; x++)
+                *p_dst++ = p_part[morton_rank(x, y, z, res) - first];
+}
+
+// a piece of a box whose voxels follow each other in the file, a row in linear order or a whole octree node of size^3
+// voxels in morton order
+struct RegionRun {
+    uint64_t first;
+    glm::uvec3 origin;
+    uint32_t size;
+};
+
+// the octree nodes below origin that are inside of the box [min, max), in morton order
+static void collect_node_runs(const glm::uvec3 origin, const uint32_t size, const uint32_t res, const glm::uvec3 min,
+                              const glm::uvec3 max, std::vector<RegionRun> *p_runs) {
+    bool inside = true;
+    for (int axis = 0; axis < 3; axis++) {
+        if (origin[axis] >= max[axis] || origin[axis] + size <= min[axis])
+            return;
+        inside &= origin[axis] >= min[axis] && origin[axis] + size <= max[axis];
+    }
+
+    // the box is inside of the grid, so the ranks of the node have no gaps
+    if (inside) {
+        p_runs->push_back({morton_rank(origin.x, origin.y, origin.z, res), origin, size});
+        return;
+    }
+
+    const uint32_t half = size / 2;
+    for (uint32_t child = 0; child < 8; child++) {
+        const glm::uvec3 offset(child & 1, child >> 1 & 1, child >> 2);
+        collect_node_runs(origin + offset * half, half, res, min, max, p_runs);
+    }
+}
+
+// the runs of the box [min, max), sorted by their position in the file
+static std::vector<RegionRun> get_region_runs(const uint32_t res, const bool morton, const glm::uvec3 min,
+                                              const glm::uvec3 max) {
+    std::vector<RegionRun> runs;
+    if (morton) {
+        collect_node_runs(glm::uvec3(0), std::bit_ceil(res), res, min, max, &runs);
+        return runs;
+    }
+
+    for (uint32_t z = min.z; z < max.z; z++)
+        for (uint32_t y = min.y; y < max.y; y++)
+            runs.push_back({grid_index(min.x, y, z, res, false), glm::uvec3(min.x, y, z), max.x - min.x});
+    return runs;
+}
+
+// func(i) for every i in [begin, end), the threads take the next index from a shared counter
+template<typename Func>
+static void parallel_for(const uint32_t begin, const uint32_t end, const uint32_t thread_count, Func func) {
+    std::atomic<uint32_t> next = begin;
+    auto work = [&] {
+        for (uint32_t i = next++; i < end; i = next++)
+            func(i);
+    };
+
+    std::vector<std::future<void>> tasks;
+    for (uint32_t thread = 1; thread < std::min(thread_count, end - begin); thread++)
+        tasks.push_back(std::async(std::launch::async, work));
+    work();
+
+    for (auto &task: tasks)
+        task.get();
+}
+
+MappedFile::MappedFile(const std::string &filename) {
+#ifdef _WIN32
+    file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        throw std::runtime_error("failed to open file.");
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size)) {
+        release();
+        throw std::runtime_error("failed to get file size.");
+    }
+    byte_count = static_cast<size_t>(file_size.QuadPart);
+    if (byte_count == 0)
+        return;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle)
+        p_data = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!p_data) {
+        release();
+        throw std::runtime_error("failed to map file.");
+    }
+#else
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("failed to open file.");
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to get file size.");
+    }
+    byte_count = static_cast<size_t>(file_stat.st_size);
+
+    // the mapping keeps the file referenced on its own
+    void *p_map = byte_count > 0 ? mmap(nullptr, byte_count, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (p_map == MAP_FAILED)
+        throw std::runtime_error("failed to map file.");
+    p_data = static_cast<const uint8_t*>(p_map);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        release();
+        std::swap(p_data, other.p_data);
+        std::swap(byte_count, other.byte_count);
+#ifdef _WIN32
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::advise_random() const {
+#ifndef _WIN32
+    if (p_data)
+        madvise(const_cast<uint8_t*>(p_data), byte_count, MADV_RANDOM);
+#endif
+}
+
+void MappedFile::release() {
+#ifdef _WIN32
+    if (p_data)
+        UnmapViewOfFile(p_data);
+    if (mapping_handle)
+        CloseHandle(mapping_handle);
+    if (file_handle)
+        CloseHandle(file_handle);
+    file_handle = mapping_handle = nullptr;
+#else
+    if (p_data)
+        munmap(const_cast<uint8_t*>(p_data), byte_count);
+#endif
+    p_data = nullptr;
+    byte_count = 0;
+}
+
+BvoxReader::BvoxReader(const std::string &filename) : file(filename) {
+    if (file.size() < sizeof(BvoxHeader))
+        throw std::runtime_error("file is too small for a bvox header.");
+    std::memcpy(&header, file.data(), sizeof(BvoxHeader));
+
+    res = header.chunk_res;
+    morton = header.morton_encoded;
+    if (res == 0 || static_cast<uint64_t>(header.chunk_size) != get_voxel_count())
+        throw std::runtime_error("bvox header does not describe a cubic grid.");
+
+    // the run length stream of vss has no index to seek in
+    if (header.run_length_encoded)
+        throw std::runtime_error("run length encoded bvox files are not supported by the reader.");
+
+    if (file.size() - sizeof(BvoxHeader) != get_voxel_count())
+        throw std::runtime_error("bvox payload does not match the header.");
+}
+
+uint64_t BvoxReader::index_of(const uint32_t x, const uint32_t y, const uint32_t z) const {
+    return grid_index(x, y, z, res, morton);
+}
+
+uint8_t BvoxReader::at(const uint32_t x, const uint32_t y, const uint32_t z) const {
+    if (x >= res || y >= res || z >= res)
+        return 0;
+    return get_payload()[index_of(x, y, z)];
+}
+
+void BvoxReader::extract_region(const glm::uvec3 min, const glm::uvec3 extent, uint8_t *p_dst) const {
+    check_region(min, extent, res);
+    gather_region(get_payload(), 0, res, morton, min, extent, p_dst);
+}
+
+void BvoxReader::decode(const uint64_t first, const uint64_t count, uint8_t *p_dst) const {
+    if (first > get_voxel_count() || count > get_voxel_count() - first)
+        throw std::runtime_error("decode range is outside of the grid.");
+    std::memcpy(p_dst, get_payload() + first, count);
+}
+
+BsvoReader::BsvoReader(const std::string &filename) : file(filename) {
+    if (file.size() < sizeof(BsvoHeader))
+        throw std::runtime_error("file is too small for a bsvo header.");
+    std::memcpy(&header, file.data(), sizeof(BsvoHeader));
+
+    // the depth can not go below single voxels
+    const auto root_res = static_cast<uint32_t>(header.root_res);
+    if (root_res == 0 || static_cast<int32_t>(header.max_depth) > std::countr_zero(std::bit_ceil(root_res)))
+        throw std::runtime_error("bsvo header is inconsistent.");
+}
+
+CvoxReader::CvoxReader(const std::string &filename) : file(filename) {
+    if (file.size() < sizeof(CvoxHeader))
+        throw std::runtime_error("file is too small for a cvox header.");
+    std::memcpy(&header, file.data(), sizeof(CvoxHeader));
+
+    if (header.magic != CVOX_MAGIC || header.version != CVOX_VERSION)
+        throw std::runtime_error("not a cvox file of a supported version.");
+    if (header.codec != CODEC_RLE && header.codec != CODEC_MASK)
+        throw std::runtime_error("unknown chunk codec.");
+
+    const uint64_t voxel_count = get_voxel_count();
+    if (voxel_count == 0 || header.chunk_voxels == 0 ||
+        header.chunk_count != (voxel_count + header.chunk_voxels - 1) / header.chunk_voxels)
+        throw std::runtime_error("cvox header is inconsistent.");
+
+    const size_t index_bytes = (static_cast<size_t>(header.chunk_count) + 1) * sizeof(uint64_t);
+    if (file.size() - sizeof(CvoxHeader) < index_bytes)
+        throw std::runtime_error("cvox chunk index is truncated.");
+    offsets.resize(header.chunk_count + 1);
+    std::memcpy(offsets.data(), file.data() + sizeof(CvoxHeader), index_bytes);
+
+    if (offsets.front() != sizeof(CvoxHeader) + index_bytes || offsets.back() != file.size() ||
+        !std::is_sorted(offsets.begin(), offsets.end()))
+        throw std::runtime_error("cvox chunk index does not match the file.");
+}
+
+uint32_t CvoxReader::get_chunk_size(const uint32_t chunk) const {
+    const uint64_t first = static_cast<uint64_t>(chunk) * header.chunk_voxels;
+    return static_cast<uint32_t>(std::min<uint64_t>(header.chunk_voxels, get_voxel_count() - first));
+}
+
+void CvoxReader::decode_chunk(const uint32_t chunk, uint8_t *p_dst) const {
+    ::decode_chunk(static_cast<VoxelCodec>(header.codec), file.data() + offsets[chunk], get_chunk_bytes(chunk),
+                   p_dst, get_chunk_size(chunk));
+}
+
+void CvoxReader::decode(const uint64_t first, const uint64_t count, uint8_t *p_dst, const uint32_t thread_count) const {
+    if (first > get_voxel_count() || count > get_voxel_count() - first)
+        throw std::runtime_error("decode range is outside of the grid.");
+    if (count == 0)
+        return;
+
+    const auto first_chunk = static_cast<uint32_t>(first / header.chunk_voxels);
+    const auto end_chunk = static_cast<uint32_t>((first + count - 1) / header.chunk_voxels + 1);
+
+    parallel_for(first_chunk, end_chunk, thread_count, [&](const uint32_t chunk) {
+        const uint64_t chunk_first = static_cast<uint64_t>(chunk) * header.chunk_voxels;
+        const uint64_t chunk_end = chunk_first + get_chunk_size(chunk);
+        const uint64_t copy_first = std::max(first, chunk_first);
+        const uint64_t copy_end = std::min(first + count, chunk_end);
+
+        if (copy_first == chunk_first && copy_end == chunk_end) {
+            decode_chunk(chunk, p_dst + (chunk_first - first));
+            return;
+        }
+
+        std::vector<uint8_t> voxels(chunk_end - chunk_first);
+        decode_chunk(chunk, voxels.data());
+        std::memcpy(p_dst + (copy_first - first), voxels.data() + (copy_first - chunk_first), copy_end - copy_first);
+    });
+}
+
+void CvoxReader::extract_region(const glm::uvec3 min, const glm::uvec3 extent, uint8_t *p_dst,
+                                const uint32_t thread_count) const {
+    check_region(min, extent, get_res());
+    if (extent.x == 0 || extent.y == 0 || extent.z == 0)
+        return;
+
+    const bool morton = is_morton();
+    const std::vector<RegionRun> runs = get_region_runs(get_res(), morton, min, min + extent);
+    auto get_run_end = [&](const RegionRun &run) {
+        return run.first + (morton ? static_cast<uint64_t>(run.size) * run.size * run.size : run.size);
+    };
+
+    // the chunks that the runs overlap, with the runs of each one
+    struct ChunkRuns {
+        uint32_t chunk;
+        size_t first_run;
+        size_t end_run;
+    };
+    std::vector<ChunkRuns> chunks;
+    for (size_t i = 0; i < runs.size(); i++) {
+        const auto first_chunk = static_cast<uint32_t>(runs[i].first / header.chunk_voxels);
+        const auto last_chunk = static_cast<uint32_t>((get_run_end(runs[i]) - 1) / header.chunk_voxels);
+        for (uint32_t chunk = first_chunk; chunk <= last_chunk; chunk++) {
+            if (!chunks.empty() && chunks.back().chunk == chunk)
+                chunks.back().end_run = i + 1;
+            else
+                chunks.push_back({chunk, i, i + 1});
+        }
+    }
+
+    // each chunk is decoded once and its part of every run is copied into the box
+    parallel_for(0, static_cast<uint32_t>(chunks.size()), thread_count, [&](const uint32_t i) {
+        const ChunkRuns &chunk_runs = chunks[i];
+        const uint64_t chunk_first = static_cast<uint64_t>(chunk_runs.chunk) * header.chunk_voxels;
+        std::vector<uint8_t> voxels(get_chunk_size(chunk_runs.chunk));
+        decode_chunk(chunk_runs.chunk, voxels.data());
+
+        for (size_t r = chunk_runs.first_run; r < chunk_runs.end_run; r++) {
+            const RegionRun &run = runs[r];
+            const uint64_t copy_first = std::max(run.first, chunk_first);
+            const uint64_t copy_end = std::min(get_run_end(run), chunk_first + voxels.size());
+            const uint8_t *p_src = voxels.data() + (copy_first - chunk_first);
+
+            if (!morton) {
+                const glm::uvec3 pos = run.origin - min;
+                const uint64_t dst = (static_cast<uint64_t>(pos.z) * extent.y + pos.y) * extent.x + pos.x;
+                std::memcpy(p_dst + dst + (copy_first - run.first), p_src, copy_end - copy_first);
+                continue;
+            }
+
+            for (uint64_t code = copy_first - run.first; code < copy_end - run.first; code++) {
+                const glm::uvec3 pos = run.origin - min + glm::uvec3(compact_by_3(code), compact_by_3(code >> 1),
+                                                                     compact_by_3(code >> 2));
+                p_dst[(static_cast<uint64_t>(pos.z) * extent.y + pos.y) * extent.x + pos.x] = *p_src++;
+            }
+        }
+    });
+}
+
+uint8_t CvoxReader::at(const uint32_t x, const uint32_t y, const uint32_t z) const {
+    if (x >= get_res() || y >= get_res() || z >= get_res())
+        return 0;
+
+    uint8_t value;
+    decode(grid_index(x, y, z, get_res(), is_morton()), 1, &value);
+    return value;
+}
+
+OccupancyOctree::OccupancyOctree(const BvoxReader &reader) : reader(reader) {
+    for (uint32_t level_res = reader.get_res(); level_res > 1;) {
+        level_res = (level_res + 1) / 2;
+        const uint64_t node_count = static_cast<uint64_t>(level_res) * level_res * level_res;
+        levels.push_back({level_res, std::vector<uint64_t>((node_count + 63) / 64)});
+    }
+    if (levels.empty())
+        return;
+
+    // the first level from the payload, in file order so that the mapping is read sequentially
+    Level &first = levels.front();
+    reader.for_each_voxel([&](const uint32_t x, const uint32_t y, const uint32_t z, const uint8_t value) {
+        if (value == 0)
+            return;
+        const uint64_t node = (static_cast<uint64_t>(z / 2) * first.res + y / 2) * first.res + x / 2;
+        first.bits[node / 64] |= 1ull << (node % 64);
+    });
+
+    for (size_t i = 1; i < levels.size(); i++) {
+        const Level &child = levels[i - 1];
+        Level &parent = levels[i];
+
+        for (uint64_t word = 0; word < child.bits.size(); word++) {
+            for (uint64_t bits = child.bits[word]; bits != 0; bits &= bits - 1) {
+                const uint64_t node = word * 64 + std::countr_zero(bits);
+                const uint64_t x = node % child.res / 2;
+                const uint64_t y = node / child.res % child.res / 2;
+                const uint64_t z = node / child.res / child.res / 2;
+                const uint64_t parent_node = (z * parent.res + y) * parent.res + x;
+                parent.bits[parent_node / 64] |= 1ull << (parent_node % 64);
+            }
+        }
+    }
+}
+
+bool OccupancyOctree::is_occupied(const uint32_t level, const uint32_t x, const uint32_t y, const uint32_t z) const {
+    if (level == 0)
+        return reader.at(x, y, z) != 0;
+
+    const Level &nodes = levels[level - 1];
+    if (x >= nodes.res || y >= nodes.res || z >= nodes.res)
+        return false;
+
+    const uint64_t node = (static_cast<uint64_t>(z) * nodes.res + y) * nodes.res + x;
+    return nodes.bits[node / 64] >> (node % 64) & 1;
+}
+
+RayHit OccupancyOctree::cast_ray(const glm::vec3 origin, const glm::vec3 dir, const float max_t) const {
+    const RayHit miss = {false, glm::uvec3(0), 0, max_t};
+    const auto res = static_cast<int32_t>(reader.get_res());
+    const glm::vec3 inv_dir = 1.0f / dir;
+
+    // clip the ray to the grid
+    float t_begin = 0.0f;
+    float t_end = max_t;
+    for (int32_t axis = 0; axis < 3; axis++) {
+        if (dir[axis] == 0.0f) {
+            if (origin[axis] < 0.0f || origin[axis] >= static_cast<float>(res))
+                return miss;
+            continue;
+        }
+
+        const float t0 = -origin[axis] * inv_dir[axis];
+        const float t1 = (static_cast<float>(res) - origin[axis]) * inv_dir[axis];
+        t_begin = std::max(t_begin, std::min(t0, t1));
+        t_end = std::min(t_end, std::max(t0, t1));
+    }
+    if (t_begin > t_end)
+        return miss;
+
+    float t = t_begin;
+    glm::ivec3 voxel = glm::clamp(glm::ivec3(glm::floor(origin + dir * t)), glm::ivec3(0), glm::ivec3(res - 1));
+    const auto top_level = static_cast<uint32_t>(levels.size());
+
+    while (true) {
+        // the coarsest empty node around the voxel, the voxel itself if all of its ancestors are occupied
+        uint32_t empty_level = 0;
+        for (uint32_t level = top_level; level > 0; level--) {
+            if (!is_occupied(level, voxel.x >> level, voxel.y >> level, voxel.z >> level)) {
+                empty_level = level;
+                break;
+            }
+        }
+        if (empty_level == 0) {
+            if (const uint8_t value = reader.at(voxel.x, voxel.y, voxel.z); value != 0)
+                return {true, glm::uvec3(voxel), value, t};
+        }
+
+        // leave the node through the nearest face
+        const int32_t node_size = 1 << empty_level;
+        const glm::ivec3 node_min = voxel >> empty_level << empty_level;
+
+        float t_exit = std::numeric_limits<float>::infinity();
+        int32_t exit_axis = 0;
+        for (int32_t axis = 0; axis < 3; axis++) {
+            if (dir[axis] == 0.0f)
+                continue;
+
+            const int32_t face = dir[axis] > 0.0f ? node_min[axis] + node_size : node_min[axis];
+            const float t_face = (static_cast<float>(face) - origin[axis]) * inv_dir[axis];
+            if (t_face < t_exit) {
+                t_exit = t_face;
+                exit_axis = axis;
+            }
+        }
+        if (t_exit > t_end)
+            return miss;
+        t = std::max(t, t_exit);
+
+        // the exit axis steps exactly, the others never move against the ray
+        const auto pos = glm::ivec3(glm::floor(origin + dir * t));
+        for (int32_t axis = 0; axis < 3; axis++) {
+            if (axis == exit_axis)
+                voxel[axis] = dir[axis] > 0.0f ? node_min[axis] + node_size : node_min[axis] - 1;
+            else if (dir[axis] > 0.0f)
+                voxel[axis] = std::max(voxel[axis], pos[axis]);
+            else if (dir[axis] < 0.0f)
+                voxel[axis] = std::min(voxel[axis], pos[axis]);
+        }
+
+        if (voxel[exit_axis] < 0 || voxel[exit_axis] >= res)
+            return miss;
+        voxel = glm::clamp(voxel, glm::ivec3(0), glm::ivec3(res - 1));
+    }
+}
@@ -0,0 +1,257 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vss.h"
+
+#include "../codec.h"
+#include "../morton.h"
+
+#ifndef VCW_READER_H
+#define VCW_READER_H
+
+// read side of the gpu_mtv outputs for other services. files are mapped instead of read, the headers are the ones of
+// vss and are validated on open. lookups and ranged decodes go straight to the mapping, nothing is decompressed up
+// front. no vulkan, so a service only links this library.
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    const uint8_t *data() const {
+        return p_data;
+    }
+
+    size_t size() const {
+        return byte_count;
+    }
+
+    // page cache hint for scattered lookups, ranged decodes keep the default read ahead
+    void advise_random() const;
+
+private:
+    void release();
+
+    const uint8_t *p_data = nullptr;
+    size_t byte_count = 0;
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+// dense occupancy grid of a .bvox file, in linear (x fastest) or morton order
+class BvoxReader {
+public:
+    explicit BvoxReader(const std::string &filename);
+
+    const BvoxHeader &get_header() const {
+        return header;
+    }
+
+    uint32_t get_res() const {
+        return res;
+    }
+
+    bool is_morton() const {
+        return morton;
+    }
+
+    // payload in file order, valid as long as the reader lives
+    const uint8_t *get_payload() const {
+        return file.data() + sizeof(BvoxHeader);
+    }
+
+    uint64_t get_voxel_count() const {
+        return static_cast<uint64_t>(res) * res * res;
+    }
+
+    // position of (x, y, z) in the payload
+    uint64_t index_of(uint32_t x, uint32_t y, uint32_t z) const;
+
+    // 0 outside of the grid
+    uint8_t at(uint32_t x, uint32_t y, uint32_t z) const;
+
+    // copies the box [min, min + extent) into p_dst, x fastest
+    void extract_region(glm::uvec3 min, glm::uvec3 extent, uint8_t *p_dst) const;
+
+    // copies count voxels of the payload from first on into p_dst, in file order. for reading the grid in slices
+    // without holding all of it
+    void decode(uint64_t first, uint64_t count, uint8_t *p_dst) const;
+
+    // calls func(x, y, z, value) for every voxel in file order
+    template<typename Func>
+    void for_each_voxel(Func func) const;
+
+    void advise_random() const {
+        file.advise_random();
+    }
+
+private:
+    MappedFile file;
+    BvoxHeader header;
+    uint32_t res;
+    bool morton;
+};
+
+template<typename Func>
+void BvoxReader::for_each_voxel(Func func) const {
+    const uint8_t *p_payload = get_payload();
+
+    if (!morton) {
+        uint64_t index = 0;
+        for (uint32_t z = 0; z < res; z++)
+            for (uint32_t y = 0; y < res; y++)
+                for (uint32_t x = 0; x < res; x++)
+                    func(x, y, z, p_payload[index++]);
+        return;
+    }
+
+    // codes outside of the grid are not in the file. the 8 codes of a group only differ in the lowest bit per axis,
+    // so the corner is decoded once per group
+    const uint64_t size = std::bit_ceil(res);
+    uint64_t index = 0;
+    for (uint64_t group = 0; group < std::max<uint64_t>(1, size * size * size / 8); group++) {
+        const uint32_t x0 = compact_by_3(group) * 2;
+        const uint32_t y0 = compact_by_3(group >> 1) * 2;
+        const uint32_t z0 = compact_by_3(group >> 2) * 2;
+
+        for (uint32_t child = 0; child < 8; child++) {
+            const uint32_t x = x0 + (child & 1);
+            const uint32_t y = y0 + (child >> 1 & 1);
+            const uint32_t z = z0 + (child >> 2);
+            if (x < res && y < res && z < res)
+                func(x, y, z, p_payload[index++]);
+        }
+    }
+}
+
+// .bsvo file, the header is validated and the node data is handed out as it is, its layout belongs to vss
+class BsvoReader {
+public:
+    explicit BsvoReader(const std::string &filename);
+
+    const BsvoHeader &get_header() const {
+        return header;
+    }
+
+    const uint8_t *get_nodes() const {
+        return file.data() + sizeof(BsvoHeader);
+    }
+
+    size_t get_node_bytes() const {
+        return file.size() - sizeof(BsvoHeader);
+    }
+
+private:
+    MappedFile file;
+    BsvoHeader header;
+};
+
+// chunked grid of a .cvox file, see codec.h. only the chunks a query touches are decoded, on several threads if
+// asked to
+class CvoxReader {
+public:
+    explicit CvoxReader(const std::string &filename);
+
+    const CvoxHeader &get_header() const {
+        return header;
+    }
+
+    uint32_t get_res() const {
+        return header.chunk_res;
+    }
+
+    bool is_morton() const {
+        return header.morton_encoded;
+    }
+
+    uint64_t get_voxel_count() const {
+        return static_cast<uint64_t>(header.chunk_res) * header.chunk_res * header.chunk_res;
+    }
+
+    uint32_t get_chunk_count() const {
+        return header.chunk_count;
+    }
+
+    // voxels of chunk, the last one may be shorter
+    uint32_t get_chunk_size(uint32_t chunk) const;
+
+    // compressed bytes of chunk
+    uint64_t get_chunk_bytes(uint32_t chunk) const {
+        return offsets[chunk + 1] - offsets[chunk];
+    }
+
+    void decode_chunk(uint32_t chunk, uint8_t *p_dst) const;
+
+    // copies count voxels from first on into p_dst, in file order. chunks that are covered completely are decoded in
+    // place
+    void decode(uint64_t first, uint64_t count, uint8_t *p_dst, uint32_t thread_count = 1) const;
+
+    // copies the box [min, min + extent) into p_dst, x fastest. only the chunks that the box overlaps are decoded,
+    // each of them once
+    void extract_region(glm::uvec3 min, glm::uvec3 extent, uint8_t *p_dst, uint32_t thread_count = 1) const;
+
+    // decodes the chunk of the voxel, 0 outside of the grid
+    uint8_t at(uint32_t x, uint32_t y, uint32_t z) const;
+
+private:
+    MappedFile file;
+    CvoxHeader header;
+    std::vector<uint64_t> offsets;
+};
+
+struct RayHit {
+    bool hit;
+    glm::uvec3 voxel;
+    uint8_t value;
+    // distance along dir to the entry into the voxel
+    float t;
+};
+
+// sparse voxel octree over the occupancy of a bvox grid, one bit per node and level, level 0 are the voxels
+// themselves and are looked up in the mapping. built with a single pass over the payload.
+class OccupancyOctree {
+public:
+    explicit OccupancyOctree(const BvoxReader &reader);
+
+    uint32_t get_level_count() const {
+        return static_cast<uint32_t>(levels.size()) + 1;
+    }
+
+    // node (x, y, z) of level, in units of 2^level voxels
+    bool is_occupied(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const;
+
+    // first occupied voxel along origin + t * dir in grid space, a voxel spans [v, v + 1). empty nodes are skipped
+    // as a whole.
+    RayHit cast_ray(glm::vec3 origin, glm::vec3 dir, float max_t) const;
+
+private:
+    struct Level {
+        uint32_t res;
+        std::vector<uint64_t> bits;
+    };
+
+    const BvoxReader &reader;
+    std::vector<Level> levels;
+};
+
+#endif //VCW_READER_H
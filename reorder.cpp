@@ -0,0 +1,96 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// triangle reordering: triangles are sorted by the morton code of their centroid, so that consecutive fragments write
+// to nearby voxels of the render target instead of jumping through it in file order. vertices can additionally be
+// renumbered in the order they are first fetched.
+
+// stable lsd radix sort of key value pairs with 8 bit digits. every thread counts the digits of its range, the counts
+// are prefix summed in (digit, thread) order and every thread scatters its range to the resulting offsets.
+static void radix_sort_pairs(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, const uint32_t key_bits) {
+    const auto n = static_cast<uint32_t>(keys.size());
+    const uint32_t max_threads = std::max(1u, div_ceil(n, RADIX_MIN_RANGE));
+    const uint32_t thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, max_threads);
+
+    std::vector<uint32_t> sorted_keys(n);
+    std::vector<uint32_t> sorted_values(n);
+    std::vector<std::array<uint32_t, 256>> offsets(thread_count);
+
+    for (uint32_t shift = 0; shift < key_bits; shift += 8) {
+        parallel_ranges(n, thread_count, [&](const uint32_t thread, const uint32_t begin, const uint32_t end) {
+            offsets[thread].fill(0);
+            for (uint32_t i = begin; i < end; i++)
+                offsets[thread][(keys[i] >> shift) & 0xFF]++;
+        });
+
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < 256; digit++) {
+            for (auto &offset: offsets) {
+                const uint32_t count = offset[digit];
+                offset[digit] = sum;
+                sum += count;
+            }
+        }
+
+        parallel_ranges(n, thread_count, [&](const uint32_t thread, const uint32_t begin, const uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const uint32_t dst = offsets[thread][(keys[i] >> shift) & 0xFF]++;
+                sorted_keys[dst] = keys[i];
+                sorted_values[dst] = values[i];
+            }
+        });
+
+        keys.swap(sorted_keys);
+        values.swap(sorted_values);
+    }
+}
+
+// has to be called after the bounds of the model are known
+void App::sort_tris_morton() {
+    TRACE_SCOPE(__func__);
+    const auto tri_count = static_cast<uint32_t>(indices.size() / 3);
+
+    // centroids are quantized to 10 bit per axis inside the bounding box
+    const glm::vec3 scale = 1023.0f / glm::max(dim, glm::vec3(std::numeric_limits<float>::epsilon()));
+
+    std::vector<uint32_t> keys(tri_count);
+    std::vector<uint32_t> order(tri_count);
+    for (uint32_t tri = 0; tri < tri_count; tri++) {
+        const glm::vec3 centroid = (vertices[indices[3 * tri + 0]].pos + vertices[indices[3 * tri + 1]].pos +
+                                    vertices[indices[3 * tri + 2]].pos) / 3.0f;
+        const glm::uvec3 cell(glm::clamp((centroid - min_vert_coord) * scale, 0.0f, 1023.0f));
+
+        // 10 bit per axis, the code fits into 30 bits
+        keys[tri] = static_cast<uint32_t>(spread_by_3(cell.x) | spread_by_3(cell.y) << 1 | spread_by_3(cell.z) << 2);
+        order[tri] = tri;
+    }
+
+    radix_sort_pairs(keys, order, 30);
+
+    std::vector<uint32_t> sorted_indices(indices.size());
+    for (uint32_t tri = 0; tri < tri_count; tri++)
+        std::copy_n(indices.begin() + 3 * order[tri], 3, sorted_indices.begin() + 3 * tri);
+
+    indices.swap(sorted_indices);
+}
+
+// renumbers the vertices in the order the index stream first references them
+void App::reorder_vertices() {
+    TRACE_SCOPE(__func__);
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto &index: indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
@@ -0,0 +1,127 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// signed distance field: sdf_seed.comp marks the surface voxels of the render target, sdf_jfa.comp runs a 3d jump
+// flood with halving steps and sdf_resolve.comp turns the closest seed into a quantized distance. the sign comes from
+// the solid fill, without -fill the distance is unsigned.
+
+void App::create_sdf_resources() {
+    const VkExtent3D extent = {params.chunk_res, params.chunk_res, params.chunk_res};
+
+    for (auto &seed_img: sdf_seed_imgs) {
+        seed_img = create_img(extent, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_STORAGE_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+        create_img_view(&seed_img, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+    }
+
+    sdf_img = create_img(extent, params.sdf_bits == 8 ? VK_FORMAT_R8_UINT : VK_FORMAT_R16_UINT,
+                         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+    create_img_view(&sdf_img, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+
+    // one pass per halving of the step, starting at half the padded resolution
+    sdf_pass_count = static_cast<uint32_t>(std::countr_zero(next_pow2(params.chunk_res)));
+
+    sdf_seed_pipe = create_comp_pipe("sdf_seed.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                       VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+                                     sizeof(VCW_SdfPushConstants));
+    write_comp_img_binding(sdf_seed_pipe, render_target, 0);
+    write_comp_img_binding(sdf_seed_pipe, sdf_seed_imgs[0], 1);
+
+    // ping pong, pipe i reads seed image i
+    for (uint32_t i = 0; i < 2; i++) {
+        sdf_jfa_pipes[i] = create_comp_pipe("sdf_jfa.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+                                            sizeof(VCW_SdfPushConstants));
+        write_comp_img_binding(sdf_jfa_pipes[i], sdf_seed_imgs[i], 0);
+        write_comp_img_binding(sdf_jfa_pipes[i], sdf_seed_imgs[1 - i], 1);
+    }
+
+    const std::vector<std::string> defines = {
+            params.sdf_bits == 8 ? "SDF_FORMAT=r8ui" : "SDF_FORMAT=r16ui",
+            params.sdf_bits == 8 ? "SDF_MAX_VALUE=255" : "SDF_MAX_VALUE=65535"
+    };
+    sdf_resolve_pipe = create_comp_pipe("sdf_resolve.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+                                        sizeof(VCW_SdfPushConstants), defines);
+    write_comp_img_binding(sdf_resolve_pipe, render_target, 0);
+    write_comp_img_binding(sdf_resolve_pipe, sdf_seed_imgs[sdf_pass_count % 2], 1);
+    write_comp_img_binding(sdf_resolve_pipe, sdf_img, 2);
+}
+
+// has to be called after the grid was read back, the render target is not modified
+void App::write_sdf() {
+    TRACE_SCOPE(__func__);
+    VCW_SdfPushConstants sdf_const{};
+    sdf_const.res = params.chunk_res;
+    sdf_const.signed_dist = params.solid_axes > 0;
+    sdf_const.max_dist = static_cast<float>(params.chunk_res) / SDF_RANGE_DIVISOR;
+
+    const uint32_t group_count = div_ceil(params.chunk_res, 8);
+    const uint32_t group_count_z = div_ceil(params.chunk_res, 4);
+
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+    record_timestamp(cmd_buf, QUERY_SDF_BEGIN, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    for (auto *p_img: {&sdf_seed_imgs[0], &sdf_seed_imgs[1], &sdf_img})
+        transition_img_layout(cmd_buf, p_img, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    dispatch_comp(cmd_buf, sdf_seed_pipe, group_count, group_count, group_count_z, &sdf_const);
+
+    for (uint32_t pass = 0; pass < sdf_pass_count; pass++) {
+        comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        sdf_const.step = next_pow2(params.chunk_res) >> (pass + 1);
+        dispatch_comp(cmd_buf, sdf_jfa_pipes[pass % 2], group_count, group_count, group_count_z, &sdf_const);
+    }
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    dispatch_comp(cmd_buf, sdf_resolve_pipe, group_count, group_count, group_count_z, &sdf_const);
+
+    record_timestamp(cmd_buf, QUERY_SDF_END, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    end_single_time_cmd(cmd_buf);
+    trace_gpu_queries("sdf", QUERY_SDF_BEGIN, QUERY_SDF_END);
+
+    // every brick holds a distance, so all of them are read back
+    std::vector<uint32_t> brick_table(brick_axis_count * brick_axis_count * brick_axis_count);
+    std::iota(brick_table.begin(), brick_table.end(), 0);
+
+    const uint32_t texel_size = params.sdf_bits / 8;
+    VCW_Buffer packed_buf = cp_img_bricks(&sdf_img, brick_table, texel_size);
+
+    std::vector<uint8_t> sdf_grid(static_cast<size_t>(params.chunk_size) * texel_size);
+    scatter_bricks(packed_buf, brick_table, texel_size, sdf_grid.data());
+
+    unmap_buf(&packed_buf);
+    clean_up_buf(packed_buf);
+
+    SdfHeader header{};
+    header.chunk_res = params.chunk_res;
+    header.bits = params.sdf_bits;
+    header.signed_dist = sdf_const.signed_dist;
+    header.max_dist = sdf_const.max_dist;
+
+    // the grid is written while the remaining stages run
+    FileWriter &writer = open_writer(params.sdf_file);
+    writer.write(&header, sizeof(SdfHeader));
+    writer.write_owned(std::move(sdf_grid));
+}
+
+void App::clean_up_sdf() const {
+    clean_up_comp_pipe(sdf_seed_pipe);
+    clean_up_comp_pipe(sdf_jfa_pipes[0]);
+    clean_up_comp_pipe(sdf_jfa_pipes[1]);
+    clean_up_comp_pipe(sdf_resolve_pipe);
+
+    clean_up_img(sdf_seed_imgs[0]);
+    clean_up_img(sdf_seed_imgs[1]);
+    clean_up_img(sdf_img);
+}
@@ -2,11 +2,61 @@
 
 // from https://github.com/pumexx/pumex/tree/master/examples/pumexvoxelizer
 
+#extension GL_GOOGLE_include_directive: require
+
+#ifdef TEXTURES
+#extension GL_EXT_nonuniform_qualifier: require
+#endif
+
+#ifdef HASH_ENGINE
+#extension GL_ARB_gpu_shader_int64: require
+#extension GL_EXT_shader_atomic_int64: require
+#endif
+
 layout (set = 0, binding = 0) uniform UBO {
     vec4 chunk_res;
 } ubo;
 
+#ifdef HASH_ENGINE
+layout (set = 0, binding = 1) buffer HashTable {
+    uint64_t keys[];
+} hash_table;
+
+layout (set = 0, binding = 2) buffer HashInfo {
+    uint capacity;
+    uint count;
+    uint overflow;
+} hash_info;
+
+const uint64_t empty_key = 0xFFFFFFFFFFFFFFFFUL;
+const uint max_probes = 128;
+#else
 layout (set = 0, binding = 1, r8ui) uniform uimage3D render_target;
+#endif
+
+#ifdef BRICK_READBACK
+// one bit per BRICK_RES^3 brick of the render target
+layout (set = 0, binding = 2) buffer BrickBits {
+    uint bits[];
+} brick_bits;
+#endif
+
+#ifdef ATTRIBUTES
+// running averages, the top 8 bits hold the sample count
+layout (set = 0, binding = 3, r32ui) uniform coherent volatile uimage3D color_target;
+layout (set = 0, binding = 4, r32ui) uniform coherent volatile uimage3D normal_target;
+layout (set = 0, binding = 5, MAT_FORMAT) uniform uimage3D mat_target;
+#endif
+
+#ifdef TEXTURES
+layout (set = 0, binding = 6) uniform sampler tex_sampler;
+layout (set = 0, binding = 7) uniform texture2D textures[TEXTURE_COUNT];
+
+// texture index of every material, -1 without diffuse texture
+layout (set = 0, binding = 8) readonly buffer MaterialTextures {
+    int ids[];
+} mat_tex;
+#endif
 
 layout (location = 0) in vec3 gs_pos;
 layout (location = 1) in vec3 gs_normal;
@@ -16,11 +66,97 @@ layout (location = 4) flat in uint gs_mat_id;
 layout (location = 5) flat in vec3 gs_min_aabb;
 layout (location = 6) flat in vec3 gs_max_aabb;
 
+#ifdef HASH_ENGINE
+// spreads the lower 21 bits of a, so that there are two zero bits between each bit
+uint64_t spread_by_3(uint a) {
+    uint64_t x = uint64_t(a) & 0x1fffffUL;
+    x = (x | x << 32) & 0x1f00000000ffffUL;
+    x = (x | x << 16) & 0x1f0000ff0000ffUL;
+    x = (x | x << 8) & 0x100f00f00f00f00fUL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3UL;
+    x = (x | x << 2) & 0x1249249249249249UL;
+    return x;
+}
+
+uint64_t morton_encode(uvec3 coord) {
+    return spread_by_3(coord.x) | (spread_by_3(coord.y) << 1) | (spread_by_3(coord.z) << 2);
+}
+
+uint hash_key(uint64_t key) {
+    uint h = uint(key) * 0x9e3779b1u ^ uint(key >> 32) * 0x85ebca77u;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+void insert_voxel(uvec3 coord) {
+    uint64_t key = morton_encode(coord);
+    uint mask = hash_info.capacity - 1;
+    uint slot = hash_key(key) & mask;
+
+    for (uint i = 0; i < max_probes; i++) {
+        uint64_t prev = atomicCompSwap(hash_table.keys[slot], empty_key, key);
+        if (prev == empty_key || prev == key) return;
+        slot = (slot + 1) & mask;
+    }
+
+    atomicAdd(hash_info.overflow, 1);
+}
+#endif
+
+#ifdef ATTRIBUTES
+#include "attrib.glsl"
+#endif
+
 void main() {
+#ifdef TEXTURES
+    // one pixel is one voxel, so the uv derivatives select the mip level that matches the voxel footprint.
+    // taken before any discard, derivatives are undefined afterwards.
+    vec2 uv_dx = dFdx(gs_uv);
+    vec2 uv_dy = dFdy(gs_uv);
+#endif
+
     if (any(lessThan(gs_pos, gs_min_aabb)) || any(lessThan(gs_max_aabb, gs_pos))) discard;
 
     vec3 address = gs_pos * vec3(0.5) + vec3(0.5);
     ivec3 img_coord = ivec3(ubo.chunk_res.xyz * address);
 
+#ifdef HASH_ENGINE
+    // out of bounds stores are dropped by the image, the hash table has to do it manually
+    if (any(lessThan(img_coord, ivec3(0))) || any(greaterThanEqual(img_coord, ivec3(ubo.chunk_res.xyz)))) return;
+
+    insert_voxel(uvec3(img_coord));
+#else
     imageStore(render_target, img_coord, uvec4(1));
+
+#ifdef ATTRIBUTES
+    if (all(greaterThanEqual(img_coord, ivec3(0))) && all(lessThan(img_coord, ivec3(ubo.chunk_res.xyz)))) {
+        vec3 color = gs_color;
+#ifdef TEXTURES
+        if (gs_mat_id < mat_tex.ids.length()) {
+            int tex_id = mat_tex.ids[gs_mat_id];
+            if (tex_id >= 0)
+                color = textureGrad(sampler2D(textures[nonuniformEXT(tex_id)], tex_sampler), gs_uv, uv_dx, uv_dy).rgb;
+        }
+#endif
+        average_color(img_coord, color);
+        average_normal(img_coord, gs_normal);
+        imageStore(mat_target, img_coord, uvec4(gs_mat_id));
+    }
+#endif
+
+#ifdef BRICK_READBACK
+    if (any(lessThan(img_coord, ivec3(0))) || any(greaterThanEqual(img_coord, ivec3(ubo.chunk_res.xyz)))) return;
+
+    uint brick_axis = (uint(ubo.chunk_res.x) + BRICK_RES - 1) / BRICK_RES;
+    uvec3 brick = uvec3(img_coord) / BRICK_RES;
+    uint brick_index = brick.x + brick_axis * (brick.y + brick_axis * brick.z);
+
+    // most fragments hit an already marked brick, avoid the atomic in that case
+    uint mask = 1u << (brick_index & 31u);
+    if ((brick_bits.bits[brick_index >> 5] & mask) == 0)
+        atomicOr(brick_bits.bits[brick_index >> 5], mask);
+#endif
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,306 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// solid voxelization: the mesh is rasterized along one or three axes without dilation, every covered pixel toggles a
+// crossing bit in the parity image. a prefix xor along each column then yields the inside voxels, which are merged
+// into the surface shell of the render target. everything stays on the device.
+
+void App::create_solid_resources() {
+    parity_word_count = div_ceil(params.chunk_res, 32);
+
+    const VkExtent3D extent = {params.chunk_res, params.chunk_res, parity_word_count * params.solid_axes};
+    parity_img = create_img(extent, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TYPE_3D);
+
+    create_img_view(&parity_img, VK_IMAGE_VIEW_TYPE_3D, DEFAULT_SUBRESOURCE_RANGE);
+
+    create_parity_pipe();
+
+    solid_scan_pipe = create_comp_pipe("solid_scan.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+                                       sizeof(VCW_SolidPushConstants));
+    write_comp_img_binding(solid_scan_pipe, parity_img, 0);
+
+    std::vector<VkDescriptorType> fill_desc_types = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                     VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    if (!params.full_readback)
+        fill_desc_types.push_back(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+    solid_fill_pipe = create_comp_pipe("solid_fill.comp", fill_desc_types, sizeof(VCW_SolidPushConstants),
+                                       get_shader_defines());
+    write_comp_img_binding(solid_fill_pipe, parity_img, 0);
+    write_comp_img_binding(solid_fill_pipe, render_target, 1);
+    if (!params.full_readback)
+        write_comp_buf_binding(solid_fill_pipe, brick_buf, 2);
+}
+
+void App::create_parity_pipe() {
+    //
+    // descriptor set, parity image only
+    //
+    VkDescriptorSetLayoutBinding parity_layout_binding{};
+    parity_layout_binding.binding = 0;
+    parity_layout_binding.descriptorCount = 1;
+    parity_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    parity_layout_binding.pImmutableSamplers = nullptr;
+    parity_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo desc_set_layout_info{};
+    desc_set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    desc_set_layout_info.bindingCount = 1;
+    desc_set_layout_info.pBindings = &parity_layout_binding;
+
+    if (vkCreateDescriptorSetLayout(dev, &desc_set_layout_info, nullptr, &parity_desc_set_layout) != VK_SUCCESS)
+        throw std::runtime_error("failed to create parity descriptor set layout.");
+
+    VkDescriptorPoolSize pool_size;
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_size.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+
+    if (vkCreateDescriptorPool(dev, &pool_info, nullptr, &parity_desc_pool) != VK_SUCCESS)
+        throw std::runtime_error("failed to create parity descriptor pool.");
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = parity_desc_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &parity_desc_set_layout;
+
+    if (vkAllocateDescriptorSets(dev, &alloc_info, &parity_desc_set) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate parity descriptor set.");
+
+    VkDescriptorImageInfo img_info{};
+    img_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    img_info.imageView = parity_img.view;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = parity_desc_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.descriptorCount = 1;
+    write.pImageInfo = &img_info;
+
+    vkUpdateDescriptorSets(dev, 1, &write, 0, nullptr);
+
+    //
+    // pipeline, vertex and fragment stage only
+    //
+    std::string vert_code = read_file_string("shaders/parity.vert");
+    std::string frag_code = read_file_string("shaders/parity.frag");
+
+    *p_log << "compiling parity shaders." << std::endl;
+    VkShaderModule vert_module = create_shader_mod(compile_shader(vert_code, shaderc_glsl_vertex_shader, "main"));
+    VkShaderModule frag_module = create_shader_mod(compile_shader(frag_code, shaderc_glsl_fragment_shader, "main"));
+
+    VkPipelineShaderStageCreateInfo vert_stage_info{};
+    vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_stage_info.module = vert_module;
+    vert_stage_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo frag_stage_info{};
+    frag_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_stage_info.module = frag_module;
+    frag_stage_info.pName = "main";
+
+    std::array stages = {vert_stage_info, frag_stage_info};
+
+    auto binding_desc = Vertex::get_binding_desc();
+    auto attrib_descs = Vertex::get_attrib_descs();
+
+    // only the position is consumed
+    VkPipelineVertexInputStateCreateInfo vert_input_info{};
+    vert_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vert_input_info.vertexBindingDescriptionCount = 1;
+    vert_input_info.vertexAttributeDescriptionCount = 1;
+    vert_input_info.pVertexBindingDescriptions = &binding_desc;
+    vert_input_info.pVertexAttributeDescriptions = &attrib_descs[0];
+
+    VkPipelineInputAssemblyStateCreateInfo input_asm_info{};
+    input_asm_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_asm_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_asm_info.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_info{};
+    viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_info.viewportCount = 1;
+    viewport_info.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo raster_info{};
+    raster_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster_info.depthClampEnable = VK_FALSE;
+    raster_info.rasterizerDiscardEnable = VK_FALSE;
+    raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+    raster_info.lineWidth = 1.0f;
+    raster_info.cullMode = VK_CULL_MODE_NONE;
+    raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    raster_info.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisample_info{};
+    multisample_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_info.sampleShadingEnable = VK_FALSE;
+    multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendStateCreateInfo blend_info{};
+    blend_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend_info.logicOpEnable = VK_FALSE;
+    blend_info.attachmentCount = 0;
+
+    std::vector<VkDynamicState> dynamic_states = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state_info{};
+    dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic_state_info.pDynamicStates = dynamic_states.data();
+
+    VkPushConstantRange push_const_range{};
+    push_const_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_const_range.offset = 0;
+    push_const_range.size = sizeof(VCW_ParityPushConstants);
+
+    VkPipelineLayoutCreateInfo pipe_layout_info{};
+    pipe_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipe_layout_info.setLayoutCount = 1;
+    pipe_layout_info.pSetLayouts = &parity_desc_set_layout;
+    pipe_layout_info.pushConstantRangeCount = 1;
+    pipe_layout_info.pPushConstantRanges = &push_const_range;
+
+    if (vkCreatePipelineLayout(dev, &pipe_layout_info, nullptr, &parity_pipe_layout) != VK_SUCCESS)
+        throw std::runtime_error("failed to create parity pipeline layout.");
+
+    VkGraphicsPipelineCreateInfo pipe_info{};
+    pipe_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipe_info.stageCount = static_cast<uint32_t>(stages.size());
+    pipe_info.pStages = stages.data();
+    pipe_info.pVertexInputState = &vert_input_info;
+    pipe_info.pInputAssemblyState = &input_asm_info;
+    pipe_info.pViewportState = &viewport_info;
+    pipe_info.pRasterizationState = &raster_info;
+    pipe_info.pMultisampleState = &multisample_info;
+    pipe_info.pColorBlendState = &blend_info;
+    pipe_info.pDynamicState = &dynamic_state_info;
+    pipe_info.layout = parity_pipe_layout;
+    pipe_info.renderPass = rendp;
+    pipe_info.subpass = 0;
+    pipe_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateGraphicsPipelines(dev, get_pipe_cache(), 1, &pipe_info, nullptr, &parity_pipe) != VK_SUCCESS)
+        throw std::runtime_error("failed to create parity pipeline.");
+
+    vkDestroyShaderModule(dev, frag_module, nullptr);
+    vkDestroyShaderModule(dev, vert_module, nullptr);
+}
+
+// has to be recorded before rendering, clears all crossing bits
+void App::record_parity_clear(VkCommandBuffer cmd_buf) {
+    transition_img_layout(cmd_buf, &parity_img, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    constexpr VkClearColorValue clear_color = {};
+    vkCmdClearColorImage(cmd_buf, parity_img.img, VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1,
+                         &DEFAULT_SUBRESOURCE_RANGE);
+}
+
+// has to be recorded after the surface pass, outside of a render pass
+// draws [first_tri, first_tri + tri_count) of the parity passes as part of a batch of render(), every axis draws all
+// triangles in turn
+void App::record_parity_draws(VkCommandBuffer cmd_buf, const uint32_t first_tri, const uint32_t tri_count) {
+    VkRenderPassBeginInfo rendp_begin_info{};
+    rendp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rendp_begin_info.renderPass = rendp;
+    rendp_begin_info.framebuffer = frame_buf;
+    rendp_begin_info.renderArea.offset = {0, 0};
+    rendp_begin_info.renderArea.extent = render_extent;
+
+    vkCmdBeginRenderPass(cmd_buf, &rendp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, parity_pipe);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(render_extent.width);
+    viewport.height = static_cast<float>(render_extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = render_extent;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+
+    const VkBuffer vert_bufs[] = {vert_buf.buf};
+    constexpr VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd_buf, 0, 1, vert_bufs, offsets);
+
+    vkCmdBindIndexBuffer(cmd_buf, index_buf.buf, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, parity_pipe_layout, 0, 1, &parity_desc_set, 0,
+                            nullptr);
+
+    // a single axis is always z, three axes are stored in slots 0, 1, 2
+    const auto axis_tri_count = static_cast<uint32_t>(indices_count / 3);
+    for (uint32_t tri = first_tri; tri < first_tri + tri_count;) {
+        const uint32_t slot = tri / axis_tri_count;
+        const uint32_t slot_first = tri % axis_tri_count;
+        const uint32_t slot_count = std::min(first_tri + tri_count - tri, axis_tri_count - slot_first);
+
+        VCW_ParityPushConstants parity_const{};
+        parity_const.view_proj = chunk_module.proj;
+        parity_const.axis = params.solid_axes == 1 ? 2 : slot;
+        parity_const.slot = slot;
+        parity_const.res = params.chunk_res;
+        parity_const.word_count = parity_word_count;
+
+        vkCmdPushConstants(cmd_buf, parity_pipe_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                           sizeof(VCW_ParityPushConstants), &parity_const);
+        vkCmdDrawIndexed(cmd_buf, 3 * slot_count, 1, 3 * slot_first, 0, 0);
+        tri += slot_count;
+    }
+
+    vkCmdEndRenderPass(cmd_buf);
+}
+
+// the parity passes were drawn by the batches of render()
+void App::record_solid_fill(VkCommandBuffer cmd_buf) {
+    VCW_SolidPushConstants solid_const{};
+    solid_const.res = params.chunk_res;
+    solid_const.word_count = parity_word_count;
+    solid_const.axis_count = params.solid_axes;
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    const uint32_t column_groups = div_ceil(params.chunk_res, 8);
+    dispatch_comp(cmd_buf, solid_scan_pipe, column_groups, column_groups, params.solid_axes, &solid_const);
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    dispatch_comp(cmd_buf, solid_fill_pipe, column_groups, column_groups, div_ceil(params.chunk_res, 2),
+                  &solid_const);
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+void App::clean_up_solid() const {
+    clean_up_comp_pipe(solid_scan_pipe);
+    clean_up_comp_pipe(solid_fill_pipe);
+
+    vkDestroyPipeline(dev, parity_pipe, nullptr);
+    vkDestroyPipelineLayout(dev, parity_pipe_layout, nullptr);
+    vkDestroyDescriptorPool(dev, parity_desc_pool, nullptr);
+    vkDestroyDescriptorSetLayout(dev, parity_desc_set_layout, nullptr);
+
+    clean_up_img(parity_img);
+}
@@ -0,0 +1,82 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "app.h"
+
+// voxel statistics are reduced on the device by stats.comp and read back ahead of the grid, so the host never has to
+// scan the dense grid to count voxels.
+
+void App::create_stats_bufs() {
+    stats_buf = create_buf(sizeof(VCW_VoxelStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    stats_transfer_buf = create_buf(sizeof(VCW_VoxelStats), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+void App::create_stats_pipe() {
+    // without subgroup arithmetic a workgroup reduces through shared memory
+    std::vector<std::string> defines;
+    if (check_phy_dev_subgroup_support(phy_dev))
+        defines.emplace_back("SUBGROUP_ARITHMETIC");
+
+    stats_pipe = create_comp_pipe("stats.comp", {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER},
+                                  0, defines);
+    write_comp_img_binding(stats_pipe, render_target, 0);
+    write_comp_buf_binding(stats_pipe, stats_buf, 1);
+}
+
+// has to be recorded before rendering, resets the counters and the aabb
+void App::record_stats_reset(VkCommandBuffer cmd_buf) const {
+    vkCmdFillBuffer(cmd_buf, stats_buf.buf, 0, offsetof(VCW_VoxelStats, aabb_min), 0);
+    vkCmdFillBuffer(cmd_buf, stats_buf.buf, offsetof(VCW_VoxelStats, aabb_min), sizeof(VCW_VoxelStats::aabb_min),
+                    0xFFFFFFFF);
+    vkCmdFillBuffer(cmd_buf, stats_buf.buf, offsetof(VCW_VoxelStats, aabb_max),
+                    sizeof(VCW_VoxelStats) - offsetof(VCW_VoxelStats, aabb_max), 0);
+}
+
+// reduces the render target and copies the result to stats_transfer_buf
+void App::record_stats(VkCommandBuffer cmd_buf) {
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    const uint32_t group_count = div_ceil(tile_res, 8);
+    dispatch_comp(cmd_buf, stats_pipe, group_count, group_count, group_count);
+
+    comp_memory_barrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkBufferCopy cp_region{};
+    cp_region.size = stats_buf.size;
+    vkCmdCopyBuffer(cmd_buf, stats_buf.buf, stats_transfer_buf.buf, 1, &cp_region);
+}
+
+void App::read_stats() {
+    TRACE_SCOPE(__func__);
+    cp_data_from_buf(&stats_transfer_buf, &vox_stats);
+}
+
+void App::print_stats() const {
+    *p_log << "voxel count: " << vox_stats.vox_count << std::endl;
+
+    if (vox_stats.vox_count == 0)
+        return;
+
+    *p_log << "occupied aabb: (" << vox_stats.aabb_min[0] << ", " << vox_stats.aabb_min[1] << ", "
+           << vox_stats.aabb_min[2] << ") - (" << vox_stats.aabb_max[0] << ", " << vox_stats.aabb_max[1] << ", "
+           << vox_stats.aabb_max[2] << ")" << std::endl;
+
+    for (uint32_t i = 1; i < STATS_VALUE_COUNT; i++) {
+        if (vox_stats.value_counts[i] > 0)
+            *p_log << "voxels with value " << i << ": " << vox_stats.value_counts[i] << std::endl;
+    }
+}
+
+void App::clean_up_stats() const {
+    clean_up_comp_pipe(stats_pipe);
+
+    clean_up_buf(stats_buf);
+    clean_up_buf(stats_transfer_buf);
+}
@@ -0,0 +1,88 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "trace.h"
+#include "util.h"
+
+#include <iomanip>
+#include <mutex>
+
+#define TRACE_CPU_PID 1
+#define TRACE_GPU_PID 2
+
+struct TraceEvent {
+    std::string name;
+    uint32_t pid;
+    uint32_t tid;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+std::atomic<bool> trace_active = false;
+
+static std::mutex trace_mutex;
+static std::vector<TraceEvent> trace_events;
+static int64_t trace_origin_ns = 0;
+
+// small sequential ids instead of the native thread ids, in order of the first event of every thread
+static uint32_t trace_tid() {
+    static std::atomic<uint32_t> next_tid = 0;
+    thread_local const uint32_t tid = next_tid++;
+    return tid;
+}
+
+int64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(TraceClock::now().time_since_epoch()).count();
+}
+
+void trace_begin() {
+    // the thread that starts the trace gets the first id
+    trace_tid();
+
+    std::lock_guard lock(trace_mutex);
+    trace_events.clear();
+    trace_origin_ns = trace_now_ns();
+    trace_active = true;
+}
+
+void trace_cpu_span(const char *name, const int64_t begin_ns, const int64_t end_ns) {
+    const uint32_t tid = trace_tid();
+
+    std::lock_guard lock(trace_mutex);
+    trace_events.push_back({name, TRACE_CPU_PID, tid, begin_ns, end_ns});
+}
+
+void trace_gpu_span(const std::string &name, const int64_t begin_ns, const int64_t end_ns) {
+    std::lock_guard lock(trace_mutex);
+    trace_events.push_back({name, TRACE_GPU_PID, 0, begin_ns, end_ns});
+}
+
+void trace_end(const std::string &filename) {
+    if (!trace_enabled())
+        return;
+    trace_active = false;
+
+    std::lock_guard lock(trace_mutex);
+
+    // timestamps are in us relative to trace_begin
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    json << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << TRACE_CPU_PID
+         << ", \"args\": {\"name\": \"cpu\"}},\n";
+    json << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << TRACE_GPU_PID
+         << ", \"args\": {\"name\": \"gpu\"}}";
+
+    for (const auto &event: trace_events) {
+        json << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": " << event.pid << ", \"tid\": "
+             << event.tid << ", \"ts\": " << static_cast<double>(event.begin_ns - trace_origin_ns) / 1000.0
+             << ", \"dur\": " << static_cast<double>(event.end_ns - event.begin_ns) / 1000.0 << "}";
+    }
+    json << "\n]}\n";
+
+    const std::string data = json.str();
+    write_file(filename, data.data(), static_cast<std::streamsize>(data.size()));
+
+    trace_events.clear();
+}
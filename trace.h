@@ -0,0 +1,57 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "inc.h"
+
+#ifndef VCW_TRACE_H
+#define VCW_TRACE_H
+
+// trace export: scoped cpu markers and gpu spans are collected in memory and written as chrome trace event json,
+// which opens in perfetto. until trace_begin is called a marker costs one relaxed atomic load.
+
+// the host timeline of the trace, also the clock gpu timestamps are calibrated against
+using TraceClock = std::chrono::steady_clock;
+
+extern std::atomic<bool> trace_active;
+
+inline bool trace_enabled() {
+    return trace_active.load(std::memory_order_relaxed);
+}
+
+void trace_begin();
+
+// ns on the TraceClock timeline
+int64_t trace_now_ns();
+
+void trace_cpu_span(const char *name, int64_t begin_ns, int64_t end_ns);
+
+void trace_gpu_span(const std::string &name, int64_t begin_ns, int64_t end_ns);
+
+// writes everything collected since trace_begin and stops tracing
+void trace_end(const std::string &filename);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : name(name), begin_ns(trace_enabled() ? trace_now_ns() : -1) {
+    }
+
+    ~TraceScope() {
+        if (begin_ns >= 0)
+            trace_cpu_span(name, begin_ns, trace_now_ns());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    int64_t begin_ns;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) const TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif //VCW_TRACE_H
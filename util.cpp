@@ -4,6 +4,14 @@
 
 #include "util.h"
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 template std::vector<char> read_file<char>(const std::string &);
 
 template std::vector<uint8_t> read_file<uint8_t>(const std::string &);
@@ -71,4 +79,109 @@ float max_component(const glm::vec3 v) {
 
 float max_component(const glm::vec4 v) {
     return std::max(v.x, std::max(v.y, std::max(v.z, v.w)));
+}
+
+uint32_t div_ceil(const uint32_t num, const uint32_t denom) {
+    return (num + denom - 1) / denom;
+}
+
+uint32_t next_pow2(uint32_t v) {
+    if (v <= 1)
+        return 1;
+
+    v--;
+    v |= v >> 1;
+    v |= v >> 2;
+    v |= v >> 4;
+    v |= v >> 8;
+    v |= v >> 16;
+    return v + 1;
+}
+
+// peak resident set size of the process in bytes, 0 if the platform does not report it
+size_t get_peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    // kilobytes on linux
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// memory the os can hand out without swapping in bytes, 0 if the platform does not report it
+size_t get_available_host_mem() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status{};
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status))
+        return 0;
+    return static_cast<size_t>(status.ullAvailPhys);
+#elif defined(__linux__)
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        // in kilobytes
+        if (line.rfind("MemAvailable:", 0) == 0)
+            return static_cast<size_t>(std::stoull(line.substr(strlen("MemAvailable:")))) * 1024;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+// reorders a linear res^3 grid into the order of morton_encode_3d_grid without a second grid. every cycle of the
+// permutation is followed once, a bit per voxel marks the ones that are already in place.
+void morton_order_grid(uint8_t *p_grid, const uint32_t res) {
+    const uint64_t size = static_cast<uint64_t>(res) * res * res;
+    std::vector<uint64_t> placed((size + 63) / 64);
+
+    for (uint64_t start = 0; start < size; start++) {
+        if (placed[start / 64] == UINT64_MAX) {
+            start |= 63;
+            continue;
+        }
+        if (placed[start / 64] >> (start % 64) & 1)
+            continue;
+
+        // carries the value of index to its destination until the cycle is back at start
+        uint8_t value = p_grid[start];
+        uint64_t index = start;
+        do {
+            const auto x = static_cast<uint32_t>(index % res);
+            const auto y = static_cast<uint32_t>(index / res % res);
+            const auto z = static_cast<uint32_t>(index / (static_cast<uint64_t>(res) * res));
+
+            index = morton_rank(x, y, z, res);
+            std::swap(value, p_grid[index]);
+            placed[index / 64] |= 1ull << (index % 64);
+        } while (index != start);
+    }
+}
+
+std::string json_escape(const std::string &string) {
+    std::string escaped;
+    for (const char c: string) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 //
 
 #include "inc.h"
+#include "morton.h"
 
 #ifndef VCW_UTIL_H
 #define VCW_UTIL_H
@@ -24,4 +25,46 @@ float max_component(glm::vec3 v);
 
 float max_component(glm::vec4 v);
 
+uint32_t div_ceil(uint32_t num, uint32_t denom);
+
+uint32_t next_pow2(uint32_t v);
+
+size_t get_peak_rss();
+
+size_t get_available_host_mem();
+
+void morton_order_grid(uint8_t *p_grid, uint32_t res);
+
+// for strings inside of json output
+std::string json_escape(const std::string &string);
+
+// drops everything written to it, for muted progress output. the state of a stream on it never changes, unlike one
+// without a buffer, so several threads can write to the same stream.
+class NullStreamBuf : public std::streambuf {
+protected:
+    int overflow(const int c) override {
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *, const std::streamsize count) override {
+        return count;
+    }
+};
+
+// runs func(thread, begin, end) on thread_count equally sized ranges of [0, n)
+template<typename Func>
+void parallel_ranges(const uint32_t n, const uint32_t thread_count, Func func) {
+    const uint32_t range = (n + thread_count - 1) / thread_count;
+
+    std::vector<std::future<void>> tasks;
+    for (uint32_t thread = 0; thread < thread_count; thread++) {
+        const uint32_t begin = std::min(n, thread * range);
+        const uint32_t end = std::min(n, begin + range);
+        tasks.push_back(std::async(std::launch::async, func, thread, begin, end));
+    }
+
+    for (auto &task: tasks)
+        task.get();
+}
+
 #endif //VCW_UTIL_H
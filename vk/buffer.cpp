@@ -17,6 +17,12 @@ uint32_t App::find_mem_type(const uint32_t type_filter, const VkMemoryPropertyFl
     throw std::runtime_error("failed to find suitable memory type.");
 }
 
+void App::track_dev_mem_alloc(const VkDeviceSize size) const {
+    dev_mem_allocated += size;
+    dev_mem_in_use += size;
+    dev_mem_peak = std::max(dev_mem_peak, dev_mem_in_use);
+}
+
 VCW_Buffer App::create_buf(const VkDeviceSize size, const VkBufferUsageFlags usage,
                            const VkMemoryPropertyFlags mem_props) const {
     VCW_Buffer buf{};
@@ -45,6 +51,9 @@ VCW_Buffer App::create_buf(const VkDeviceSize size, const VkBufferUsageFlags usa
 
     vkBindBufferMemory(dev, buf.buf, buf.mem, 0);
 
+    buf.mem_size = mem_reqs.size;
+    track_dev_mem_alloc(buf.mem_size);
+
     return buf;
 }
 
@@ -61,6 +70,7 @@ void App::unmap_buf(VCW_Buffer *p_buf) const {
 }
 
 void App::cp_data_to_buf(VCW_Buffer *p_buf, const void *p_data) const {
+    TRACE_SCOPE(__func__);
     if (p_buf == nullptr || p_data == nullptr)
         throw std::invalid_argument("cannot copy data from buffer, argument is nullptr.");
 
@@ -70,16 +80,20 @@ void App::cp_data_to_buf(VCW_Buffer *p_buf, const void *p_data) const {
 }
 
 void App::cp_data_from_buf(VCW_Buffer *p_buf, void *p_data) const {
+    TRACE_SCOPE(__func__);
     if (p_buf == nullptr || p_data == nullptr)
         throw std::invalid_argument("cannot copy data from buffer, argument is nullptr.");
 
     map_buf(p_buf);
     memcpy(p_data, p_buf->p_mapped_mem, p_buf->size);
     unmap_buf(p_buf);
+
+    readback_bytes += p_buf->size;
 }
 
 // allocates new command buffers
 void App::cp_buf(const VCW_Buffer &src_buf, const VCW_Buffer &dst_buf) {
+    TRACE_SCOPE(__func__);
     if (src_buf.size != dst_buf.size)
         throw std::invalid_argument("src buffer size is not equal to dst buffer size.");
 
@@ -112,4 +126,6 @@ void App::buffer_memory_barrier(VkCommandBuffer cmd_buf, VCW_Buffer *p_buf, cons
 void App::clean_up_buf(const VCW_Buffer &buf) const {
     vkDestroyBuffer(dev, buf.buf, nullptr);
     vkFreeMemory(dev, buf.mem, nullptr);
+
+    dev_mem_in_use -= buf.mem_size;
 }
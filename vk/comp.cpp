@@ -0,0 +1,174 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "../app.h"
+
+VCW_ComputePipe App::create_comp_pipe(const std::string &shader_file, const std::vector<VkDescriptorType> &desc_types,
+                                      const uint32_t push_const_size, const std::vector<std::string> &defines,
+                                      const uint32_t set_count) {
+    TRACE_SCOPE(__func__);
+    VCW_ComputePipe comp_pipe{};
+    comp_pipe.push_const_size = push_const_size;
+
+    //
+    // set_count descriptor sets, one binding per entry in desc_types
+    //
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (uint32_t i = 0; i < desc_types.size(); i++) {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = i;
+        binding.descriptorCount = 1;
+        binding.descriptorType = desc_types[i];
+        binding.pImmutableSamplers = nullptr;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings.push_back(binding);
+
+        VkDescriptorPoolSize pool_size;
+        pool_size.type = desc_types[i];
+        pool_size.descriptorCount = set_count;
+        pool_sizes.push_back(pool_size);
+    }
+
+    VkDescriptorSetLayoutCreateInfo desc_set_layout_info{};
+    desc_set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    desc_set_layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    desc_set_layout_info.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(dev, &desc_set_layout_info, nullptr, &comp_pipe.desc_set_layout) != VK_SUCCESS)
+        throw std::runtime_error("failed to create compute descriptor set layout.");
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = set_count;
+
+    if (vkCreateDescriptorPool(dev, &pool_info, nullptr, &comp_pipe.desc_pool) != VK_SUCCESS)
+        throw std::runtime_error("failed to create compute descriptor pool.");
+
+    const std::vector<VkDescriptorSetLayout> set_layouts(set_count, comp_pipe.desc_set_layout);
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = comp_pipe.desc_pool;
+    alloc_info.descriptorSetCount = set_count;
+    alloc_info.pSetLayouts = set_layouts.data();
+
+    comp_pipe.desc_sets.resize(set_count);
+    if (vkAllocateDescriptorSets(dev, &alloc_info, comp_pipe.desc_sets.data()) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate compute descriptor set.");
+
+    //
+    // pipeline
+    //
+    *p_log << "compiling compute shader " << shader_file << "." << std::endl;
+    std::string comp_code = read_file_string("shaders/" + shader_file);
+    std::vector<uint32_t> comp_bin = compile_shader(comp_code, shaderc_glsl_compute_shader, "main", defines);
+    VkShaderModule comp_module = create_shader_mod(comp_bin);
+
+    VkPipelineShaderStageCreateInfo comp_stage_info{};
+    comp_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    comp_stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    comp_stage_info.module = comp_module;
+    comp_stage_info.pName = "main";
+
+    VkPushConstantRange push_const_range{};
+    push_const_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_const_range.offset = 0;
+    push_const_range.size = push_const_size;
+
+    VkPipelineLayoutCreateInfo pipe_layout_info{};
+    pipe_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipe_layout_info.setLayoutCount = 1;
+    pipe_layout_info.pSetLayouts = &comp_pipe.desc_set_layout;
+    pipe_layout_info.pushConstantRangeCount = push_const_size > 0 ? 1 : 0;
+    pipe_layout_info.pPushConstantRanges = push_const_size > 0 ? &push_const_range : nullptr;
+
+    if (vkCreatePipelineLayout(dev, &pipe_layout_info, nullptr, &comp_pipe.pipe_layout) != VK_SUCCESS)
+        throw std::runtime_error("failed to create compute pipeline layout.");
+
+    VkComputePipelineCreateInfo pipe_info{};
+    pipe_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipe_info.stage = comp_stage_info;
+    pipe_info.layout = comp_pipe.pipe_layout;
+    pipe_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(dev, get_pipe_cache(), 1, &pipe_info, nullptr, &comp_pipe.pipe) != VK_SUCCESS)
+        throw std::runtime_error("failed to create compute pipeline.");
+
+    vkDestroyShaderModule(dev, comp_module, nullptr);
+
+    return comp_pipe;
+}
+
+void App::write_comp_buf_binding(const VCW_ComputePipe &comp_pipe, const VCW_Buffer &buf,
+                                 const uint32_t dst_binding, const uint32_t set) const {
+    VkDescriptorBufferInfo buf_info{};
+    buf_info.buffer = buf.buf;
+    buf_info.offset = 0;
+    buf_info.range = buf.size;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = comp_pipe.desc_sets[set];
+    write.dstBinding = dst_binding;
+    write.dstArrayElement = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.descriptorCount = 1;
+    write.pBufferInfo = &buf_info;
+
+    vkUpdateDescriptorSets(dev, 1, &write, 0, nullptr);
+}
+
+void App::write_comp_img_binding(const VCW_ComputePipe &comp_pipe, const VCW_Image &img,
+                                 const uint32_t dst_binding, const uint32_t set) const {
+    VkDescriptorImageInfo img_info{};
+    img_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    img_info.imageView = img.view;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = comp_pipe.desc_sets[set];
+    write.dstBinding = dst_binding;
+    write.dstArrayElement = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.descriptorCount = 1;
+    write.pImageInfo = &img_info;
+
+    vkUpdateDescriptorSets(dev, 1, &write, 0, nullptr);
+}
+
+void App::dispatch_comp(VkCommandBuffer cmd_buf, const VCW_ComputePipe &comp_pipe, const uint32_t group_count_x,
+                        const uint32_t group_count_y, const uint32_t group_count_z, const void *p_push_const,
+                        const uint32_t set) {
+    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, comp_pipe.pipe);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, comp_pipe.pipe_layout, 0, 1,
+                            &comp_pipe.desc_sets[set], 0, nullptr);
+
+    if (p_push_const != nullptr && comp_pipe.push_const_size > 0)
+        vkCmdPushConstants(cmd_buf, comp_pipe.pipe_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, comp_pipe.push_const_size,
+                           p_push_const);
+
+    vkCmdDispatch(cmd_buf, group_count_x, group_count_y, group_count_z);
+}
+
+// global memory barrier, makes all shader / transfer writes visible to the next stage
+void App::comp_memory_barrier(VkCommandBuffer cmd_buf, const VkPipelineStageFlags src_stage,
+                              const VkPipelineStageFlags dst_stage) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                            VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd_buf, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void App::clean_up_comp_pipe(const VCW_ComputePipe &comp_pipe) const {
+    vkDestroyPipeline(dev, comp_pipe.pipe, nullptr);
+    vkDestroyPipelineLayout(dev, comp_pipe.pipe_layout, nullptr);
+    vkDestroyDescriptorPool(dev, comp_pipe.desc_pool, nullptr);
+    vkDestroyDescriptorSetLayout(dev, comp_pipe.desc_set_layout, nullptr);
+}
@@ -21,7 +21,7 @@ VCW_QueueFamilyIndices App::find_qf(VkPhysicalDevice loc_phy_dev) const {
 
     int i = 0;
     for (const auto &qf: loc_qf_props) {
-        if (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT && qf.timestampValidBits)
+        if (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT && qf.queueFlags & VK_QUEUE_COMPUTE_BIT && qf.timestampValidBits)
             loc_qf_indices.qf_graph = i;
 
         if (loc_qf_indices.is_complete())
@@ -48,6 +48,119 @@ bool App::check_phy_dev_ext_support(VkPhysicalDevice loc_phy_dev) {
     return required_exts.empty();
 }
 
+// the gpu clock can be sampled together with the clock of the trace, which is CLOCK_MONOTONIC on linux. on windows the
+// trace clock is not available as a calibrateable domain and the fallback of calibrate_gpu_clock is used.
+bool App::check_phy_dev_calibrated_timestamps(VkPhysicalDevice loc_phy_dev) const {
+#ifdef _WIN32
+    return false;
+#else
+    uint32_t ext_count;
+    vkEnumerateDeviceExtensionProperties(loc_phy_dev, nullptr, &ext_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_exts(ext_count);
+    vkEnumerateDeviceExtensionProperties(loc_phy_dev, nullptr, &ext_count, available_exts.data());
+
+    if (std::none_of(available_exts.begin(), available_exts.end(), [](const VkExtensionProperties &ext) {
+        return strcmp(ext.extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0;
+    }))
+        return false;
+
+    const auto get_time_domains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            vkGetInstanceProcAddr(inst, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (get_time_domains == nullptr)
+        return false;
+
+    uint32_t domain_count = 0;
+    get_time_domains(loc_phy_dev, &domain_count, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domain_count);
+    get_time_domains(loc_phy_dev, &domain_count, domains.data());
+
+    return std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end() &&
+           std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) != domains.end();
+#endif
+}
+
+// 64 bit buffer atomics are needed by the hash engine
+bool App::check_phy_dev_int64_atomics(VkPhysicalDevice loc_phy_dev) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+
+    if (props.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceVulkan12Features features_12{};
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features_12;
+    vkGetPhysicalDeviceFeatures2(loc_phy_dev, &features);
+
+    return features.features.shaderInt64 && features_12.shaderBufferInt64Atomics;
+}
+
+// subgroup arithmetic in compute shaders, stats.comp reduces through shared memory without it
+bool App::check_phy_dev_subgroup_support(VkPhysicalDevice loc_phy_dev) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+
+    if (props.apiVersion < VK_API_VERSION_1_1)
+        return false;
+
+    VkPhysicalDeviceSubgroupProperties subgroup_props{};
+    subgroup_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 props_2{};
+    props_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props_2.pNext = &subgroup_props;
+    vkGetPhysicalDeviceProperties2(loc_phy_dev, &props_2);
+
+    constexpr VkSubgroupFeatureFlags required_ops = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+
+    return (subgroup_props.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+           (subgroup_props.supportedOperations & required_ops) == required_ops;
+}
+
+// the texture array in shader.frag is indexed by material, which is not uniform within a draw
+bool App::check_phy_dev_nonuniform_indexing(VkPhysicalDevice loc_phy_dev) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+
+    // the features are queried and enabled through VkPhysicalDeviceVulkan12Features
+    if (props.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceVulkan12Features features_12{};
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features_12;
+    vkGetPhysicalDeviceFeatures2(loc_phy_dev, &features);
+
+    return features.features.shaderSampledImageArrayDynamicIndexing &&
+           features_12.shaderSampledImageArrayNonUniformIndexing;
+}
+
+// heap budget and usage of the whole system, only queried by the memory budget and never enabled
+bool App::check_phy_dev_memory_budget(VkPhysicalDevice loc_phy_dev) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+
+    if (props.apiVersion < VK_API_VERSION_1_1)
+        return false;
+
+    uint32_t ext_count;
+    vkEnumerateDeviceExtensionProperties(loc_phy_dev, nullptr, &ext_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_exts(ext_count);
+    vkEnumerateDeviceExtensionProperties(loc_phy_dev, nullptr, &ext_count, available_exts.data());
+
+    return std::any_of(available_exts.begin(), available_exts.end(), [](const VkExtensionProperties &ext) {
+        return strcmp(ext.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    });
+}
+
 bool App::is_phy_dev_suitable(VkPhysicalDevice loc_phy_dev) const {
     VCW_QueueFamilyIndices loc_qf_indices = find_qf(loc_phy_dev);
 
@@ -56,35 +169,117 @@ bool App::is_phy_dev_suitable(VkPhysicalDevice loc_phy_dev) const {
     VkPhysicalDeviceFeatures features;
     vkGetPhysicalDeviceFeatures(loc_phy_dev, &features);
 
+    if (params.engine == ENGINE_HASH && !check_phy_dev_int64_atomics(loc_phy_dev))
+        return false;
+
+    if (params.use_textures && !check_phy_dev_nonuniform_indexing(loc_phy_dev))
+        return false;
+
     return loc_qf_indices.is_complete() && exts_supported
            && features.samplerAnisotropy && features.geometryShader
            && features.fragmentStoresAndAtomics && features.vertexPipelineStoresAndAtomics;
 }
 
-void App::pick_phy_dev() {
+// discrete gpus first, then integrated ones, virtual ones and cpu implementations
+static uint32_t get_dev_type_rank(const VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return 0;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return 1;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+// size of the largest device local heap
+static VkDeviceSize get_dev_local_mem(VkPhysicalDevice loc_phy_dev) {
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(loc_phy_dev, &mem_props);
+
+    VkDeviceSize size = 0;
+    for (uint32_t i = 0; i < mem_props.memoryHeapCount; i++) {
+        if (mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            size = std::max(size, mem_props.memoryHeaps[i].size);
+    }
+    return size;
+}
+
+// every suitable device ranked by type and then by device local memory, the order of the driver breaks ties
+std::vector<VkPhysicalDevice> App::get_suitable_phy_devs() const {
     uint32_t phy_dev_count = 0;
     vkEnumeratePhysicalDevices(inst, &phy_dev_count, nullptr);
 
-    if (phy_dev_count == 0)
-        throw std::runtime_error("failed to find GPU with Vulkan support.");
-
     std::vector<VkPhysicalDevice> phy_devs(phy_dev_count);
     vkEnumeratePhysicalDevices(inst, &phy_dev_count, phy_devs.data());
 
-    for (const auto &possible_dev: phy_devs) {
-        if (is_phy_dev_suitable(possible_dev)) {
-            phy_dev = possible_dev;
-            break;
-        }
-    }
+    std::erase_if(phy_devs, [this](VkPhysicalDevice possible_dev) {
+        return !is_phy_dev_suitable(possible_dev);
+    });
+
+    const auto rank = [](VkPhysicalDevice loc_phy_dev) {
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(loc_phy_dev, &props);
+        return std::make_pair(get_dev_type_rank(props.deviceType), get_dev_local_mem(loc_phy_dev));
+    };
+
+    std::stable_sort(phy_devs.begin(), phy_devs.end(), [&](VkPhysicalDevice a, VkPhysicalDevice b) {
+        const auto rank_a = rank(a);
+        const auto rank_b = rank(b);
+        if (rank_a.first != rank_b.first)
+            return rank_a.first < rank_b.first;
+        return rank_a.second > rank_b.second;
+    });
+
+    return phy_devs;
+}
+
+void App::pick_phy_dev() {
+    uint32_t phy_dev_count = 0;
+    vkEnumeratePhysicalDevices(inst, &phy_dev_count, nullptr);
 
-    if (phy_dev == VK_NULL_HANDLE)
+    if (phy_dev_count == 0)
+        throw std::runtime_error("failed to find GPU with Vulkan support.");
+
+    const std::vector<VkPhysicalDevice> phy_devs = get_suitable_phy_devs();
+    if (phy_devs.empty() && params.use_textures)
+        throw std::runtime_error("failed to find a suitable GPU, textures need Vulkan 1.2 with non-uniform indexing "
+                                 "of sampled image arrays.");
+    if (phy_devs.empty())
         throw std::runtime_error("failed to find a suitable GPU.");
 
+    phy_dev = phy_devs.front();
+
     vkGetPhysicalDeviceMemoryProperties(phy_dev, &phy_dev_mem_props);
     vkGetPhysicalDeviceProperties(phy_dev, &phy_dev_props);
 }
 
+// creates a throwaway instance to check for a gpu the current engine can run on
+bool App::has_suitable_phy_dev() {
+    try {
+        create_inst();
+    } catch (const std::exception &) {
+        return false;
+    }
+
+    uint32_t phy_dev_count = 0;
+    vkEnumeratePhysicalDevices(inst, &phy_dev_count, nullptr);
+    std::vector<VkPhysicalDevice> phy_devs(phy_dev_count);
+    vkEnumeratePhysicalDevices(inst, &phy_dev_count, phy_devs.data());
+
+    const bool found = std::any_of(phy_devs.begin(), phy_devs.end(), [this](VkPhysicalDevice possible_dev) {
+        return is_phy_dev_suitable(possible_dev);
+    });
+
+    vkDestroyInstance(inst, nullptr);
+    inst = VK_NULL_HANDLE;
+    return found;
+}
+
 void App::create_dev() {
     qf_indices = find_qf(phy_dev);
 
@@ -107,16 +302,37 @@ void App::create_dev() {
     dev_features.fragmentStoresAndAtomics = VK_TRUE;
     dev_features.vertexPipelineStoresAndAtomics = VK_TRUE;
 
+    VkPhysicalDeviceVulkan12Features features_12{};
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
     VkDeviceCreateInfo dev_info{};
     dev_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+    if (params.engine == ENGINE_HASH) {
+        dev_features.shaderInt64 = VK_TRUE;
+        features_12.shaderBufferInt64Atomics = VK_TRUE;
+        dev_info.pNext = &features_12;
+    }
+
+    if (params.use_textures) {
+        dev_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        features_12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        dev_info.pNext = &features_12;
+    }
+
     dev_info.queueCreateInfoCount = static_cast<uint32_t>(queue_infos.size());
     dev_info.pQueueCreateInfos = queue_infos.data();
 
     dev_info.pEnabledFeatures = &dev_features;
 
-    dev_info.enabledExtensionCount = static_cast<uint32_t>(dev_exts.size());
-    dev_info.ppEnabledExtensionNames = dev_exts.data();
+    // only needed to align the gpu timeline of a trace
+    std::vector<const char *> exts = dev_exts;
+    calibrated_timestamps = trace_enabled() && check_phy_dev_calibrated_timestamps(phy_dev);
+    if (calibrated_timestamps)
+        exts.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    dev_info.enabledExtensionCount = static_cast<uint32_t>(exts.size());
+    dev_info.ppEnabledExtensionNames = exts.data();
 
 #ifdef VALIDATION
     dev_info.enabledLayerCount = static_cast<uint32_t>(val_layers.size());
@@ -131,3 +347,24 @@ void App::create_dev() {
     qf_props = get_qf_props(phy_dev);
     vkGetDeviceQueue(dev, qf_indices.qf_graph.value(), 0, &q_graph);
 }
+
+void VCW_DeviceContext::clean_up() {
+    if (pipe_cache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(dev, pipe_cache, nullptr);
+    if (dev != VK_NULL_HANDLE)
+        vkDestroyDevice(dev, nullptr);
+
+#ifdef VALIDATION
+    if (inst != VK_NULL_HANDLE)
+        destroy_debug_callback(inst, debug_msg, nullptr);
+#endif
+
+    if (inst != VK_NULL_HANDLE)
+        vkDestroyInstance(inst, nullptr);
+
+    inst = VK_NULL_HANDLE;
+    phy_dev = VK_NULL_HANDLE;
+    dev = VK_NULL_HANDLE;
+    pipe_cache = VK_NULL_HANDLE;
+    shader_cache.clear();
+}
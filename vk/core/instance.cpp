@@ -26,7 +26,7 @@ void App::create_inst() {
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = ENGINE_NAME;
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    app_info.apiVersion = VK_API_VERSION_1_2;
 
     VkInstanceCreateInfo inst_info{};
     inst_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -32,17 +32,19 @@ bool App::has_stencil_component(const VkFormat format) {
 }
 
 VCW_Image App::create_img(const VkExtent2D extent, const VkFormat format, const VkImageUsageFlags usage,
-                          const VkMemoryPropertyFlags mem_props, const VkImageTiling tiling) const {
+                          const VkMemoryPropertyFlags mem_props, const VkImageTiling tiling,
+                          const uint32_t mip_levels) const {
     VkExtent3D extent_3d = {extent.width, extent.height, 1};
-    return create_img(extent_3d, format, usage, mem_props, tiling, VK_IMAGE_TYPE_2D);
+    return create_img(extent_3d, format, usage, mem_props, tiling, VK_IMAGE_TYPE_2D, mip_levels);
 }
 
 VCW_Image App::create_img(const VkExtent3D extent, const VkFormat format, const VkImageUsageFlags usage,
                           const VkMemoryPropertyFlags mem_props, const VkImageTiling tiling,
-                          const VkImageType img_type) const {
+                          const VkImageType img_type, const uint32_t mip_levels) const {
     VCW_Image img{};
     img.format = format;
     img.extent = extent;
+    img.mip_levels = mip_levels;
     img.cur_layout = VK_IMAGE_LAYOUT_UNDEFINED;
     img.cur_access_mask = 0;
 
@@ -50,7 +52,7 @@ VCW_Image App::create_img(const VkExtent3D extent, const VkFormat format, const
     img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     img_info.imageType = img_type;
     img_info.extent = img.extent;
-    img_info.mipLevels = 1;
+    img_info.mipLevels = img.mip_levels;
     img_info.arrayLayers = 1;
     img_info.format = img.format;
     img_info.tiling = tiling;
@@ -75,6 +77,9 @@ VCW_Image App::create_img(const VkExtent3D extent, const VkFormat format, const
 
     vkBindImageMemory(dev, img.img, img.mem, 0);
 
+    img.mem_size = mem_reqs.size;
+    track_dev_mem_alloc(img.mem_size);
+
     return img;
 }
 
@@ -121,6 +126,8 @@ VkSampler App::create_sampler(const VkFilter filter, const VkSamplerAddressMode
     sampler_info.compareEnable = VK_FALSE;
     sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
     sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
 
     VkSampler sampler;
     if (vkCreateSampler(dev, &sampler_info, nullptr, &sampler) != VK_SUCCESS)
@@ -176,6 +183,7 @@ void App::transition_img_layout(VkCommandBuffer cmd_buf, VCW_Image *p_img, const
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.image = p_img->img;
     barrier.subresourceRange = DEFAULT_SUBRESOURCE_RANGE;
+    barrier.subresourceRange.levelCount = p_img->mip_levels;
 
     barrier.srcAccessMask = p_img->cur_access_mask;
     barrier.dstAccessMask = access_mask;
@@ -256,6 +264,60 @@ void App::copy_img(VkCommandBuffer cmd_buf, const VCW_Image &src, const VCW_Imag
                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
 
+// all levels have to be in transfer dst layout with level 0 filled, afterwards all levels are shader read only
+void App::generate_mipmaps(VkCommandBuffer cmd_buf, VCW_Image *p_img) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = p_img->img;
+    barrier.subresourceRange = DEFAULT_SUBRESOURCE_RANGE;
+
+    auto width = static_cast<int32_t>(p_img->extent.width);
+    auto height = static_cast<int32_t>(p_img->extent.height);
+
+    for (uint32_t level = 1; level < p_img->mip_levels; level++) {
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                             0, nullptr, 1, &barrier);
+
+        VkImageBlit region{};
+        region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        region.srcOffsets[1] = {width, height, 1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        region.dstOffsets[1] = {std::max(width / 2, 1), std::max(height / 2, 1), 1};
+
+        vkCmdBlitImage(cmd_buf, p_img->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, p_img->img,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &barrier);
+
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    // last level was only written
+    barrier.subresourceRange.baseMipLevel = p_img->mip_levels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+
+    p_img->cur_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    p_img->cur_access_mask = VK_ACCESS_SHADER_READ_BIT;
+}
+
 void App::clean_up_img(const VCW_Image &img) const {
     if (img.combined_img_sampler)
         vkDestroySampler(dev, img.sampler, nullptr);
@@ -264,4 +326,6 @@ void App::clean_up_img(const VCW_Image &img) const {
 
     vkDestroyImage(dev, img.img, nullptr);
     vkFreeMemory(dev, img.mem, nullptr);
+
+    dev_mem_in_use -= img.mem_size;
 }
@@ -17,11 +17,69 @@ void App::create_rendp() {
         throw std::runtime_error("failed to create render pass.");
 }
 
-std::vector<uint32_t> App::compile_shader(const std::string& source, shaderc_shader_kind kind, const char* entry_point) {
+// resolves #include "name" to shaders/name, where the shaders are read from at runtime
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+    struct Include {
+        std::string name;
+        std::string content;
+        shaderc_include_result result{};
+    };
+
+public:
+    shaderc_include_result *GetInclude(const char *requested_source, shaderc_include_type, const char *,
+                                       size_t) override {
+        auto *p_include = new Include{requested_source};
+        try {
+            p_include->content = read_file_string("shaders/" + p_include->name);
+        } catch (const std::exception &) {
+            // an empty name reports the content as the error
+            p_include->content = "failed to open " + p_include->name + ".";
+            p_include->name.clear();
+        }
+
+        p_include->result.source_name = p_include->name.c_str();
+        p_include->result.source_name_length = p_include->name.size();
+        p_include->result.content = p_include->content.c_str();
+        p_include->result.content_length = p_include->content.size();
+        p_include->result.user_data = p_include;
+        return &p_include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result *p_result) override {
+        delete static_cast<Include *>(p_result->user_data);
+    }
+};
+
+std::vector<uint32_t> App::compile_shader(const std::string &source, shaderc_shader_kind kind, const char *entry_point,
+                                          const std::vector<std::string> &defines) {
+    TRACE_SCOPE(__func__);
+
+    // the library compiles every shader once per device context
+    std::string cache_key;
+    if (p_dev_context != nullptr) {
+        cache_key = std::to_string(kind) + '\0' + entry_point + '\0';
+        for (const auto &define: defines)
+            cache_key += define + '\0';
+        cache_key += source;
+
+        if (const auto it = p_dev_context->shader_cache.find(cache_key); it != p_dev_context->shader_cache.end())
+            return it->second;
+    }
+
     shaderc::Compiler compiler;
     shaderc::CompileOptions options;
     options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
-    options.SetTargetSpirv(shaderc_spirv_version_1_0);
+    options.SetTargetSpirv(shaderc_spirv_version_1_3);
+    options.SetIncluder(std::make_unique<ShaderIncluder>());
+
+    // defines are either NAME or NAME=VALUE
+    for (const auto &define: defines) {
+        const size_t split = define.find('=');
+        if (split == std::string::npos)
+            options.AddMacroDefinition(define);
+        else
+            options.AddMacroDefinition(define.substr(0, split), define.substr(split + 1));
+    }
 
     shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind, entry_point, options);
 
@@ -30,7 +88,15 @@ std::vector<uint32_t> App::compile_shader(const std::string& source, shaderc_sha
         throw std::runtime_error("shader compilation failed.");
     }
 
-    return {result.cbegin(), result.cend()};
+    std::vector<uint32_t> code(result.cbegin(), result.cend());
+    if (p_dev_context != nullptr)
+        p_dev_context->shader_cache[cache_key] = code;
+
+    return code;
+}
+
+VkPipelineCache App::get_pipe_cache() const {
+    return p_dev_context != nullptr ? p_dev_context->pipe_cache : VK_NULL_HANDLE;
 }
 
 VkShaderModule App::create_shader_mod(const std::vector<uint32_t> &code) const {
@@ -40,6 +40,7 @@ VkCommandBuffer App::begin_single_time_cmd() const {
 }
 
 void App::end_single_time_cmd(VkCommandBuffer cmd_buf) const {
+    TRACE_SCOPE(__func__);
     vkEndCommandBuffer(cmd_buf);
 
     VkSubmitInfo submit{};
@@ -79,29 +80,202 @@ void App::create_sync() {
     }
 }
 
+void App::create_query_pool() {
+    VkQueryPoolCreateInfo query_pool_info{};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = QUERY_COUNT;
+
+    if (vkCreateQueryPool(dev, &query_pool_info, nullptr, &query_pool) != VK_SUCCESS)
+        throw std::runtime_error("failed to create query pool.");
+}
+
+void App::record_timestamp(VkCommandBuffer cmd_buf, const uint32_t query,
+                           const VkPipelineStageFlagBits stage) const {
+    vkCmdWriteTimestamp(cmd_buf, stage, query_pool, query);
+}
+
+// the bits of a timestamp that the queue writes, the others are undefined
+uint64_t App::get_timestamp_mask() const {
+    const uint32_t valid_bits = qf_props[qf_indices.qf_graph.value()].timestampValidBits;
+    return valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+}
+
+// waits for the query to be written
+uint64_t App::read_timestamp(const uint32_t query) const {
+    uint64_t timestamp = 0;
+    vkGetQueryPoolResults(dev, query_pool, query, 1, sizeof(uint64_t), &timestamp, sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    return timestamp & get_timestamp_mask();
+}
+
+// gpu time between two written timestamps in ms, negative if the queue does not support timestamps
+double App::get_gpu_time(const uint32_t begin_query, const uint32_t end_query) const {
+    if (qf_props[qf_indices.qf_graph.value()].timestampValidBits == 0)
+        return -1.0;
+
+    // the counter may wrap around between the two within its valid bits
+    const uint64_t begin = read_timestamp(begin_query);
+    const uint64_t end = read_timestamp(end_query);
+    return static_cast<double>((end - begin) & get_timestamp_mask()) * phy_dev_props.limits.timestampPeriod / 1e6;
+}
+
+// offset from gpu timestamps to the trace timeline. VK_EXT_calibrated_timestamps samples both clocks at once,
+// without it a timestamp of an empty submission is matched with the middle of the host wait for it.
+void App::calibrate_gpu_clock() {
+    const double period = phy_dev_props.limits.timestampPeriod;
+
+    if (calibrated_timestamps) {
+        const auto get_calibrated_timestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                vkGetDeviceProcAddr(dev, "vkGetCalibratedTimestampsEXT"));
+
+        VkCalibratedTimestampInfoEXT infos[2]{};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+        uint64_t timestamps[2];
+        uint64_t max_deviation;
+        if (get_calibrated_timestamps != nullptr &&
+            get_calibrated_timestamps(dev, 2, infos, timestamps, &max_deviation) == VK_SUCCESS) {
+            gpu_clock_offset_ns = static_cast<int64_t>(timestamps[1]) -
+                                  static_cast<int64_t>(static_cast<double>(timestamps[0]) * period);
+            return;
+        }
+    }
+
+    VkCommandBuffer cmd_buf = begin_single_time_cmd();
+    vkCmdResetQueryPool(cmd_buf, query_pool, QUERY_CALIBRATE, 1);
+    record_timestamp(cmd_buf, QUERY_CALIBRATE, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    const int64_t submit_ns = trace_now_ns();
+    end_single_time_cmd(cmd_buf);
+    const int64_t done_ns = trace_now_ns();
+
+    gpu_clock_offset_ns = (submit_ns + done_ns) / 2 -
+                          static_cast<int64_t>(static_cast<double>(read_timestamp(QUERY_CALIBRATE)) * period);
+}
+
+// adds the time between two written timestamps to the gpu timeline of the trace
+void App::trace_gpu_queries(const char *name, const uint32_t begin_query, const uint32_t end_query) const {
+    if (!trace_enabled() || qf_props[qf_indices.qf_graph.value()].timestampValidBits == 0)
+        return;
+
+    const double period = phy_dev_props.limits.timestampPeriod;
+    const auto begin_ns = static_cast<int64_t>(static_cast<double>(read_timestamp(begin_query)) * period);
+    const auto end_ns = static_cast<int64_t>(static_cast<double>(read_timestamp(end_query)) * period);
+    trace_gpu_span(name, gpu_clock_offset_ns + begin_ns, gpu_clock_offset_ns + end_ns);
+}
+
+// next batch size from the triangles per ms of the last batch, grows or shrinks by at most a factor of two
+uint32_t App::tune_batch_tris(const uint32_t batch_tris, const uint32_t done_tris, const double batch_time) const {
+    if (params.batch_tris > 0 || batch_time <= 0.0)
+        return batch_tris;
+
+    const double tris_per_ms = static_cast<double>(done_tris) / batch_time;
+    const double target = tris_per_ms * static_cast<double>(params.batch_time_ms);
+
+    const double min_tris = std::max<double>(BATCH_MIN_TRIS, batch_tris / 2.0);
+    const double max_tris = 2.0 * batch_tris;
+    return static_cast<uint32_t>(std::clamp(target, min_tris, max_tris));
+}
+
+// triangles render() draws: the raster ones, then all of them once per axis of the parity passes
+uint32_t App::get_draw_tri_count() const {
+    return raster_tri_count + params.solid_axes * static_cast<uint32_t>(indices_count / 3);
+}
+
+// submits the draws in batches of bounded size, up to MAX_FRAMES_IN_FLIGHT are queued at once. the previous batch is
+// waited on after every submission to report progress, tune the batch size and check for an abort.
 void App::render() {
-    vkWaitForFences(dev, 1, &fens[cur_frame], VK_TRUE, UINT64_MAX);
+    TRACE_SCOPE(__func__);
+    const uint32_t tri_count = get_draw_tri_count();
+    uint32_t batch_tris = params.batch_tris > 0 ? params.batch_tris : BATCH_INITIAL_TRIS;
 
-    update_bufs(cur_frame);
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> frame_tris{};
+    std::array<std::chrono::high_resolution_clock::time_point, MAX_FRAMES_IN_FLIGHT> submit_times{};
 
-    vkResetFences(dev, 1, &fens[cur_frame]);
+    uint32_t first_tri = 0;
+    uint32_t done_tris = 0;
+    batch_count = 0;
 
-    vkResetCommandBuffer(cmd_bufs[cur_frame], /*VkCommandBufferResetFlagBits*/ 0);
-    record_cmd_buf(cmd_bufs[cur_frame]);
+    while (true) {
+        vkWaitForFences(dev, 1, &fens[cur_frame], VK_TRUE, UINT64_MAX);
 
-    VkSubmitInfo submit{};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &cmd_bufs[cur_frame];
+        update_bufs(cur_frame);
+
+        vkResetFences(dev, 1, &fens[cur_frame]);
+
+        const uint32_t count = std::min(batch_tris, tri_count - first_tri);
+
+        vkResetCommandBuffer(cmd_bufs[cur_frame], /*VkCommandBufferResetFlagBits*/ 0);
+        record_cmd_buf(cmd_bufs[cur_frame], first_tri, count);
+
+        VkSubmitInfo submit{};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &cmd_bufs[cur_frame];
+
+        if (vkQueueSubmit(q_graph, 1, &submit, fens[cur_frame]) != VK_SUCCESS)
+            throw std::runtime_error("failed to submit render command buffer.");
+
+        frame_tris[cur_frame] = count;
+        submit_times[cur_frame] = std::chrono::high_resolution_clock::now();
+        first_tri += count;
+        batch_count++;
 
-    if (vkQueueSubmit(q_graph, 1, &submit, fens[cur_frame]) != VK_SUCCESS)
-        throw std::runtime_error("failed to submit render command buffer.");
+        cur_frame = (cur_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 
-    cur_frame = (cur_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+        if (first_tri == tri_count)
+            break;
+
+        // the previous batch, without timestamps its time includes waiting for the one before it
+        const uint32_t prev_frame = (cur_frame + MAX_FRAMES_IN_FLIGHT - 2) % MAX_FRAMES_IN_FLIGHT;
+        if (frame_tris[prev_frame] > 0) {
+            vkWaitForFences(dev, 1, &fens[prev_frame], VK_TRUE, UINT64_MAX);
+
+            const uint32_t batch_query = QUERY_BATCH_BEGIN + 2 * prev_frame;
+            double batch_time = get_gpu_time(batch_query, batch_query + 1);
+            if (batch_time < 0.0) {
+                const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::high_resolution_clock::now() - submit_times[prev_frame]);
+                batch_time = static_cast<double>(duration.count()) / 1000.0;
+            }
+
+            trace_gpu_queries("draw batch", batch_query, batch_query + 1);
+
+            done_tris += frame_tris[prev_frame];
+            batch_tris = tune_batch_tris(batch_tris, frame_tris[prev_frame], batch_time);
+            frame_tris[prev_frame] = 0;
+
+            if (print_batches)
+                *p_log << "\rrendered " << done_tris << " / " << tri_count << " triangles ("
+                       << 100 * static_cast<uint64_t>(done_tris) / tri_count << "%), batch size " << batch_tris
+                       << std::flush;
+        }
+
+        if (*p_abort_requested) {
+            vkQueueWaitIdle(q_graph);
+            *p_log << std::endl;
+            throw std::runtime_error("voxelization aborted.");
+        }
+    }
+
+    if (done_tris > 0 && print_batches)
+        *p_log << std::endl;
+
+    // the batches still in flight, waits for them only while tracing
+    if (trace_enabled()) {
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            const uint32_t batch_query = QUERY_BATCH_BEGIN + 2 * frame;
+            if (frame_tris[frame] > 0)
+                trace_gpu_queries("draw batch", batch_query, batch_query + 1);
+        }
+    }
 }
 
 void App::clean_up_sync() const {
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyFence(dev, fens[i], nullptr);
-    }
+    for (const VkFence fen: fens)
+        vkDestroyFence(dev, fen, nullptr);
 }
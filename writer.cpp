@@ -0,0 +1,462 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "writer.h"
+#include "prop.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define VCW_IO_URING
+#endif
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint8_t *alloc_block() {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(WRITER_BLOCK_SIZE, WRITER_BLOCK_ALIGN));
+#else
+    return static_cast<uint8_t*>(std::aligned_alloc(WRITER_BLOCK_ALIGN, WRITER_BLOCK_SIZE));
+#endif
+}
+
+static void free_block(uint8_t *p_block) {
+#ifdef _WIN32
+    _aligned_free(p_block);
+#else
+    std::free(p_block);
+#endif
+}
+
+static bool write_at(const int fd, const uint8_t *data, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    // no positional writes, the workers share the file position
+    static std::mutex seek_mutex;
+    std::lock_guard lock(seek_mutex);
+
+    if (_lseeki64(fd, static_cast<int64_t>(offset), SEEK_SET) < 0)
+        return false;
+    while (size > 0) {
+        const int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, WRITER_BLOCK_SIZE)));
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        const ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+#endif
+    return true;
+}
+
+#ifdef VCW_IO_URING
+
+// minimal io_uring on the raw syscalls, one thread submits and reaps. no sqpoll, so the kernel only reads the
+// submission ring inside io_uring_enter
+class IoUring {
+public:
+    // false if the kernel is too old or io_uring is disabled
+    bool init(const uint32_t entries) {
+        io_uring_params params = {};
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0)
+            return false;
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_size = cq_size = std::max(sq_size, cq_size);
+
+        p_sq = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                    IORING_OFF_SQ_RING);
+        p_cq = single_mmap ? p_sq : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                         IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void *p_sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_SQES);
+        if (p_sq == MAP_FAILED || p_cq == MAP_FAILED || p_sqes == MAP_FAILED) {
+            if (p_sqes != MAP_FAILED)
+                munmap(p_sqes, sqes_size);
+            release();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(p_sqes);
+
+        auto *sq = static_cast<uint8_t*>(p_sq);
+        sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+        auto *cq = static_cast<uint8_t*>(p_cq);
+        cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    ~IoUring() {
+        if (sqes)
+            munmap(sqes, sqes_size);
+        release();
+    }
+
+    // the caller keeps at most as many writes in flight as the ring has entries
+    void prep_write(const int fd, const void *data, const uint32_t size, const uint64_t offset,
+                    const uint64_t user_data) {
+        const uint32_t tail = *sq_tail;
+        const uint32_t index = tail & sq_mask;
+
+        io_uring_sqe &sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = size;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+    }
+
+    bool submit() {
+        while (pending > 0) {
+            const long submitted = syscall(__NR_io_uring_enter, ring_fd, pending, 0, 0, nullptr, 0);
+            if (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+                continue;
+            if (submitted < 0)
+                return false;
+            pending -= static_cast<uint32_t>(submitted);
+        }
+        return true;
+    }
+
+    // blocks until at least one completion is there
+    bool wait() {
+        const long result = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        return result >= 0 || errno == EINTR;
+    }
+
+    bool peek(io_uring_cqe *p_cqe) {
+        const uint32_t head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            return false;
+
+        *p_cqe = cqes[head & cq_mask];
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void release() {
+        if (p_cq != MAP_FAILED && p_cq != p_sq)
+            munmap(p_cq, cq_size);
+        if (p_sq != MAP_FAILED)
+            munmap(p_sq, sq_size);
+        p_sq = p_cq = MAP_FAILED;
+        // called again by the destructor after a failed init, the number may belong to another file by then
+        if (ring_fd >= 0)
+            close(ring_fd);
+        ring_fd = -1;
+    }
+
+    int ring_fd = -1;
+    void *p_sq = MAP_FAILED;
+    void *p_cq = MAP_FAILED;
+    size_t sq_size = 0;
+    size_t cq_size = 0;
+    size_t sqes_size = 0;
+    uint32_t pending = 0;
+
+    io_uring_sqe *sqes = nullptr;
+    uint32_t *sq_tail = nullptr;
+    uint32_t sq_mask = 0;
+    uint32_t *sq_array = nullptr;
+
+    uint32_t *cq_head = nullptr;
+    uint32_t *cq_tail = nullptr;
+    uint32_t cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+};
+
+#else
+
+class IoUring {
+};
+
+#endif
+
+FileWriter::FileWriter(const std::string &filename) : filename(filename) {
+#ifdef _WIN32
+    fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    if (fd < 0)
+        throw std::runtime_error("failed to open file.");
+
+    // one block more than in flight, so the producer can fill while the queue is busy
+    blocks.resize(WRITER_QUEUE_DEPTH + 1);
+    for (uint32_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = alloc_block();
+        if (!blocks[i])
+            throw std::runtime_error("failed to allocate writer blocks.");
+        free_blocks.push_back(i);
+    }
+
+#ifdef VCW_IO_URING
+    p_ring = std::make_unique<IoUring>();
+    if (p_ring->init(WRITER_QUEUE_DEPTH)) {
+        threads.emplace_back(&FileWriter::run_ring, this);
+        return;
+    }
+    p_ring.reset();
+#endif
+
+    for (uint32_t i = 0; i < WRITER_THREADS; ++i)
+        threads.emplace_back(&FileWriter::run_worker, this);
+}
+
+FileWriter::~FileWriter() {
+    try {
+        finish();
+    } catch (const std::exception &e) {
+        std::cerr << filename << ": " << e.what() << std::endl;
+    }
+
+    for (uint8_t *p_block: blocks)
+        free_block(p_block);
+}
+
+const char *FileWriter::get_backend_name() const {
+    return p_ring ? "io_uring" : "pwrite";
+}
+
+void FileWriter::write(const void *data, size_t size) {
+    auto p_data = static_cast<const uint8_t*>(data);
+
+    while (size > 0) {
+        if (cur_block == UINT32_MAX)
+            acquire_block();
+
+        const size_t count = std::min<size_t>(size, WRITER_BLOCK_SIZE - cur_fill);
+        std::memcpy(blocks[cur_block] + cur_fill, p_data, count);
+        cur_fill += count;
+        p_data += count;
+        size -= count;
+
+        if (cur_fill == WRITER_BLOCK_SIZE)
+            submit_block();
+    }
+}
+
+void FileWriter::write_shared(const void *p_data, size_t size, const std::shared_ptr<const void> &p_owner) {
+    auto data = static_cast<const uint8_t*>(p_data);
+
+    // top up the staging block first, then the buffer goes out in whole blocks on block boundaries
+    if (cur_fill > 0) {
+        const size_t count = std::min<size_t>(size, WRITER_BLOCK_SIZE - cur_fill);
+        write(data, count);
+        data += count;
+        size -= count;
+    }
+
+    while (size >= WRITER_BLOCK_SIZE) {
+        enqueue({data, WRITER_BLOCK_SIZE, offset, UINT32_MAX, p_owner});
+        offset += WRITER_BLOCK_SIZE;
+        data += WRITER_BLOCK_SIZE;
+        size -= WRITER_BLOCK_SIZE;
+    }
+
+    write(data, size);
+}
+
+void FileWriter::patch(const uint64_t offset, const void *data, const size_t size) {
+    const auto p_data = static_cast<const uint8_t*>(data);
+    patches.emplace_back(offset, std::vector(p_data, p_data + size));
+}
+
+void FileWriter::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    if (cur_block != UINT32_MAX)
+        submit_block();
+
+    {
+        std::lock_guard lock(mutex);
+        closing = true;
+    }
+    cond.notify_all();
+
+    for (auto &thread: threads)
+        thread.join();
+    threads.clear();
+    p_ring.reset();
+
+    for (const auto &[patch_offset, data]: patches)
+        failed |= !write_at(fd, data.data(), data.size(), patch_offset);
+    patches.clear();
+
+#ifdef _WIN32
+    const bool closed = _close(fd) == 0;
+#else
+    const bool closed = close(fd) == 0;
+#endif
+    fd = -1;
+
+    if (failed || !closed)
+        throw std::runtime_error("failed to write to file.");
+}
+
+void FileWriter::acquire_block() {
+    std::unique_lock lock(mutex);
+    cond.wait(lock, [&] { return !free_blocks.empty(); });
+
+    cur_block = free_blocks.back();
+    free_blocks.pop_back();
+    cur_fill = 0;
+}
+
+void FileWriter::submit_block() {
+    if (cur_fill == 0) {
+        std::lock_guard lock(mutex);
+        free_blocks.push_back(cur_block);
+    } else {
+        enqueue({blocks[cur_block], cur_fill, offset, cur_block, nullptr});
+        offset += cur_fill;
+    }
+
+    cur_block = UINT32_MAX;
+    cur_fill = 0;
+}
+
+void FileWriter::enqueue(Piece piece) {
+    {
+        std::lock_guard lock(mutex);
+        pieces.push_back(std::move(piece));
+    }
+    cond.notify_all();
+}
+
+bool FileWriter::next_piece(Piece *p_piece, const bool wait) {
+    std::unique_lock lock(mutex);
+    if (wait)
+        cond.wait(lock, [&] { return !pieces.empty() || closing; });
+    if (pieces.empty())
+        return false;
+
+    *p_piece = std::move(pieces.front());
+    pieces.pop_front();
+
+    if (in_flight++ == 0)
+        busy_begin_ns = now_ns();
+    return true;
+}
+
+void FileWriter::end_piece(const Piece &piece, const bool success) {
+    {
+        std::lock_guard lock(mutex);
+        failed |= !success;
+        if (piece.block != UINT32_MAX)
+            free_blocks.push_back(piece.block);
+        if (--in_flight == 0)
+            busy_ns += now_ns() - busy_begin_ns;
+    }
+    cond.notify_all();
+}
+
+void FileWriter::run_ring() {
+#ifdef VCW_IO_URING
+    // the slot index is the user data of a write
+    std::array<Piece, WRITER_QUEUE_DEPTH> slots;
+    std::vector<uint32_t> free_slots(WRITER_QUEUE_DEPTH);
+    std::iota(free_slots.rbegin(), free_slots.rend(), 0u);
+    bool broken = false;
+
+    while (true) {
+        // blocks for new pieces only while nothing is in flight, otherwise the next completion wakes us up
+        Piece piece;
+        while (!free_slots.empty() && next_piece(&piece, free_slots.size() == WRITER_QUEUE_DEPTH)) {
+            if (broken) {
+                end_piece(piece, write_at(fd, piece.data, piece.size, piece.offset));
+                continue;
+            }
+
+            const uint32_t slot = free_slots.back();
+            free_slots.pop_back();
+            slots[slot] = std::move(piece);
+            p_ring->prep_write(fd, slots[slot].data, static_cast<uint32_t>(slots[slot].size), slots[slot].offset,
+                               slot);
+        }
+        if (free_slots.size() == WRITER_QUEUE_DEPTH)
+            return;
+
+        // a ring that fails after setup drops what is in flight and the rest is written synchronously
+        if (!p_ring->submit() || !p_ring->wait()) {
+            broken = true;
+            for (uint32_t slot = 0; slot < WRITER_QUEUE_DEPTH; ++slot) {
+                if (std::find(free_slots.begin(), free_slots.end(), slot) == free_slots.end())
+                    end_piece(slots[slot], false);
+                slots[slot] = {};
+            }
+            free_slots.resize(WRITER_QUEUE_DEPTH);
+            std::iota(free_slots.rbegin(), free_slots.rend(), 0u);
+            continue;
+        }
+
+        io_uring_cqe cqe;
+        while (p_ring->peek(&cqe)) {
+            Piece &done = slots[cqe.user_data];
+            bool success = cqe.res == static_cast<int32_t>(done.size);
+
+            // short writes and kernels without IORING_OP_WRITE finish synchronously
+            if (!success) {
+                const size_t written = cqe.res > 0 ? cqe.res : 0;
+                success = write_at(fd, done.data + written, done.size - written, done.offset + written);
+            }
+
+            end_piece(done, success);
+            done = {};
+            free_slots.push_back(static_cast<uint32_t>(cqe.user_data));
+        }
+    }
+#endif
+}
+
+void FileWriter::run_worker() {
+    Piece piece;
+    while (next_piece(&piece, true)) {
+        end_piece(piece, write_at(fd, piece.data, piece.size, piece.offset));
+        piece = {};
+    }
+}
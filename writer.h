@@ -0,0 +1,110 @@
+//
+// Created by Ludw on 4/25/2024.
+//
+
+#include "inc.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#ifndef VCW_WRITER_H
+#define VCW_WRITER_H
+
+// output writer: the file stays open and is written in the background in blocks of WRITER_BLOCK_SIZE at aligned
+// offsets, through io_uring on linux and a pool of pwrite threads otherwise. small writes are gathered in aligned
+// staging blocks, buffers handed over with write_owned are written without a copy. errors surface in finish.
+
+class IoUring;
+
+class FileWriter {
+public:
+    explicit FileWriter(const std::string &filename);
+
+    ~FileWriter();
+
+    FileWriter(const FileWriter &) = delete;
+
+    FileWriter &operator=(const FileWriter &) = delete;
+
+    // copies data, blocks only while all staging blocks are in flight
+    void write(const void *data, size_t size);
+
+    // takes the buffer and returns right away, it is released once it is on disk
+    template<typename T>
+    void write_owned(std::vector<T> &&data) {
+        const auto p_owner = std::make_shared<const std::vector<T>>(std::move(data));
+        write_shared(p_owner->data(), p_owner->size() * sizeof(T), p_owner);
+    }
+
+    // writes data without a copy, p_owner keeps it alive until it is on disk. it must not change before finish
+    void write_shared(const void *data, size_t size, const std::shared_ptr<const void> &p_owner);
+
+    // overwrites written bytes once everything else is on disk, e.g. a header that is only known at the end
+    void patch(uint64_t offset, const void *data, size_t size);
+
+    // writes the last block, waits for everything and closes the file
+    void finish();
+
+    uint64_t get_size() const {
+        return offset + cur_fill;
+    }
+
+    // time in which at least one write was in flight
+    double get_busy_ms() const {
+        return static_cast<double>(busy_ns) / 1e6;
+    }
+
+    const char *get_backend_name() const;
+
+private:
+    // a block of the staging pool or a piece of a handed over buffer
+    struct Piece {
+        const uint8_t *data;
+        size_t size;
+        uint64_t offset;
+        uint32_t block;
+        std::shared_ptr<const void> p_owner;
+    };
+
+    void acquire_block();
+
+    void submit_block();
+
+    void enqueue(Piece piece);
+
+    // waits for a piece, false once the writer is closing and everything is taken
+    bool next_piece(Piece *p_piece, bool wait);
+
+    void end_piece(const Piece &piece, bool success);
+
+    void run_ring();
+
+    void run_worker();
+
+    int fd = -1;
+    std::string filename;
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> patches;
+    bool finished = false;
+
+    std::vector<uint8_t *> blocks;
+    std::vector<uint32_t> free_blocks;
+    uint32_t cur_block = UINT32_MAX;
+    size_t cur_fill = 0;
+    uint64_t offset = 0;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Piece> pieces;
+    uint32_t in_flight = 0;
+    bool closing = false;
+    bool failed = false;
+
+    int64_t busy_begin_ns = 0;
+    int64_t busy_ns = 0;
+
+    std::unique_ptr<IoUring> p_ring;
+    std::vector<std::thread> threads;
+};
+
+#endif //VCW_WRITER_H